@@ -0,0 +1,297 @@
+#include "bmp1.h"
+#include "bmpheader.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static void put32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; p[2] = (v >> 16) & 0xFF; p[3] = v >> 24;
+}
+static void put16(unsigned char *p, uint16_t v) {
+    p[0] = v & 0xFF; p[1] = v >> 8;
+}
+
+static int popcount64(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// BMP rows start with the most significant bit, t_bmp1 words with the least
+static void makeReverseTable(uint8_t *table) {
+    for (int v = 0; v < 256; v++) {
+        uint8_t r = 0;
+        for (int b = 0; b < 8; b++) r |= ((v >> b) & 1) << (7 - b);
+        table[v] = r;
+    }
+}
+
+// Bits past the width are kept at 0
+static uint64_t lastWordMask(int width) {
+    return width % 64 ? ((uint64_t)1 << (width % 64)) - 1 : ~(uint64_t)0;
+}
+
+t_bmp1 *bmp1_create(int width, int height) {
+    if (width <= 0 || height <= 0) return NULL;
+    t_bmp1 *img = malloc(sizeof(t_bmp1));
+    if (!img) return NULL;
+    img->width = width;
+    img->height = height;
+    img->wordsPerRow = (width + 63) / 64;
+    img->data = calloc((size_t)img->wordsPerRow * height, sizeof(uint64_t));
+    if (!img->data) {
+        free(img);
+        return NULL;
+    }
+    return img;
+}
+
+void bmp1_free(t_bmp1 *img) {
+    if (img) {
+        free(img->data);
+        free(img);
+    }
+}
+
+// Decode a whole 1-bit BMP file held in memory
+t_bmp1 *bmp1_decode(const void *buf, size_t len, t_status *status) {
+    const unsigned char *file = buf;
+
+    t_bmpHeader h;
+    if (bmp_parseHeader(file, len, &h) != 0) {
+        status_set(status, STATUS_CORRUPTED);
+        return NULL;
+    }
+    if (h.bitCount != 1 || h.compression != 0) {
+        status_set(status, STATUS_UNSUPPORTED);
+        return NULL;
+    }
+    if (h.dataOffset + (size_t)h.rowSize * h.height > len) {
+        status_set(status, STATUS_READ_FAILED);
+        return NULL;
+    }
+
+    // Set bits are the entry closest to white
+    unsigned char palette[8] = {0, 0, 0, 0, 255, 255, 255, 0};
+    memcpy(palette, file + h.paletteOffset, (h.colorsUsed < 2 ? h.colorsUsed : 2) * 4);
+    int invert = palette[0] + palette[1] + palette[2] > palette[4] + palette[5] + palette[6];
+
+    t_bmp1 *img = bmp1_create(h.width, h.height);
+    if (!img) {
+        status_set(status, STATUS_NO_MEMORY);
+        return NULL;
+    }
+
+    uint8_t reverse[256];
+    makeReverseTable(reverse);
+    uint64_t mask = lastWordMask(img->width);
+    int bytes = (img->width + 7) / 8;
+    for (int y = 0; y < img->height; y++) {
+        const unsigned char *row = file + h.dataOffset + (size_t)y * h.rowSize;
+        uint64_t *dst = BMP1_ROW(img, h.topDown ? y : img->height - 1 - y);
+        for (int i = 0; i < bytes; i++) dst[i >> 3] |= (uint64_t)reverse[row[i]] << (8 * (i & 7));
+        if (invert) {
+            for (int i = 0; i < img->wordsPerRow; i++) dst[i] = ~dst[i];
+        }
+        dst[img->wordsPerRow - 1] &= mask;
+    }
+
+    status_set(status, STATUS_OK);
+    return img;
+}
+
+t_bmp1 *bmp1_loadImage(const char *filename, t_status *status) {
+    size_t len;
+    unsigned char *file = bmp_readFile(filename, &len, status);
+    if (!file) return NULL;
+    t_bmp1 *img = bmp1_decode(file, len, status);
+    free(file);
+    return img;
+}
+
+// Black and white palette, bottom-up rows
+static void bmp1_write(t_bmpWriter *w, const t_bmp1 *img) {
+    uint32_t rowSize = (img->width + 31) / 32 * 4;
+    uint32_t offset = 14 + 40 + 8;
+    uint32_t imageSize = rowSize * img->height;
+
+    unsigned char header[14 + 40 + 8] = {0};
+    put16(header, 0x4D42);
+    put32(header + 2, offset + imageSize);
+    put32(header + 10, offset);
+
+    unsigned char *info = header + 14;
+    put32(info, 40);
+    put32(info + 4, (uint32_t)img->width);
+    put32(info + 8, (uint32_t)img->height);
+    put16(info + 12, 1);
+    put16(info + 14, 1);
+    put32(info + 20, imageSize);
+    put32(info + 24, 2835);
+    put32(info + 28, 2835);
+    put32(info + 32, 2);
+    // Color table: black, white
+    memset(info + 44, 255, 3);
+    bmp_write(w, header, offset);
+
+    unsigned char *row = calloc(rowSize, 1);
+    if (!row) {
+        w->status = STATUS_NO_MEMORY;
+        return;
+    }
+    uint8_t reverse[256];
+    makeReverseTable(reverse);
+    int bytes = (img->width + 7) / 8;
+    for (int y = img->height - 1; y >= 0; y--) {
+        const uint64_t *src = BMP1_ROW(img, y);
+        for (int i = 0; i < bytes; i++) row[i] = reverse[(src[i >> 3] >> (8 * (i & 7))) & 0xFF];
+        bmp_write(w, row, rowSize);
+    }
+    free(row);
+}
+
+t_status bmp1_encode(const t_bmp1 *img, t_buffer *out) {
+    t_bmpWriter w = {NULL, out, STATUS_OK};
+    out->size = 0;
+    bmp1_write(&w, img);
+    return w.status;
+}
+
+t_status bmp1_saveImage(const t_bmp1 *img, const char *filename) {
+    t_bmpWriter w = {fopen(filename, "wb"), NULL, STATUS_OK};
+    if (!w.file) return STATUS_OPEN_FAILED;
+    bmp1_write(&w, img);
+    if (fclose(w.file) != 0 && w.status == STATUS_OK) w.status = STATUS_WRITE_FAILED;
+    return w.status;
+}
+
+// ---- Threshold ----
+
+typedef struct {
+    const t_bmp8 *src;
+    uint8_t threshold;
+    t_bmp1 *dst;
+} t_thresholdJob;
+
+// Bit i is set when p[i] >= threshold, n <= 64
+static uint64_t thresholdWord(const uint8_t *p, int n, uint8_t threshold) {
+    uint64_t word = 0;
+    int i = 0;
+#ifdef __SSE2__
+    // Unsigned v >= t is max(v, t) == v, one mask bit per byte
+    const __m128i t = _mm_set1_epi8((char)threshold);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, t), v));
+        word |= (uint64_t)(uint16_t)bits << i;
+    }
+#endif
+    for (; i < n; i++) word |= (uint64_t)(p[i] >= threshold) << i;
+    return word;
+}
+
+static void thresholdRows(int begin, int end, void *arg) {
+    const t_thresholdJob *job = arg;
+    const t_bmp8 *src = job->src;
+    int stride = ((src->width + 3) / 4) * 4;
+    for (int y = begin; y < end; y++) {
+        const uint8_t *row = src->data + (size_t)(src->topDown ? y : (int)src->height - 1 - y) * stride;
+        uint64_t *dst = BMP1_ROW(job->dst, y);
+        for (int i = 0; i < job->dst->wordsPerRow; i++) {
+            int n = job->dst->width - 64 * i < 64 ? job->dst->width - 64 * i : 64;
+            dst[i] = thresholdWord(row + 64 * i, n, job->threshold);
+        }
+    }
+}
+
+t_bmp1 *bmp8_thresholdToBmp1(const t_bmp8 *img, int threshold) {
+    t_bmp1 *out = bmp1_create(img->width, img->height);
+    if (!out || threshold > 255) return out;
+    t_thresholdJob job = {img, (uint8_t)(threshold < 0 ? 0 : threshold), out};
+    parallel_for(out->height, thresholdRows, &job);
+    return out;
+}
+
+t_bmp8 *bmp1_toBmp8(const t_bmp1 *img) {
+    t_bmp8 *out = bmp8_create(img->width, img->height);
+    if (!out) return NULL;
+    int stride = ((img->width + 3) / 4) * 4;
+    for (int y = 0; y < img->height; y++) {
+        unsigned char *row = out->data + (size_t)(img->height - 1 - y) * stride;
+        for (int x = 0; x < img->width; x++) row[x] = BMP1_GET(img, x, y) ? 255 : 0;
+    }
+    return out;
+}
+
+// ---- Statistics and logic ----
+
+uint64_t bmp1_count(const t_bmp1 *img) {
+    uint64_t count = 0;
+    size_t n = (size_t)img->wordsPerRow * img->height;
+    for (size_t i = 0; i < n; i++) count += popcount64(img->data[i]);
+    return count;
+}
+
+uint64_t bmp1_countRect(const t_bmp1 *img, int x, int y, int width, int height) {
+    // Clip to the image
+    int x1 = x + width, y1 = y + height;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x1 > img->width) x1 = img->width;
+    if (y1 > img->height) y1 = img->height;
+    if (x >= x1 || y >= y1) return 0;
+
+    int first = x >> 6, last = (x1 - 1) >> 6;
+    uint64_t firstMask = ~(uint64_t)0 << (x & 63);
+    uint64_t lastMask = lastWordMask(x1);
+    uint64_t count = 0;
+    for (int r = y; r < y1; r++) {
+        const uint64_t *row = BMP1_ROW(img, r);
+        if (first == last) {
+            count += popcount64(row[first] & firstMask & lastMask);
+            continue;
+        }
+        count += popcount64(row[first] & firstMask) + popcount64(row[last] & lastMask);
+        for (int i = first + 1; i < last; i++) count += popcount64(row[i]);
+    }
+    return count;
+}
+
+t_status bmp1_and(t_bmp1 *dst, const t_bmp1 *src) {
+    if (dst->width != src->width || dst->height != src->height) return STATUS_INVALID_ARGUMENT;
+    size_t n = (size_t)dst->wordsPerRow * dst->height;
+    for (size_t i = 0; i < n; i++) dst->data[i] &= src->data[i];
+    return STATUS_OK;
+}
+
+t_status bmp1_or(t_bmp1 *dst, const t_bmp1 *src) {
+    if (dst->width != src->width || dst->height != src->height) return STATUS_INVALID_ARGUMENT;
+    size_t n = (size_t)dst->wordsPerRow * dst->height;
+    for (size_t i = 0; i < n; i++) dst->data[i] |= src->data[i];
+    return STATUS_OK;
+}
+
+t_status bmp1_xor(t_bmp1 *dst, const t_bmp1 *src) {
+    if (dst->width != src->width || dst->height != src->height) return STATUS_INVALID_ARGUMENT;
+    size_t n = (size_t)dst->wordsPerRow * dst->height;
+    for (size_t i = 0; i < n; i++) dst->data[i] ^= src->data[i];
+    return STATUS_OK;
+}
+
+void bmp1_not(t_bmp1 *img) {
+    uint64_t mask = lastWordMask(img->width);
+    for (int y = 0; y < img->height; y++) {
+        uint64_t *row = BMP1_ROW(img, y);
+        for (int i = 0; i < img->wordsPerRow; i++) row[i] = ~row[i];
+        row[img->wordsPerRow - 1] &= mask;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef BMP1_H
+#define BMP1_H
+#include <stdint.h>
+#include "bmp8.h"
+
+// === Binary image, 1 bit per pixel ===
+// Rows are top-down, wordsPerRow words each. Pixel x is bit x % 64 of word
+// x / 64 and the bits past the width are always 0, so whole words can be
+// combined and counted without masking. A set bit is a white pixel.
+typedef struct {
+    int width;
+    int height;
+    int wordsPerRow;
+    uint64_t *data;
+} t_bmp1;
+
+#define BMP1_ROW(img, y) ((img)->data + (size_t)(y) * (img)->wordsPerRow)
+#define BMP1_GET(img, x, y) ((BMP1_ROW(img, y)[(x) >> 6] >> ((x) & 63)) & 1)
+
+// All pixels black
+t_bmp1 *bmp1_create(int width, int height);
+void bmp1_free(t_bmp1 *img);
+
+// 1-bit BMP files (the palette entry closest to white becomes the set bit)
+// status may be NULL
+t_bmp1 *bmp1_loadImage(const char *filename, t_status *status);
+t_status bmp1_saveImage(const t_bmp1 *img, const char *filename);
+// Same from / to memory: buf holds a whole BMP file, out receives one
+t_bmp1 *bmp1_decode(const void *buf, size_t len, t_status *status);
+t_status bmp1_encode(const t_bmp1 *img, t_buffer *out);
+
+// Same test as bmp8_threshold (pixel >= threshold), written straight to bits
+t_bmp1 *bmp8_thresholdToBmp1(const t_bmp8 *img, int threshold);
+// 0 / 255 grayscale image
+t_bmp8 *bmp1_toBmp8(const t_bmp1 *img);
+
+// Set pixels in the image, or in the rectangle [x, x + width) x [y, y + height)
+uint64_t bmp1_count(const t_bmp1 *img);
+uint64_t bmp1_countRect(const t_bmp1 *img, int x, int y, int width, int height);
+
+// dst = dst op src, STATUS_INVALID_ARGUMENT when the sizes differ
+t_status bmp1_and(t_bmp1 *dst, const t_bmp1 *src);
+t_status bmp1_or(t_bmp1 *dst, const t_bmp1 *src);
+t_status bmp1_xor(t_bmp1 *dst, const t_bmp1 *src);
+void bmp1_not(t_bmp1 *img);
+
+#endif // BMP1_H
@@ -1,7 +1,22 @@
 #include "bmp24.h"
+#include "bmpheader.h"
+#include "fft.h"
+#include "convolution.h"
+#include "dispatch.h"
+#include "orient.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
+
+// Little-endian helpers
+static void put32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; p[2] = (v >> 16) & 0xFF; p[3] = v >> 24;
+}
+
+static void put16(unsigned char *p, uint16_t v) {
+    p[0] = v & 0xFF; p[1] = v >> 8;
+}
 
 
 // Allocate a pixel matrix
@@ -26,6 +41,22 @@ void bmp24_freeDataPixels(t_pixel **pixels, int height) {
 }
 
 
+// Allocate an image
+t_bmp24 *bmp24_allocate(int width, int height, int colorDepth) {
+    if (width <= 0 || height <= 0) return NULL;
+    t_bmp24 *img = malloc(sizeof(t_bmp24));
+    if (!img) return NULL;
+    img->width = width;
+    img->height = height;
+    img->colorDepth = colorDepth;
+    img->data = bmp24_allocateDataPixels(width, height);
+    if (!img->data) {
+        free(img);
+        return NULL;
+    }
+    return img;
+}
+
 // Free the BMP
 void bmp24_free(t_bmp24 *img) {
     if (img) {
@@ -34,137 +65,131 @@ void bmp24_free(t_bmp24 *img) {
     }
 }
 
-// Load a BMP 24 bit image
-t_bmp24 *bmp24_loadImage(const char *filename) {
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
-        printf("Erreur ouverture fichier %s\n", filename);
-        return NULL;
-    }
-
-    // Manually read only the essential header fields
-    uint16_t type;
-    int32_t width, height;
-    uint16_t bits;
-    uint32_t compression, offset;
-
-    fseek(f, 0, SEEK_SET);
-    // BMP signature
-    fread(&type, sizeof(uint16_t), 1, f);
-
-    fseek(f, 18, SEEK_SET);
-    fread(&width, sizeof(int32_t), 1, f);
-    fread(&height, sizeof(int32_t), 1, f);
+// Decode a whole 24-bit BMP file held in memory
+t_bmp24 *bmp24_decode(const void *buf, size_t len, t_status *status) {
+    const unsigned char *file = buf;
 
-    fseek(f, 28, SEEK_SET);
-    fread(&bits, sizeof(uint16_t), 1, f);
-
-    fseek(f, 30, SEEK_SET);
-    fread(&compression, sizeof(uint32_t), 1, f);
-
-    fseek(f, 10, SEEK_SET);
-    fread(&offset, sizeof(uint32_t), 1, f);
+    // Header fields come from the shared reader (any header version)
+    t_bmpHeader h;
+    int valid = bmp_parseHeader(file, len, &h) == 0;
 
     // Validate BMP 24-bit uncompressed format
-    if (type != 0x4D42 || bits != 24 || compression != 0) {
-        printf("Incompatible file. BMP 24 bits must be uncompressed .\n");
-        fclose(f);
+    if (!valid || h.bitCount != 24 || h.compression != 0) {
+        status_set(status, valid ? STATUS_UNSUPPORTED : STATUS_CORRUPTED);
+        return NULL;
+    }
+    if (h.dataOffset + (size_t)h.rowSize * h.height > len) {
+        status_set(status, STATUS_READ_FAILED);
         return NULL;
     }
+    int width = h.width;
+    int height = h.height;
 
     // structure is allocated
-    t_bmp24 *img = malloc(sizeof(t_bmp24));
-    img->width = width;
-    img->height = height;
-    img->colorDepth = bits;
-    img->data = bmp24_allocateDataPixels(width, height);
-    if (!img->data) {
-        fclose(f);
-        free(img);
+    t_bmp24 *img = bmp24_allocate(width, height, h.bitCount);
+    if (!img) {
+        status_set(status, STATUS_NO_MEMORY);
         return NULL;
     }
 
-    fseek(f, offset, SEEK_SET);
-    int padding = (4 - (width * 3) % 4) % 4;
-
+    // Rows are read in place (padding included), top-down files keep their row order
+    const t_kernels *kernels = dispatch_selected();
     for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            unsigned char bgr[3];
-            fread(bgr, 1, 3, f);
-            img->data[height - 1 - y][x].blue = bgr[0];
-            img->data[height - 1 - y][x].green = bgr[1];
-            img->data[height - 1 - y][x].red = bgr[2];
-        }
-        // padding byte skip
-        fseek(f, padding, SEEK_CUR);
+        const unsigned char *row = file + h.dataOffset + (size_t)y * h.rowSize;
+        kernels->swapRedBlue((uint8_t *)img->data[h.topDown ? y : height - 1 - y], row, width);
     }
 
-    fclose(f);
-    printf("Image loaded : %dx%d\n", width, height);
+    status_set(status, STATUS_OK);
     return img;
 }
 
-// Save 24-bytes
-void bmp24_saveImage(t_bmp24 *img, const char *filename) {
-    FILE *f = fopen(filename, "wb");
-    if (!f) {
-        printf("Writing error  %s\n", filename);
+// Load a BMP 24 bit image
+t_bmp24 *bmp24_loadImage(const char *filename, t_status *status) {
+    size_t len;
+    unsigned char *file = bmp_readFile(filename, &len, status);
+    if (!file) return NULL;
+    t_bmp24 *img = bmp24_decode(file, len, status);
+    free(file);
+    return img;
+}
+
+// Rows written at once
+#define SAVE_STRIP 64
+
+static void bmp24_write(t_bmpWriter *w, t_bmp24 *img, t_orientation o) {
+    int width = orient_swapsAxes(o) ? img->height : img->width;
+    int height = orient_swapsAxes(o) ? img->width : img->height;
+    int rowSize = (width * 3 + 3) / 4 * 4;
+
+    // A strip of file rows and the source rows as bytes
+    unsigned char *strip = malloc((size_t)SAVE_STRIP * rowSize);
+    uint8_t **src = malloc(img->height * sizeof(uint8_t *));
+    uint8_t *rows[SAVE_STRIP];
+    if (!strip || !src) {
+        free(strip);
+        free(src);
+        w->status = STATUS_NO_MEMORY;
         return;
     }
+    for (int y = 0; y < img->height; y++) src[y] = (uint8_t *)img->data[y];
+    for (int i = 0; i < SAVE_STRIP; i++) rows[i] = strip + (size_t)i * rowSize;
+    const t_kernels *kernels = dispatch_selected();
 
-    // // BMP header
-    uint16_t type = 0x4D42;
+    // BMP file header then info header, little-endian
     uint32_t offset = 54;
-    uint32_t size = offset + (img->width * 3 + (4 - (img->width * 3 % 4)) % 4) * img->height;
-    uint16_t reserved = 0;
-
-    // BMP info header
-    fwrite(&type, sizeof(uint16_t), 1, f);
-    fwrite(&size, sizeof(uint32_t), 1, f);
-    fwrite(&reserved, sizeof(uint16_t), 1, f);
-    fwrite(&reserved, sizeof(uint16_t), 1, f);
-    fwrite(&offset, sizeof(uint32_t), 1, f);
-
-    // Header info
-    uint32_t headerSize = 40;
-    uint16_t planes = 1;
-    uint16_t bits = 24;
-    uint32_t compression = 0;
-    uint32_t imageSize = size - offset;
-    int32_t resolution = 2835;
-
-    fwrite(&headerSize, sizeof(uint32_t), 1, f);
-    fwrite(&img->width, sizeof(int32_t), 1, f);
-    fwrite(&img->height, sizeof(int32_t), 1, f);
-    fwrite(&planes, sizeof(uint16_t), 1, f);
-    fwrite(&bits, sizeof(uint16_t), 1, f);
-    fwrite(&compression, sizeof(uint32_t), 1, f);
-    fwrite(&imageSize, sizeof(uint32_t), 1, f);
-    fwrite(&resolution, sizeof(int32_t), 1, f);
-    fwrite(&resolution, sizeof(int32_t), 1, f);
-    // Ncolors = 0
-    fwrite(&compression, sizeof(uint32_t), 1, f);
-    // Important colors = 0
-    fwrite(&compression, sizeof(uint32_t), 1, f);
-
-    // Pixel is write
-    int padding = (4 - (img->width * 3) % 4) % 4;
-    unsigned char pad[3] = {0, 0, 0};
-
-    for (int y = img->height - 1; y >= 0; y--) {
-        for (int x = 0; x < img->width; x++) {
-            unsigned char bgr[3] = {
-                img->data[y][x].blue,
-                img->data[y][x].green,
-                img->data[y][x].red
-            };
-            fwrite(bgr, 1, 3, f);
+    uint32_t size = offset + rowSize * height;
+    unsigned char header[54] = {0};
+    put16(header, 0x4D42);
+    put32(header + 2, size);
+    put32(header + 10, offset);
+    put32(header + 14, 40);
+    put32(header + 18, (uint32_t)width);
+    put32(header + 22, (uint32_t)height);
+    put16(header + 26, 1);
+    put16(header + 28, 24);
+    put32(header + 34, size - offset);
+    put32(header + 38, 2835);
+    put32(header + 42, 2835);
+    bmp_write(w, header, sizeof(header));
+
+    // Pixel is write: the rotation and the bottom-up order are done by the same copy
+    for (int first = 0; first < height; first += SAVE_STRIP) {
+        int count = height - first < SAVE_STRIP ? height - first : SAVE_STRIP;
+        orient_copyRows(src, img->width, img->height, sizeof(t_pixel), o, 1, first, count, rows);
+        for (int i = 0; i < count; i++) {
+            unsigned char *p = rows[i];
+            kernels->swapRedBlue(p, p, width);
+            for (int x = width * 3; x < rowSize; x++) p[x] = 0;
         }
-        fwrite(pad, 1, padding, f);
+        bmp_write(w, strip, (size_t)rowSize * count);
     }
 
-    fclose(f);
-    printf("Image save successfully in %s\n", filename);
+    free(strip);
+    free(src);
+}
+
+t_status bmp24_encode(t_bmp24 *img, t_buffer *out) {
+    return bmp24_encodeOriented(img, out, ORIENT_NORMAL);
+}
+
+t_status bmp24_encodeOriented(t_bmp24 *img, t_buffer *out, t_orientation o) {
+    t_bmpWriter w = {NULL, out, STATUS_OK};
+    out->size = 0;
+    bmp24_write(&w, img, o);
+    return w.status;
+}
+
+// Save 24-bytes
+t_status bmp24_saveImage(t_bmp24 *img, const char *filename) {
+    return bmp24_saveImageOriented(img, filename, ORIENT_NORMAL);
+}
+
+t_status bmp24_saveImageOriented(t_bmp24 *img, const char *filename, t_orientation o) {
+    t_bmpWriter w = {fopen(filename, "wb"), NULL, STATUS_OK};
+    if (!w.file) return STATUS_OPEN_FAILED;
+    bmp24_write(&w, img, o);
+    if (fclose(w.file) != 0 && w.status == STATUS_OK) w.status = STATUS_WRITE_FAILED;
+    return w.status;
 }
 
 // Color inverting
@@ -181,13 +206,8 @@ void bmp24_negative(t_bmp24 *img) {
 
 // Grayscale converting
 void bmp24_grayscale(t_bmp24 *img) {
-    for (int y = 0; y < img->height; y++) {
-        for (int x = 0; x < img->width; x++) {
-            t_pixel *p = &img->data[y][x];
-            uint8_t g = (p->red + p->green + p->blue) / 3;
-            p->red = p->green = p->blue = g;
-        }
-    }
+    const t_kernels *kernels = dispatch_selected();
+    for (int y = 0; y < img->height; y++) kernels->grayscale((uint8_t *)img->data[y], img->width);
 }
 
 // Adjust brightness
@@ -228,9 +248,14 @@ t_pixel bmp24_convolution(t_bmp24 *img, int x, int y, float **kernel, int kernel
     return result;
 }
 
-void bmp24_applyFilter(t_bmp24 *img, float **kernel, int kernelSize) {
+t_status bmp24_applyFilter(t_bmp24 *img, float **kernel, int kernelSize) {
+    // Common sizes and separable kernels have their own loops
+    if (convolution_apply24(img, kernel, kernelSize) == 0) return STATUS_OK;
+    // Large kernels go through the FFT
+    if (fft_isFaster(kernelSize) && bmp24_applyFilterFFT(img, kernel, kernelSize) == STATUS_OK) return STATUS_OK;
+
     t_pixel **newData = bmp24_allocateDataPixels(img->width, img->height);
-    if (!newData) return;
+    if (!newData) return STATUS_NO_MEMORY;
 
     for (int y = 0; y < img->height; y++) {
         for (int x = 0; x < img->width; x++) {
@@ -240,57 +265,28 @@ void bmp24_applyFilter(t_bmp24 *img, float **kernel, int kernelSize) {
 
     bmp24_freeDataPixels(img->data, img->height);
     img->data = newData;
+    return STATUS_OK;
 }
 
 // Filters advanced
-void bmp24_boxBlur(t_bmp24 *img) {
-    float box[3][3] = {
-        {1/9.f, 1/9.f, 1/9.f},
-        {1/9.f, 1/9.f, 1/9.f},
-        {1/9.f, 1/9.f, 1/9.f}
-    };
-    float* kernel[3] = { box[0], box[1], box[2] };
-    bmp24_applyFilter(img, kernel, 3);
+t_status bmp24_boxBlur(t_bmp24 *img) {
+    return bmp24_applyPreset(img, PRESET_BOX);
 }
 
-void bmp24_gaussianBlur(t_bmp24 *img) {
-    float gauss[3][3] = {
-        {1/16.f, 2/16.f, 1/16.f},
-        {2/16.f, 4/16.f, 2/16.f},
-        {1/16.f, 2/16.f, 1/16.f}
-    };
-    float* kernel[3] = { gauss[0], gauss[1], gauss[2] };
-    bmp24_applyFilter(img, kernel, 3);
+t_status bmp24_gaussianBlur(t_bmp24 *img) {
+    return bmp24_applyPreset(img, PRESET_GAUSSIAN);
 }
 
-void bmp24_outline(t_bmp24 *img) {
-    float outline[3][3] = {
-        {-1, -1, -1},
-        {-1,  8, -1},
-        {-1, -1, -1}
-    };
-    float* kernel[3] = { outline[0], outline[1], outline[2] };
-    bmp24_applyFilter(img, kernel, 3);
+t_status bmp24_outline(t_bmp24 *img) {
+    return bmp24_applyPreset(img, PRESET_OUTLINE);
 }
 
-void bmp24_emboss(t_bmp24 *img) {
-    float emboss[3][3] = {
-        {-2, -1, 0},
-        {-1,  1, 1},
-        { 0,  1, 2}
-    };
-    float* kernel[3] = { emboss[0], emboss[1], emboss[2] };
-    bmp24_applyFilter(img, kernel, 3);
+t_status bmp24_emboss(t_bmp24 *img) {
+    return bmp24_applyPreset(img, PRESET_EMBOSS);
 }
 
-void bmp24_sharpen(t_bmp24 *img) {
-    float sharpen[3][3] = {
-        { 0, -1,  0},
-        {-1,  5, -1},
-        { 0, -1,  0}
-    };
-    float* kernel[3] = { sharpen[0], sharpen[1], sharpen[2] };
-    bmp24_applyFilter(img, kernel, 3);
+t_status bmp24_sharpen(t_bmp24 *img) {
+    return bmp24_applyPreset(img, PRESET_SHARPEN);
 }
 
 // Channel red
@@ -356,7 +352,7 @@ void computeEqualizationLUT(unsigned int *hist, int total, uint8_t *lut) {
     }
 }
 
-void bmp24_equalize(t_bmp24 *img) {
+t_status bmp24_equalize(t_bmp24 *img) {
     int width = img->width;
     int height = img->height;
     int size = width * height;
@@ -367,9 +363,8 @@ void bmp24_equalize(t_bmp24 *img) {
     float *V = malloc(size * sizeof(float));
 
     if (!Y || !U || !V) {
-        printf("Memory allocation failed.\n");
         free(Y); free(U); free(V);
-        return;
+        return STATUS_NO_MEMORY;
     }
 
     // 1 : conversion RGB to YUV
@@ -429,6 +424,6 @@ void bmp24_equalize(t_bmp24 *img) {
 
     // clean up
     free(Y); free(U); free(V);
-    printf("Histogram Equalization (Y-channel) applied successfully.\n");
+    return STATUS_OK;
 }
 
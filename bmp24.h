@@ -1,6 +1,9 @@
 #ifndef BMP24_H
 #define BMP24_H
 #include <stdint.h>
+#include <stddef.h>
+#include "buffer.h"
+#include "status.h"
 
 // Image BMP 24 bits ===
 typedef struct {
@@ -19,11 +22,16 @@ typedef struct {
 // Allocation
 t_pixel **bmp24_allocateDataPixels(int width, int height);
 void bmp24_freeDataPixels(t_pixel **pixels, int height);
+t_bmp24 *bmp24_allocate(int width, int height, int colorDepth);
 void bmp24_free(t_bmp24 *img);
 
 // Save
-t_bmp24 *bmp24_loadImage(const char *filename);
-void bmp24_saveImage(t_bmp24 *img, const char *filename);
+// status may be NULL
+t_bmp24 *bmp24_loadImage(const char *filename, t_status *status);
+t_status bmp24_saveImage(t_bmp24 *img, const char *filename);
+// Same from / to memory: buf holds a whole BMP file, out receives one
+t_bmp24 *bmp24_decode(const void *buf, size_t len, t_status *status);
+t_status bmp24_encode(t_bmp24 *img, t_buffer *out);
 
 // Filters
 void bmp24_negative(t_bmp24 *img);
@@ -31,18 +39,18 @@ void bmp24_grayscale(t_bmp24 *img);
 void bmp24_brightness(t_bmp24 *img, int value);
 
 // Convolution
-void bmp24_applyFilter(t_bmp24 *img, float **kernel, int kernelSize);
-void bmp24_boxBlur(t_bmp24 *img);
-void bmp24_gaussianBlur(t_bmp24 *img);
-void bmp24_outline(t_bmp24 *img);
-void bmp24_emboss(t_bmp24 *img);
-void bmp24_sharpen(t_bmp24 *img);
+t_status bmp24_applyFilter(t_bmp24 *img, float **kernel, int kernelSize);
+t_status bmp24_boxBlur(t_bmp24 *img);
+t_status bmp24_gaussianBlur(t_bmp24 *img);
+t_status bmp24_outline(t_bmp24 *img);
+t_status bmp24_emboss(t_bmp24 *img);
+t_status bmp24_sharpen(t_bmp24 *img);
 
 // P3
 unsigned int *bmp24_computeHistogramR(const t_bmp24 *img);
 unsigned int *bmp24_computeHistogramG(const t_bmp24 *img);
 unsigned int *bmp24_computeHistogramB(const t_bmp24 *img);
 void computeEqualizationLUT(unsigned int *hist, int totalPixels, uint8_t *lut);
-void bmp24_equalize(t_bmp24 *img);
+t_status bmp24_equalize(t_bmp24 *img);
 
 #endif // BMP24_H
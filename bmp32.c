@@ -0,0 +1,273 @@
+#include "bmp32.h"
+#include "bmpheader.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BMP32_ALIGN 32
+
+// Aligned block for pixel rows (aligned_alloc is missing on MinGW)
+// size is always a multiple of BMP32_ALIGN since the stride is 8 pixels
+static void *bmp32_alignedAlloc(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, BMP32_ALIGN);
+#else
+    return aligned_alloc(BMP32_ALIGN, size);
+#endif
+}
+
+static void bmp32_alignedFree(void *p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// Little-endian helpers
+static uint32_t get32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; p[2] = (v >> 16) & 0xFF; p[3] = v >> 24;
+}
+
+static void put16(unsigned char *p, uint16_t v) {
+    p[0] = v & 0xFF; p[1] = v >> 8;
+}
+
+// Allocate an image with aligned rows
+t_bmp32 *bmp32_allocate(int width, int height) {
+    if (width <= 0 || height <= 0) return NULL;
+    t_bmp32 *img = malloc(sizeof(t_bmp32));
+    if (!img) return NULL;
+    img->width = width;
+    img->height = height;
+    img->colorDepth = 32;
+    img->stride = (width + 7) & ~7;
+    img->compression = 0;
+    img->data = bmp32_alignedAlloc((size_t)img->stride * height * sizeof(t_pixel32));
+    if (!img->data) {
+        free(img);
+        return NULL;
+    }
+    // Padding pixels stay at 0 so whole-stride loops are safe
+    memset(img->data, 0, (size_t)img->stride * height * sizeof(t_pixel32));
+    return img;
+}
+
+void bmp32_free(t_bmp32 *img) {
+    if (img) {
+        bmp32_alignedFree(img->data);
+        free(img);
+    }
+}
+
+// One channel described by a BITFIELDS mask
+typedef struct {
+    uint32_t mask;
+    int shift;
+    uint32_t max;
+} t_channelMask;
+
+static t_channelMask makeChannel(uint32_t mask) {
+    t_channelMask c = {mask, 0, 0};
+    if (!mask) return c;
+    while (!((mask >> c.shift) & 1)) c.shift++;
+    c.max = mask >> c.shift;
+    return c;
+}
+
+// A channel without mask reads as 0, x * 255 needs 64 bits for a 32-bit mask
+static uint8_t extractChannel(uint32_t v, t_channelMask c) {
+    uint32_t x = (v & c.mask) >> c.shift;
+    if (c.max == 255) return (uint8_t)x;
+    if (!c.max) return 0;
+    return (uint8_t)(((uint64_t)x * 255 + c.max / 2) / c.max);
+}
+
+// Decode a whole 32-bit BMP file held in memory (24-bit images are promoted)
+t_bmp32 *bmp32_decode(const void *buf, size_t len, t_status *status) {
+    const unsigned char *file = buf;
+
+    t_bmpHeader h;
+    if (bmp_parseHeader(file, len, &h) != 0) {
+        status_set(status, STATUS_CORRUPTED);
+        return NULL;
+    }
+    int width = h.width;
+    int height = h.height;
+    uint16_t bits = h.bitCount;
+    uint32_t compression = h.compression;
+
+    int bitfields = compression == 3 || compression == 6;
+    if (!((bits == 32 && (compression == 0 || bitfields)) || (bits == 24 && compression == 0))) {
+        status_set(status, STATUS_UNSUPPORTED);
+        return NULL;
+    }
+    if (h.dataOffset + (size_t)h.rowSize * height > len) {
+        status_set(status, STATUS_READ_FAILED);
+        return NULL;
+    }
+
+    t_channelMask r = makeChannel(0x00FF0000), g = makeChannel(0x0000FF00);
+    t_channelMask b = makeChannel(0x000000FF), a = makeChannel(0xFF000000);
+    if (bitfields) {
+        r = makeChannel(h.redMask);
+        g = makeChannel(h.greenMask);
+        b = makeChannel(h.blueMask);
+        a = makeChannel(h.alphaMask);
+    }
+    // File rows already have the t_pixel32 layout
+    int direct = bits == 32 && r.mask == 0x00FF0000 && g.mask == 0x0000FF00 &&
+                 b.mask == 0x000000FF && a.mask == 0xFF000000;
+
+    t_bmp32 *img = bmp32_allocate(width, height);
+    if (!img) {
+        status_set(status, STATUS_NO_MEMORY);
+        return NULL;
+    }
+    img->compression = bits == 32 ? compression : 0;
+
+    const unsigned char *pixels = file + h.dataOffset;
+    if (direct && h.topDown && img->stride == width) {
+        // One copy: the pixel block is taken as is
+        memcpy(img->data, pixels, (size_t)width * height * 4);
+    } else {
+        for (int y = 0; y < height; y++) {
+            const unsigned char *row = pixels + (size_t)y * h.rowSize;
+            t_pixel32 *dst = BMP32_ROW(img, h.topDown ? y : height - 1 - y);
+            if (direct) {
+                memcpy(dst, row, (size_t)width * 4);
+            } else if (bits == 24) {
+                for (int x = 0; x < width; x++) {
+                    dst[x].blue = row[3 * x];
+                    dst[x].green = row[3 * x + 1];
+                    dst[x].red = row[3 * x + 2];
+                    dst[x].alpha = 255;
+                }
+            } else {
+                for (int x = 0; x < width; x++) {
+                    uint32_t v = get32(row + 4 * x);
+                    dst[x].red = extractChannel(v, r);
+                    dst[x].green = extractChannel(v, g);
+                    dst[x].blue = extractChannel(v, b);
+                    dst[x].alpha = a.mask ? extractChannel(v, a) : 255;
+                }
+            }
+        }
+    }
+
+    int anyAlpha = 0;
+    for (int y = 0; y < height && !anyAlpha && direct; y++) {
+        const t_pixel32 *p = BMP32_ROW(img, y);
+        for (int x = 0; x < width; x++) anyAlpha |= p[x].alpha;
+    }
+
+    // BI_RGB files usually leave the 4th byte at 0: treat it as opaque
+    if (bits == 32 && compression == 0 && !anyAlpha) {
+        for (int y = 0; y < height; y++) {
+            t_pixel32 *p = BMP32_ROW(img, y);
+            for (int x = 0; x < width; x++) p[x].alpha = 255;
+        }
+    }
+
+    status_set(status, STATUS_OK);
+    return img;
+}
+
+// Load a BMP 32 bit image (24-bit images are promoted)
+t_bmp32 *bmp32_loadImage(const char *filename, t_status *status) {
+    size_t len;
+    unsigned char *file = bmp_readFile(filename, &len, status);
+    if (!file) return NULL;
+    t_bmp32 *img = bmp32_decode(file, len, status);
+    free(file);
+    return img;
+}
+
+// BI_RGB with a 40-byte header or BI_BITFIELDS with a V4 header
+static void bmp32_write(t_bmpWriter *w, const t_bmp32 *img) {
+    int bitfields = img->compression != 0;
+    uint32_t infoSize = bitfields ? 108 : 40;
+    uint32_t offset = 14 + infoSize;
+    uint32_t imageSize = (uint32_t)img->width * 4 * img->height;
+
+    unsigned char header[14 + 108] = {0};
+    put16(header, 0x4D42);
+    put32(header + 2, offset + imageSize);
+    put32(header + 10, offset);
+
+    unsigned char *info = header + 14;
+    put32(info, infoSize);
+    put32(info + 4, (uint32_t)img->width);
+    put32(info + 8, (uint32_t)img->height);
+    put16(info + 12, 1);
+    put16(info + 14, 32);
+    put32(info + 16, bitfields ? 3 : 0);
+    put32(info + 20, imageSize);
+    put32(info + 24, 2835);
+    put32(info + 28, 2835);
+    if (bitfields) {
+        put32(info + 40, 0x00FF0000);
+        put32(info + 44, 0x0000FF00);
+        put32(info + 48, 0x000000FF);
+        put32(info + 52, 0xFF000000);
+        put32(info + 56, 0x73524742); // 'sRGB'
+    }
+    bmp_write(w, header, offset);
+
+    // Rows are bottom-up, a 32-bit row never needs padding
+    for (int y = img->height - 1; y >= 0; y--) {
+        bmp_write(w, BMP32_ROW(img, y), sizeof(t_pixel32) * img->width);
+    }
+}
+
+t_status bmp32_encode(t_bmp32 *img, t_buffer *out) {
+    t_bmpWriter w = {NULL, out, STATUS_OK};
+    out->size = 0;
+    bmp32_write(&w, img);
+    return w.status;
+}
+
+// Save 32-bytes
+t_status bmp32_saveImage(t_bmp32 *img, const char *filename) {
+    t_bmpWriter w = {fopen(filename, "wb"), NULL, STATUS_OK};
+    if (!w.file) return STATUS_OPEN_FAILED;
+    bmp32_write(&w, img);
+    if (fclose(w.file) != 0 && w.status == STATUS_OK) w.status = STATUS_WRITE_FAILED;
+    return w.status;
+}
+
+// Promote a 24-bit image
+t_bmp32 *bmp32_fromBmp24(const t_bmp24 *img) {
+    t_bmp32 *out = bmp32_allocate(img->width, img->height);
+    if (!out) return NULL;
+    for (int y = 0; y < img->height; y++) {
+        t_pixel32 *dst = BMP32_ROW(out, y);
+        for (int x = 0; x < img->width; x++) {
+            t_pixel p = img->data[y][x];
+            dst[x].blue = p.blue;
+            dst[x].green = p.green;
+            dst[x].red = p.red;
+            dst[x].alpha = 255;
+        }
+    }
+    return out;
+}
+
+// Back to 24-bit (alpha is dropped)
+t_bmp24 *bmp32_toBmp24(const t_bmp32 *img) {
+    t_bmp24 *out = bmp24_allocate(img->width, img->height, 24);
+    if (!out) return NULL;
+    for (int y = 0; y < img->height; y++) {
+        const t_pixel32 *src = BMP32_ROW(img, y);
+        for (int x = 0; x < img->width; x++) {
+            out->data[y][x].red = src[x].red;
+            out->data[y][x].green = src[x].green;
+            out->data[y][x].blue = src[x].blue;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,45 @@
+#ifndef BMP32_H
+#define BMP32_H
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp24.h"
+
+// Pixel BGRA 32 bits (same byte order as in the file)
+typedef struct {
+    uint8_t blue;
+    uint8_t green;
+    uint8_t red;
+    uint8_t alpha;
+} t_pixel32;
+
+// Image BMP 32 bits ===
+// All rows are in one block, top-down. The stride is a multiple of 8 pixels
+// and the block is 32-byte aligned, so a 128/256-bit lane holds exactly 4/8 pixels.
+typedef struct {
+    int width;
+    int height;
+    int colorDepth;
+    int stride;            // pixels per row
+    uint32_t compression;  // 0 = BI_RGB, 3 = BI_BITFIELDS (kept for saving)
+    t_pixel32 *data;
+} t_bmp32;
+
+#define BMP32_ROW(img, y) ((img)->data + (size_t)(y) * (img)->stride)
+
+// Allocation
+t_bmp32 *bmp32_allocate(int width, int height);
+void bmp32_free(t_bmp32 *img);
+
+// Load (32-bit BI_RGB / BI_BITFIELDS, 24-bit files are promoted) and save
+// status may be NULL
+t_bmp32 *bmp32_loadImage(const char *filename, t_status *status);
+t_status bmp32_saveImage(t_bmp32 *img, const char *filename);
+// Same from / to memory: buf holds a whole BMP file, out receives one
+t_bmp32 *bmp32_decode(const void *buf, size_t len, t_status *status);
+t_status bmp32_encode(t_bmp32 *img, t_buffer *out);
+
+// Conversion with the 24-bit format, whose filters are used on 32-bit images
+t_bmp32 *bmp32_fromBmp24(const t_bmp24 *img);
+t_bmp24 *bmp32_toBmp24(const t_bmp32 *img);
+
+#endif // BMP32_H
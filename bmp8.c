@@ -1,29 +1,29 @@
 #include "bmp8.h"
+#include "bmpheader.h"
+#include "fft.h"
+#include "convolution.h"
+#include "dispatch.h"
+#include "orient.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 
 unsigned int *bmp8_computeHistogram(t_bmp8 *img) {
     unsigned int *hist = calloc(256, sizeof(unsigned int));
-    if (!hist) {
-        printf("Memory allocation failed for histogram.\n");
-        return NULL;
-    }
+    if (!hist) return NULL;
 
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        hist[img->data[i]]++;
-    }
+    // Padding bytes at the end of the rows are not pixels
+    unsigned int stride = ((img->width + 3) / 4) * 4;
+    dispatch_selected()->histogram(img->data, img->width, img->height, stride, hist);
 
     return hist;
 }
 
 unsigned int *bmp8_computeCDF(unsigned int *hist) {
     unsigned int *cdf = malloc(256 * sizeof(unsigned int));
-    if (!cdf) {
-        printf("Memory allocation failed for CDF.\n");
-        return NULL;
-    }
+    if (!cdf) return NULL;
 
     cdf[0] = hist[0];
     for (int i = 1; i < 256; i++) {
@@ -47,133 +47,393 @@ void bmp8_equalize(t_bmp8 *img, unsigned int *cdf) {
         }
     }
 
-    // Looking for a CDF
-    printf("\n--- CDF Preview ---\n");
-    for (int i = 0; i < 256; i += 32) {
-        printf("cdf[%3d] = %u\n", i, cdf[i]);
-    }
-
     // Create the correspondance of the table
     for (int i = 0; i < 256; i++) {
         map[i] = (unsigned char) roundf(((float)(cdf[i] - cdf_min) / (totalPixels - cdf_min)) * 255.0f);
     }
 
-    // Finding a mappage table
-    printf("\n--- LUT Mapping ---\n");
-    for (int i = 0; i < 256; i += 32) {
-        printf("map[%3d] = %d\n", i, map[i]);
+    // Input the LUT to all the pixels
+    for (unsigned int i = 0; i < img->dataSize; i++) {
+        img->data[i] = map[img->data[i]];
     }
+}
+
 
-    // The change before and after of pixels values
-    printf("\n--- Sample pixel values (first 10) ---\n");
-    for (int i = 0; i < 10; i++) {
-        unsigned char old = img->data[i];
-        unsigned char new = map[old];
-        printf("Pixel[%d]: %d -> %d\n", i, old, new);
+// Decode a RLE8 / RLE4 stream into bottom-up rows of rowSize bytes (one index per byte)
+static int bmp8_decodeRLE(const unsigned char *src, size_t len, unsigned char *dst,
+                          unsigned int width, unsigned int height, unsigned int rowSize, int rle4) {
+    size_t i = 0;
+    unsigned int x = 0, y = 0;
+
+    while (i + 1 < len && y < height) {
+        unsigned int count = src[i];
+        unsigned int value = src[i + 1];
+        i += 2;
+
+        if (count > 0) {
+            // Encoded run, RLE4 alternates the two nibbles
+            for (unsigned int k = 0; k < count && x < width; k++, x++) {
+                dst[y * rowSize + x] = rle4 ? ((k & 1) ? (value & 0x0F) : (value >> 4)) : value;
+            }
+        } else if (value == 0) {
+            // End of line
+            x = 0;
+            y++;
+        } else if (value == 1) {
+            // End of bitmap
+            return 0;
+        } else if (value == 2) {
+            // Delta
+            if (i + 1 >= len) return -1;
+            x += src[i];
+            y += src[i + 1];
+            i += 2;
+        } else {
+            // Absolute mode, padded to a 16-bit boundary
+            unsigned int bytes = rle4 ? (value + 1) / 2 : value;
+            if (i + bytes > len) return -1;
+            for (unsigned int k = 0; k < value && x < width; k++, x++) {
+                unsigned char b = src[i + (rle4 ? k / 2 : k)];
+                dst[y * rowSize + x] = rle4 ? ((k & 1) ? (b & 0x0F) : (b >> 4)) : b;
+            }
+            i += bytes + (bytes & 1);
+        }
     }
+    return 0;
+}
 
-    // Input the LUT to all the pixels
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        img->data[i] = map[img->data[i]];
+// Encode the image in RLE8, returns a malloc'd buffer
+static unsigned char *bmp8_encodeRLE8(const t_bmp8 *img, unsigned int *outSize) {
+    unsigned int rowSize = ((img->width + 3) / 4) * 4;
+    // Worst case is 2 bytes per pixel, plus EOL per row and EOB
+    size_t capacity = ((size_t)img->width * 2 + 2) * img->height + 2;
+    unsigned char *out = malloc(capacity);
+    if (!out) return NULL;
+
+    size_t n = 0;
+    for (unsigned int y = 0; y < img->height; y++) {
+        // RLE bitmaps are always bottom-up
+        unsigned int fileRow = img->topDown ? img->height - 1 - y : y;
+        const unsigned char *row = img->data + (size_t)fileRow * rowSize;
+        unsigned int x = 0;
+        while (x < img->width) {
+            // Length of the run starting at x
+            unsigned int run = 1;
+            while (x + run < img->width && run < 255 && row[x + run] == row[x]) run++;
+
+            if (run >= 3 || img->width - x < 3) {
+                out[n++] = (unsigned char)run;
+                out[n++] = row[x];
+                x += run;
+                continue;
+            }
+
+            // Literal bytes until a run of 3 starts
+            unsigned int lit = 0;
+            while (x + lit < img->width && lit < 255) {
+                if (x + lit + 2 < img->width && row[x + lit] == row[x + lit + 1] &&
+                    row[x + lit] == row[x + lit + 2]) break;
+                lit++;
+            }
+            if (lit < 3) {
+                // Absolute mode needs 3 bytes at least
+                for (unsigned int k = 0; k < lit; k++) {
+                    out[n++] = 1;
+                    out[n++] = row[x + k];
+                }
+            } else {
+                out[n++] = 0;
+                out[n++] = (unsigned char)lit;
+                for (unsigned int k = 0; k < lit; k++) out[n++] = row[x + k];
+                if (lit & 1) out[n++] = 0;
+            }
+            x += lit;
+        }
+        // End of line
+        out[n++] = 0;
+        out[n++] = 0;
     }
+    // End of bitmap
+    out[n++] = 0;
+    out[n++] = 1;
+
+    *outSize = (unsigned int)n;
+    return out;
 }
 
+// Decode a whole BMP file held in memory
+t_bmp8 *bmp8_decode(const void *buf, size_t len, t_status *status) {
+    const unsigned char *file = buf;
 
-// Load the image from file
-t_bmp8 *bmp8_loadImage(const char *filename) {
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
-        printf("Unable to open file %s\n", filename);
+    // Header BMP, parsed by the shared reader
+    t_bmpHeader h;
+    if (bmp_parseHeader(file, len, &h) != 0) {
+        status_set(status, STATUS_CORRUPTED);
         return NULL;
     }
-
-    t_bmp8 *img = malloc(sizeof(t_bmp8));
-    if (!img) {
-        fclose(f);
-        printf("Memory allocation failed\n");
+    int depth = h.bitCount;
+    if (!(depth == 8 && (h.compression == BMP_BI_RGB || h.compression == BMP_BI_RLE8)) &&
+        !(depth == 4 && (h.compression == BMP_BI_RGB || h.compression == BMP_BI_RLE4))) {
+        status_set(status, STATUS_UNSUPPORTED);
+        return NULL;
+    }
+    // Palette and pixels must be inside the buffer
+    size_t streamSize = bmp_pixelDataSize(&h);
+    if ((size_t)h.paletteOffset + h.colorsUsed * 4 > len || h.dataOffset + streamSize > len) {
+        status_set(status, STATUS_READ_FAILED);
         return NULL;
     }
 
-    // Header BMP 
-    if (fread(img->header, sizeof(unsigned char), 54, f) != 54) {
-        printf("Failed to read BMP header.\n");
-        free(img);
-        fclose(f);
+    t_bmp8 *img = malloc(sizeof(t_bmp8));
+    if (!img) {
+        status_set(status, STATUS_NO_MEMORY);
         return NULL;
     }
+    // The first 54 bytes are kept for saving
+    memcpy(img->header, file, 54);
 
     // Extract info
-    img->width       = *(unsigned int *)&img->header[18];
-    img->height      = *(unsigned int *)&img->header[22];
-    img->colorDepth  = *(unsigned short *)&img->header[28];
-    img->dataSize    = *(unsigned int *)&img->header[34];
+    img->width       = h.width;
+    img->height      = h.height;
+    img->topDown     = h.topDown;
+    img->colorDepth  = h.bitCount;
+    img->compression = h.compression;
 
-    if (img->colorDepth != 8) {
-        printf("Only 8-bit grayscale BMP files are supported.\n");
-        free(img);
-        fclose(f);
-        return NULL;
-    }
+    // Read, biClrUsed entries (a 4-bit palette only has 16)
+    memset(img->colorTable, 0, 1024);
+    memcpy(img->colorTable, file + h.paletteOffset, h.colorsUsed * 4);
+
+    // Never trust biSizeImage for the pixel buffer
+    int rowSize = ((img->width + 3) / 4) * 4; // on 4 octets
+    int raw8 = depth == 8 && img->compression == BMP_BI_RGB;
+    img->dataSize = rowSize * img->height;
 
-    // Read 
-    if (fread(img->colorTable, sizeof(unsigned char), 1024, f) != 1024) {
-        printf("Failed to read color palette.\n");
+    // Allocation of pixel data
+    img->data = raw8 ? malloc(img->dataSize) : calloc(img->dataSize, 1);
+    if (!img->data) {
+        status_set(status, STATUS_NO_MEMORY);
         free(img);
-        fclose(f);
         return NULL;
     }
 
-    // We calculate again If dataSize is incorrect or equal to 0
-    if (img->dataSize == 0) {
-        int rowSize = ((img->width + 3) / 4) * 4; // on 4 octets
-        img->dataSize = rowSize * img->height;
+    // Pixels data, rows are kept in file order (top-down files need no flip)
+    const unsigned char *stream = file + h.dataOffset;
+    if (raw8) {
+        memcpy(img->data, stream, img->dataSize);
+        status_set(status, STATUS_OK);
+        return img;
     }
 
-    // Allocation of pixel data
-    img->data = malloc(img->dataSize);
-    if (!img->data) {
-        printf("Failed to allocate memory for image data.\n");
-        free(img);
-        fclose(f);
-        return NULL;
+    // Compressed or 4-bit stream
+    int decoded = 0;
+    if (img->compression == BMP_BI_RGB) {
+        // Raw 4-bit, two pixels per byte
+        unsigned int packedRow = h.rowSize;
+        for (unsigned int y = 0; y < img->height; y++) {
+            for (unsigned int x = 0; x < img->width; x++) {
+                unsigned char b = stream[y * packedRow + x / 2];
+                img->data[y * rowSize + x] = (x & 1) ? (b & 0x0F) : (b >> 4);
+            }
+        }
+    } else {
+        decoded = bmp8_decodeRLE(stream, streamSize, img->data, img->width, img->height, rowSize,
+                                 img->compression == BMP_BI_RLE4);
     }
 
-    // Pixels data
-    if (fread(img->data, sizeof(unsigned char), img->dataSize, f) != img->dataSize) {
-        printf("Failed to read pixel data.\n");
+    if (decoded != 0) {
+        status_set(status, STATUS_CORRUPTED);
         free(img->data);
         free(img);
-        fclose(f);
         return NULL;
     }
 
-    fclose(f);
+    // 4-bit images become 8-bit grayscale: indices are replaced by the gray level
+    if (depth == 4) {
+        unsigned char map[16];
+        for (int i = 0; i < 16; i++) {
+            unsigned char *c = &img->colorTable[i * 4];
+            map[i] = (unsigned char)((c[2] * 77 + c[1] * 150 + c[0] * 29 + 128) >> 8);
+        }
+        for (unsigned int i = 0; i < img->dataSize; i++) img->data[i] = map[img->data[i] & 0x0F];
+        for (int i = 0; i < 256; i++) {
+            img->colorTable[i * 4] = img->colorTable[i * 4 + 1] = img->colorTable[i * 4 + 2] = i;
+            img->colorTable[i * 4 + 3] = 0;
+        }
+        img->colorDepth = 8;
+        // RLE4 archives stay compressed when saved back
+        img->compression = img->compression == BMP_BI_RLE4 ? BMP_BI_RLE8 : BMP_BI_RGB;
+    }
+
+    status_set(status, STATUS_OK);
     return img;
 }
 
+// Load the image from file
+t_bmp8 *bmp8_loadImage(const char *filename, t_status *status) {
+    size_t len;
+    unsigned char *file = bmp_readFile(filename, &len, status);
+    if (!file) return NULL;
+    t_bmp8 *img = bmp8_decode(file, len, status);
+    free(file);
+    return img;
+}
+
+
+// Rows written at once when the image is reoriented
+#define SAVE_STRIP 64
 
-// Save img
-void bmp8_saveImage(const char *filename, t_bmp8 *img) {
-    FILE *f = fopen(filename, "wb");
-    if (!f) {
-        printf("Unable to save to %s\n", filename);
+static void bmp8_write(t_bmpWriter *w, t_bmp8 *img, t_orientation o);
+
+// RLE8 is encoded from a reoriented copy of the image
+static void bmp8_writeCopyOriented(t_bmpWriter *w, t_bmp8 *img, t_orientation o) {
+    t_bmp8 *copy = bmp8_create(img->width, img->height);
+    if (!copy) {
+        w->status = STATUS_NO_MEMORY;
         return;
     }
+    memcpy(copy->header, img->header, 54);
+    memcpy(copy->colorTable, img->colorTable, 1024);
+    memcpy(copy->data, img->data, img->dataSize);
+    copy->topDown = img->topDown;
+    copy->compression = img->compression;
+    t_status status = bmp8_orient(copy, o);
+    if (status == STATUS_OK) bmp8_write(w, copy, ORIENT_NORMAL);
+    else w->status = status;
+    bmp8_free(copy);
+}
 
-    // BMP header
-    fwrite(img->header, sizeof(unsigned char), 54, f);
+// Raw or RLE8 depending on img->compression
+static void bmp8_write(t_bmpWriter *w, t_bmp8 *img, t_orientation o) {
+    int rle = img->compression == BMP_BI_RLE8;
+    if (rle && o != ORIENT_NORMAL) {
+        bmp8_writeCopyOriented(w, img, o);
+        return;
+    }
+
+    unsigned int width = orient_swapsAxes(o) ? img->height : img->width;
+    unsigned int height = orient_swapsAxes(o) ? img->width : img->height;
+    unsigned char *pixels = img->data;
+    unsigned int size = ((width + 3) / 4) * 4 * height;
+    if (rle) {
+        pixels = bmp8_encodeRLE8(img, &size);
+        if (!pixels) {
+            w->status = STATUS_NO_MEMORY;
+            return;
+        }
+    }
+
+    // BMP header, fields describing the layout are rewritten
+    unsigned char header[54];
+    for (int i = 0; i < 54; i++) header[i] = img->header[i];
+    *(unsigned int *)&header[2]    = 54 + 1024 + size;
+    *(unsigned int *)&header[10]   = 54 + 1024;
+    *(unsigned int *)&header[14]   = 40;
+    *(int *)&header[18]            = (int)width;
+    *(int *)&header[22]            = (img->topDown && !rle) ? -(int)height : (int)height;
+    *(unsigned short *)&header[28] = 8;
+    *(unsigned int *)&header[30]   = rle ? BMP_BI_RLE8 : BMP_BI_RGB;
+    *(unsigned int *)&header[34]   = size;
+    *(unsigned int *)&header[46]   = 256;
+    bmp_write(w, header, 54);
 
     // Color table 
-    fwrite(img->colorTable, sizeof(unsigned char), 1024, f);
+    bmp_write(w, img->colorTable, 1024);
 
     // Image data 
-    fwrite(img->data, sizeof(unsigned char), img->dataSize, f);
+    if (o == ORIENT_NORMAL) {
+        bmp_write(w, pixels, size);
+        if (rle) free(pixels);
+        return;
+    }
+
+    // Source rows top to bottom, the output keeps the row order of the image
+    int stride = ((img->width + 3) / 4) * 4, outStride = ((width + 3) / 4) * 4;
+    uint8_t **src = malloc(img->height * sizeof(uint8_t *));
+    unsigned char *strip = calloc((size_t)SAVE_STRIP * outStride, 1);
+    uint8_t *rows[SAVE_STRIP];
+    if (src && strip) {
+        for (unsigned int y = 0; y < img->height; y++) {
+            src[y] = img->data + (size_t)(img->topDown ? y : img->height - 1 - y) * stride;
+        }
+        for (int i = 0; i < SAVE_STRIP; i++) rows[i] = strip + (size_t)i * outStride;
+        for (unsigned int first = 0; first < height; first += SAVE_STRIP) {
+            int count = height - first < SAVE_STRIP ? height - first : SAVE_STRIP;
+            orient_copyRows(src, img->width, img->height, 1, o, !img->topDown, first, count, rows);
+            bmp_write(w, strip, (size_t)outStride * count);
+        }
+    } else {
+        w->status = STATUS_NO_MEMORY;
+    }
+    free(src);
+    free(strip);
+}
 
-    printf("Image save successfully in %s\n", filename);
-    fclose(f);
+t_status bmp8_encode(t_bmp8 *img, t_buffer *out) {
+    return bmp8_encodeOriented(img, out, ORIENT_NORMAL);
 }
 
+t_status bmp8_encodeOriented(t_bmp8 *img, t_buffer *out, t_orientation o) {
+    t_bmpWriter w = {NULL, out, STATUS_OK};
+    out->size = 0;
+    bmp8_write(&w, img, o);
+    return w.status;
+}
+
+// Save img (raw or RLE8 depending on img->compression)
+t_status bmp8_saveImage(const char *filename, t_bmp8 *img) {
+    return bmp8_saveImageOriented(filename, img, ORIENT_NORMAL);
+}
+
+t_status bmp8_saveImageOriented(const char *filename, t_bmp8 *img, t_orientation o) {
+    t_bmpWriter w = {fopen(filename, "wb"), NULL, STATUS_OK};
+    if (!w.file) return STATUS_OPEN_FAILED;
+    bmp8_write(&w, img, o);
+    if (fclose(w.file) != 0 && w.status == STATUS_OK) w.status = STATUS_WRITE_FAILED;
+    return w.status;
+}
+
+
+
+// New black image with a grayscale palette
+t_bmp8 *bmp8_create(unsigned int width, unsigned int height) {
+    if (width == 0 || height == 0) return NULL;
+    t_bmp8 *img = malloc(sizeof(t_bmp8));
+    if (!img) return NULL;
+
+    img->width = width;
+    img->height = height;
+    img->colorDepth = 8;
+    img->compression = BMP_BI_RGB;
+    img->topDown = 0;
+    img->dataSize = ((width + 3) / 4) * 4 * height;
+    img->data = calloc(img->dataSize, 1);
+    if (!img->data) {
+        free(img);
+        return NULL;
+    }
 
+    // Header, the layout fields are rewritten on save anyway
+    for (int i = 0; i < 54; i++) img->header[i] = 0;
+    img->header[0] = 'B';
+    img->header[1] = 'M';
+    *(unsigned int *)&img->header[2]    = 54 + 1024 + img->dataSize;
+    *(unsigned int *)&img->header[10]   = 54 + 1024;
+    *(unsigned int *)&img->header[14]   = 40;
+    *(int *)&img->header[18]            = (int)width;
+    *(int *)&img->header[22]            = (int)height;
+    *(unsigned short *)&img->header[26] = 1;
+    *(unsigned short *)&img->header[28] = 8;
+    *(unsigned int *)&img->header[34]   = img->dataSize;
+    *(int *)&img->header[38]            = 2835;
+    *(int *)&img->header[42]            = 2835;
+    *(unsigned int *)&img->header[46]   = 256;
+
+    for (int i = 0; i < 256; i++) {
+        img->colorTable[i * 4] = img->colorTable[i * 4 + 1] = img->colorTable[i * 4 + 2] = i;
+        img->colorTable[i * 4 + 3] = 0;
+    }
+    return img;
+}
 
 // Free  memory from image
 void bmp8_free(t_bmp8 *img) {
@@ -183,15 +443,6 @@ void bmp8_free(t_bmp8 *img) {
     }
 }
 
-// Info
-void bmp8_printInfo(const t_bmp8 *img) {
-    printf("\nImage information:\n");
-    printf("Width        : %u pixels\n", img->width);
-    printf("Height       : %u pixels\n", img->height);
-    printf("Color Depth  : %u bits\n", img->colorDepth);
-    printf("Image Size   : %u bytes\n", img->dataSize);
-}
-
 // Negative 
 void bmp8_negative(t_bmp8 *img) {
     for (unsigned int i = 0; i < img->dataSize; i++) {
@@ -216,13 +467,18 @@ void bmp8_threshold(t_bmp8 *img, int threshold) {
 }
 
 // Convolution 
-void bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize) {
+t_status bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize) {
+    // Common sizes and separable kernels have their own loops
+    if (convolution_apply8(img, kernel, kernelSize) == 0) return STATUS_OK;
+    // Large kernels go through the FFT
+    if (fft_isFaster(kernelSize) && bmp8_applyFilterFFT(img, kernel, kernelSize) == STATUS_OK) return STATUS_OK;
+
     int n = kernelSize / 2;
+    int stride = ((img->width + 3) / 4) * 4; // rows are padded to 4 bytes
+    // Row iy + ky in memory is ky rows below in a top-down image, above otherwise
+    int down = img->topDown ? 1 : -1;
     unsigned char *newData = malloc(img->dataSize);
-    if (!newData) {
-        printf("Memory error during filter.\n");
-        return;
-    }
+    if (!newData) return STATUS_NO_MEMORY;
 
     for (unsigned int y = 0; y < img->height; y++) {
         for (unsigned int x = 0; x < img->width; x++) {
@@ -232,74 +488,45 @@ void bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize) {
                     int ix = x + kx;
                     int iy = y + ky;
                     if (ix >= 0 && ix < (int)img->width && iy >= 0 && iy < (int)img->height) {
-                        pixel += img->data[iy * img->width + ix] * kernel[ky + n][kx + n];
+                        pixel += img->data[iy * stride + ix] * kernel[down * ky + n][kx + n];
                     }
                 }
             }
             if (pixel < 0) pixel = 0;
             if (pixel > 255) pixel = 255;
-            newData[y * img->width + x] = (unsigned char)roundf(pixel);
+            newData[y * stride + x] = (unsigned char)roundf(pixel);
         }
     }
 
     // Replace image
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        img->data[i] = newData[i];
+    for (unsigned int y = 0; y < img->height; y++) {
+        for (unsigned int x = 0; x < img->width; x++) img->data[y * stride + x] = newData[y * stride + x];
     }
     free(newData);
+    return STATUS_OK;
 }
 
 // Predefined filters
-void bmp8_boxBlur(t_bmp8 *img) {
-    float box[3][3] = {
-        {1/9.f, 1/9.f, 1/9.f},
-        {1/9.f, 1/9.f, 1/9.f},
-        {1/9.f, 1/9.f, 1/9.f}
-    };
-    float* kernel[3] = { box[0], box[1], box[2] };
-    bmp8_applyFilter(img, kernel, 3);
+t_status bmp8_boxBlur(t_bmp8 *img) {
+    return bmp8_applyPreset(img, PRESET_BOX);
 }
 
 // Gaussian blur
-void bmp8_gaussianBlur(t_bmp8 *img) {
-    float gauss[3][3] = {
-        {1/16.f, 2/16.f, 1/16.f},
-        {2/16.f, 4/16.f, 2/16.f},
-        {1/16.f, 2/16.f, 1/16.f}
-    };
-    float* kernel[3] = { gauss[0], gauss[1], gauss[2] };
-    bmp8_applyFilter(img, kernel, 3);
+t_status bmp8_gaussianBlur(t_bmp8 *img) {
+    return bmp8_applyPreset(img, PRESET_GAUSSIAN);
 }
 
 // Outline
-void bmp8_outline(t_bmp8 *img) {
-    float outline[3][3] = {
-        {-1, -1, -1},
-        {-1,  8, -1},
-        {-1, -1, -1}
-    };
-    float* kernel[3] = { outline[0], outline[1], outline[2] };
-    bmp8_applyFilter(img, kernel, 3);
+t_status bmp8_outline(t_bmp8 *img) {
+    return bmp8_applyPreset(img, PRESET_OUTLINE);
 }
 
 // Emboss
-void bmp8_emboss(t_bmp8 *img) {
-    float emboss[3][3] = {
-        {-2, -1, 0},
-        {-1,  1, 1},
-        { 0,  1, 2}
-    };
-    float* kernel[3] = { emboss[0], emboss[1], emboss[2] };
-    bmp8_applyFilter(img, kernel, 3);
+t_status bmp8_emboss(t_bmp8 *img) {
+    return bmp8_applyPreset(img, PRESET_EMBOSS);
 }
 
 // Sharpen
-void bmp8_sharpen(t_bmp8 *img) {
-    float sharpen[3][3] = {
-        { 0, -1,  0},
-        {-1,  5, -1},
-        { 0, -1,  0}
-    };
-    float* kernel[3] = { sharpen[0], sharpen[1], sharpen[2] };
-    bmp8_applyFilter(img, kernel, 3);
+t_status bmp8_sharpen(t_bmp8 *img) {
+    return bmp8_applyPreset(img, PRESET_SHARPEN);
 }
@@ -1,6 +1,13 @@
 #ifndef BMP8_H
 #define BMP8_H
+#include <stddef.h>
+#include "buffer.h"
+#include "status.h"
 
+// Compression field of the BMP header
+#define BMP_BI_RGB  0
+#define BMP_BI_RLE8 1
+#define BMP_BI_RLE4 2
 
 // === Structure of a BMP image (8-bit format) ===
 typedef struct {
@@ -11,28 +18,35 @@ typedef struct {
     unsigned int height;
     unsigned short colorDepth;
     unsigned int dataSize;
+    unsigned int compression; // BMP_BI_RGB or BMP_BI_RLE8, used when saving
+    int topDown;              // rows are stored top-down (negative height in the file)
 } t_bmp8;
 
 // Function basic
-t_bmp8 *bmp8_loadImage(const char *filename);
-void bmp8_saveImage(const char *filename, t_bmp8 *img);
+// status may be NULL
+t_bmp8 *bmp8_loadImage(const char *filename, t_status *status);
+t_status bmp8_saveImage(const char *filename, t_bmp8 *img);
+// Same from / to memory: buf holds a whole BMP file, out receives one
+t_bmp8 *bmp8_decode(const void *buf, size_t len, t_status *status);
+t_status bmp8_encode(t_bmp8 *img, t_buffer *out);
 void bmp8_free(t_bmp8 *img);
-void bmp8_printInfo(const t_bmp8 *img);
+t_bmp8 *bmp8_create(unsigned int width, unsigned int height);
 
 // Filters simples
 void bmp8_negative(t_bmp8 *img);
 void bmp8_brightness(t_bmp8 *img, int value);
 void bmp8_threshold(t_bmp8 *img, int threshold);
 
-// Convolution filter
-void bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize);
+// Convolution filter: the first kernel row is the top one, whether the rows
+// are stored top-down or bottom-up
+t_status bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize);
 
 // Advanced filters
-void bmp8_boxBlur(t_bmp8 *img);
-void bmp8_gaussianBlur(t_bmp8 *img);
-void bmp8_outline(t_bmp8 *img);
-void bmp8_emboss(t_bmp8 *img);
-void bmp8_sharpen(t_bmp8 *img);
+t_status bmp8_boxBlur(t_bmp8 *img);
+t_status bmp8_gaussianBlur(t_bmp8 *img);
+t_status bmp8_outline(t_bmp8 *img);
+t_status bmp8_emboss(t_bmp8 *img);
+t_status bmp8_sharpen(t_bmp8 *img);
 
 // Part 3
 unsigned int *bmp8_computeHistogram(t_bmp8 *img);
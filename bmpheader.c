@@ -0,0 +1,115 @@
+#include "bmpheader.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Little-endian helpers
+static uint32_t get32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t get16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Shared by the 1, 8, 24 and 32-bit decoders
+int bmp_parseHeader(const unsigned char *file, size_t length, t_bmpHeader *h) {
+    unsigned char buf[14 + 124 + 16] = {0};
+
+    if (length < 54 || length > UINT32_MAX || get16(file) != 0x4D42) return -1;
+
+    h->fileSize = (uint32_t)length;
+    h->dataOffset = get32(file + 10);
+    h->infoSize = get32(file + 14);
+    if (h->infoSize != 40 && h->infoSize != 52 && h->infoSize != 56 &&
+        h->infoSize != 108 && h->infoSize != 124) return -1;
+
+    // A 40-byte header may be followed by the BITFIELDS masks, copy them too
+    size_t wanted = 14 + h->infoSize + (h->infoSize == 40 ? 16 : 0);
+    if (14 + h->infoSize > length) return -1;
+    memcpy(buf, file, wanted < length ? wanted : length);
+
+    const unsigned char *info = buf + 14;
+    h->width = (int32_t)get32(info + 4);
+    h->height = (int32_t)get32(info + 8);
+    h->bitCount = get16(info + 14);
+    h->compression = get32(info + 16);
+    h->imageSize = get32(info + 20);
+    h->xPixelsPerMeter = (int32_t)get32(info + 24);
+    h->yPixelsPerMeter = (int32_t)get32(info + 28);
+    h->colorsUsed = get32(info + 32);
+
+    h->topDown = h->height < 0;
+    if (h->topDown) h->height = -h->height;
+    if (h->width <= 0 || h->height <= 0 || h->width > 0x7FFFFF || h->height > 0x7FFFFF) return -1;
+
+    // Masks: inside V2+ headers, after a 40-byte header for BI_BITFIELDS (3) / BI_ALPHABITFIELDS (6)
+    int bitfields = h->compression == 3 || h->compression == 6;
+    h->redMask = h->greenMask = h->blueMask = h->alphaMask = 0;
+    if (bitfields || h->infoSize > 40) {
+        h->redMask = get32(info + 40);
+        h->greenMask = get32(info + 44);
+        h->blueMask = get32(info + 48);
+        if (h->infoSize >= 56 || h->compression == 6) h->alphaMask = get32(info + 52);
+    }
+    h->paletteOffset = 14 + h->infoSize;
+    if (h->infoSize == 40 && bitfields) h->paletteOffset += h->compression == 6 ? 16 : 12;
+
+    if (h->bitCount <= 8) {
+        if (h->colorsUsed == 0 || h->colorsUsed > (1u << h->bitCount)) h->colorsUsed = 1u << h->bitCount;
+    } else {
+        h->colorsUsed = 0;
+    }
+
+    h->rowSize = (uint32_t)((((uint64_t)h->width * h->bitCount + 31) / 32) * 4);
+
+    if (h->dataOffset < h->paletteOffset + h->colorsUsed * 4 || h->dataOffset >= h->fileSize) return -1;
+    // Compressed bitmaps are stored bottom-up only
+    if (h->topDown && h->compression != 0 && !bitfields) return -1;
+    return 0;
+}
+
+unsigned char *bmp_readFile(const char *filename, size_t *length, t_status *status) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        status_set(status, STATUS_OPEN_FAILED);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *file = size > 0 ? malloc((size_t)size) : NULL;
+    if (!file) {
+        status_set(status, size > 0 ? STATUS_NO_MEMORY : STATUS_READ_FAILED);
+        fclose(f);
+        return NULL;
+    }
+    if (fread(file, 1, (size_t)size, f) != (size_t)size) {
+        status_set(status, STATUS_READ_FAILED);
+        free(file);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *length = (size_t)size;
+    return file;
+}
+
+void bmp_write(t_bmpWriter *w, const void *data, size_t len) {
+    if (w->file) {
+        if (w->status == STATUS_OK && fwrite(data, 1, len, w->file) != len) w->status = STATUS_WRITE_FAILED;
+        return;
+    }
+    // A fixed buffer that is full keeps counting the size
+    if (w->status != STATUS_OK && w->status != STATUS_BUFFER_TOO_SMALL) return;
+    t_status s = buffer_append(w->buffer, data, len);
+    if (s != STATUS_OK) w->status = s;
+}
+
+uint32_t bmp_pixelDataSize(const t_bmpHeader *h) {
+    uint32_t available = h->fileSize - h->dataOffset;
+    if (h->compression == 0 || h->compression == 3 || h->compression == 6) {
+        return h->rowSize * (uint32_t)h->height;
+    }
+    if (h->imageSize != 0 && h->imageSize <= available) return h->imageSize;
+    return available;
+}
@@ -0,0 +1,48 @@
+#ifndef BMPHEADER_H
+#define BMPHEADER_H
+#include <stdio.h>
+#include <stdint.h>
+#include "buffer.h"
+#include "status.h"
+
+// === Parsed BMP file header + info header (BITMAPINFOHEADER up to V5) ===
+typedef struct {
+    uint32_t fileSize;       // real size of the file (bfSize is often wrong)
+    uint32_t dataOffset;     // bfOffBits, where the pixels start
+    uint32_t infoSize;       // 40, 52, 56, 108 (V4) or 124 (V5)
+    int32_t width;
+    int32_t height;          // always positive
+    int topDown;             // 1 when the height is negative in the file (first row is the top)
+    uint16_t bitCount;
+    uint32_t compression;
+    uint32_t imageSize;      // biSizeImage as found in the file (may be 0)
+    int32_t xPixelsPerMeter;
+    int32_t yPixelsPerMeter;
+    uint32_t colorsUsed;     // palette entries, 0 in the file is resolved to 1 << bitCount
+    uint32_t paletteOffset;  // where the palette starts
+    uint32_t redMask;        // BI_BITFIELDS masks (0 when absent)
+    uint32_t greenMask;
+    uint32_t blueMask;
+    uint32_t alphaMask;
+    uint32_t rowSize;        // bytes per uncompressed row, padded to 4
+} t_bmpHeader;
+
+// Parse and validate the headers of a whole file held in memory, 0 on success, -1 otherwise
+int bmp_parseHeader(const unsigned char *file, size_t length, t_bmpHeader *h);
+
+// The whole file in one malloc'd block (the loaders decode it from memory)
+unsigned char *bmp_readFile(const char *filename, size_t *length, t_status *status);
+
+// Encoders write either to a file or to a t_buffer, the first error is kept
+typedef struct {
+    FILE *file;           // NULL to write in buffer
+    t_buffer *buffer;
+    t_status status;
+} t_bmpWriter;
+
+void bmp_write(t_bmpWriter *w, const void *data, size_t len);
+
+// Size of the pixel data to read from dataOffset (computed for BI_RGB, trusted only if compressed)
+uint32_t bmp_pixelDataSize(const t_bmpHeader *h);
+
+#endif // BMPHEADER_H
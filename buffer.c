@@ -0,0 +1,46 @@
+#include "buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+void buffer_init(t_buffer *buf) {
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+    buf->growable = 1;
+}
+
+void buffer_wrap(t_buffer *buf, void *memory, size_t capacity) {
+    buf->data = memory;
+    buf->size = 0;
+    buf->capacity = capacity;
+    buf->growable = 0;
+}
+
+void buffer_free(t_buffer *buf) {
+    if (buf->growable) {
+        free(buf->data);
+        buf->data = NULL;
+        buf->capacity = 0;
+    }
+    buf->size = 0;
+}
+
+t_status buffer_append(t_buffer *buf, const void *data, size_t len) {
+    size_t end = buf->size + len;
+    if (end > buf->capacity) {
+        if (!buf->growable) {
+            buf->size = end;
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+        // Doubling keeps the number of copies logarithmic
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < end) capacity *= 2;
+        unsigned char *grown = realloc(buf->data, capacity);
+        if (!grown) return STATUS_NO_MEMORY;
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, data, len);
+    buf->size = end;
+    return STATUS_OK;
+}
@@ -0,0 +1,29 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+#include <stddef.h>
+#include "status.h"
+
+// === Destination of the *_encode functions ===
+// Either a growable block (realloc'ed as needed, released with buffer_free)
+// or memory owned by the caller. When a fixed buffer is too small the
+// encoder returns STATUS_BUFFER_TOO_SMALL and size is still the full size
+// of the encoded image, so the call can be repeated with enough room.
+typedef struct {
+    unsigned char *data;
+    size_t size;          // bytes of the encoded image
+    size_t capacity;
+    int growable;
+} t_buffer;
+
+// Empty growable buffer
+void buffer_init(t_buffer *buf);
+// Fixed buffer over capacity bytes of memory
+void buffer_wrap(t_buffer *buf, void *memory, size_t capacity);
+// Releases a growable buffer, a wrapped one is only reset
+void buffer_free(t_buffer *buf);
+
+// Appends len bytes. STATUS_BUFFER_TOO_SMALL when they do not fit in a
+// fixed buffer (size grows anyway), STATUS_NO_MEMORY if realloc fails
+t_status buffer_append(t_buffer *buf, const void *data, size_t len);
+
+#endif // BUFFER_H
@@ -0,0 +1,454 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define CACHE_LOCK(c) AcquireSRWLockExclusive(&(c)->lock)
+#define CACHE_UNLOCK(c) ReleaseSRWLockExclusive(&(c)->lock)
+#else
+#include <pthread.h>
+#define CACHE_LOCK(c) pthread_mutex_lock(&(c)->lock)
+#define CACHE_UNLOCK(c) pthread_mutex_unlock(&(c)->lock)
+#endif
+
+#define CACHE_FILE_MAGIC 0x32435049u   // "IPC2", rows top first
+
+typedef struct t_entry {
+    uint64_t key[2];
+    int width;
+    int height;
+    int channels;
+    char *description;
+    unsigned char *pixels;       // width * channels bytes per row, no padding
+    size_t bytes;                // counted against the budget
+    struct t_entry *newer;       // LRU list, newest first
+    struct t_entry *older;
+    struct t_entry *nextInBucket;
+} t_entry;
+
+struct t_cache {
+    size_t budget;
+    size_t bytes;
+    size_t entries;
+    char *directory;
+    t_entry **buckets;           // bucketCount is a power of two
+    size_t bucketCount;
+    t_entry *newest;
+    t_entry *oldest;
+    uint64_t hits;
+    uint64_t diskHits;
+    uint64_t misses;
+    unsigned int tempCounter;
+#ifdef _WIN32
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+// Rows of an image as bytes, top row first so an image hashes and is served
+// the same whichever row order it is stored in
+typedef struct {
+    uint8_t **rows;
+    int width;
+    int height;
+    int channels;
+} t_view;
+
+static int view8(const t_bmp8 *img, t_view *v) {
+    int stride = ((img->width + 3) / 4) * 4;
+    v->rows = malloc(img->height * sizeof(uint8_t *));
+    if (!v->rows) return -1;
+    for (unsigned int y = 0; y < img->height; y++) {
+        v->rows[y] = img->data + (size_t)(img->topDown ? y : img->height - 1 - y) * stride;
+    }
+    v->width = img->width;
+    v->height = img->height;
+    v->channels = 1;
+    return 0;
+}
+
+static int view24(const t_bmp24 *img, t_view *v) {
+    v->rows = malloc(img->height * sizeof(uint8_t *));
+    if (!v->rows) return -1;
+    for (int y = 0; y < img->height; y++) v->rows[y] = (uint8_t *)img->data[y];
+    v->width = img->width;
+    v->height = img->height;
+    v->channels = 3;
+    return 0;
+}
+
+// ---- Hash ----
+// Two independent 64-bit lanes fed 16 bytes at a time (a multiply and a
+// rotation per word), then mixed with the finalizer of MurmurHash3
+
+#define PRIME1 0x9E3779B185EBCA87ull
+#define PRIME2 0xC2B2AE3D27D4EB4Full
+#define PRIME3 0x165667B19E3779F9ull
+
+typedef struct {
+    uint64_t a;
+    uint64_t b;
+    uint64_t length;
+} t_hash;
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t load64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static void hashWords(t_hash *h, uint64_t w0, uint64_t w1) {
+    h->a = rotl64(h->a ^ (w0 * PRIME1), 31) * PRIME2;
+    h->b = rotl64(h->b ^ (w1 * PRIME2), 27) * PRIME3;
+}
+
+static void hashBytes(t_hash *h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    h->length += len;
+    for (; len >= 16; p += 16, len -= 16) hashWords(h, load64(p), load64(p + 8));
+    if (len > 0) {
+        unsigned char tail[16] = {0};
+        memcpy(tail, p, len);
+        tail[15] = (unsigned char)len;
+        hashWords(h, load64(tail), load64(tail + 8));
+    }
+}
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// Pixels (padding excluded) and pipeline text
+static void computeKey(const t_view *v, const char *description, uint64_t key[2]) {
+    t_hash h = {PRIME3, PRIME1, 0};
+    uint32_t shape[3] = {(uint32_t)v->width, (uint32_t)v->height, (uint32_t)v->channels};
+    hashBytes(&h, shape, sizeof(shape));
+    for (int y = 0; y < v->height; y++) hashBytes(&h, v->rows[y], (size_t)v->width * v->channels);
+    hashBytes(&h, description, strlen(description));
+    uint64_t a = mix64(h.a ^ h.length), b = mix64(h.b + h.length * PRIME1);
+    key[0] = a ^ b;
+    key[1] = mix64(a + b);
+}
+
+// ---- Memory tier (called with the lock held) ----
+
+static void unlinkEntry(t_cache *c, t_entry *e) {
+    if (e->newer) e->newer->older = e->older;
+    else c->newest = e->older;
+    if (e->older) e->older->newer = e->newer;
+    else c->oldest = e->newer;
+}
+
+static void pushNewest(t_cache *c, t_entry *e) {
+    e->newer = NULL;
+    e->older = c->newest;
+    if (c->newest) c->newest->newer = e;
+    c->newest = e;
+    if (!c->oldest) c->oldest = e;
+}
+
+static void freeEntry(t_entry *e) {
+    free(e->description);
+    free(e->pixels);
+    free(e);
+}
+
+static t_entry *findEntry(t_cache *c, const uint64_t key[2], const t_view *v, const char *description) {
+    t_entry *e = c->buckets[key[0] & (c->bucketCount - 1)];
+    for (; e; e = e->nextInBucket) {
+        if (e->key[0] == key[0] && e->key[1] == key[1] && e->width == v->width && e->height == v->height &&
+            e->channels == v->channels && strcmp(e->description, description) == 0) return e;
+    }
+    return NULL;
+}
+
+static void removeEntry(t_cache *c, t_entry *e) {
+    t_entry **link = &c->buckets[e->key[0] & (c->bucketCount - 1)];
+    while (*link != e) link = &(*link)->nextInBucket;
+    *link = e->nextInBucket;
+    unlinkEntry(c, e);
+    c->bytes -= e->bytes;
+    c->entries--;
+    freeEntry(e);
+}
+
+static void growBuckets(t_cache *c) {
+    size_t count = c->bucketCount * 2;
+    t_entry **buckets = calloc(count, sizeof(t_entry *));
+    if (!buckets) return;
+    for (size_t i = 0; i < c->bucketCount; i++) {
+        t_entry *e = c->buckets[i];
+        while (e) {
+            t_entry *next = e->nextInBucket;
+            size_t b = e->key[0] & (count - 1);
+            e->nextInBucket = buckets[b];
+            buckets[b] = e;
+            e = next;
+        }
+    }
+    free(c->buckets);
+    c->buckets = buckets;
+    c->bucketCount = count;
+}
+
+// Takes ownership of e, which is dropped when it cannot fit or is already there
+static void insertEntry(t_cache *c, t_entry *e, const t_view *v) {
+    if (e->bytes > c->budget || findEntry(c, e->key, v, e->description)) {
+        freeEntry(e);
+        return;
+    }
+    while (c->oldest && c->bytes + e->bytes > c->budget) removeEntry(c, c->oldest);
+    if (c->entries >= c->bucketCount) growBuckets(c);
+    size_t b = e->key[0] & (c->bucketCount - 1);
+    e->nextInBucket = c->buckets[b];
+    c->buckets[b] = e;
+    pushNewest(c, e);
+    c->bytes += e->bytes;
+    c->entries++;
+}
+
+static t_entry *newEntry(const uint64_t key[2], const t_view *v, const char *description) {
+    size_t rowBytes = (size_t)v->width * v->channels;
+    t_entry *e = malloc(sizeof(t_entry));
+    if (!e) return NULL;
+    e->description = malloc(strlen(description) + 1);
+    e->pixels = malloc(rowBytes * v->height);
+    if (!e->description || !e->pixels) {
+        freeEntry(e);
+        return NULL;
+    }
+    strcpy(e->description, description);
+    e->key[0] = key[0];
+    e->key[1] = key[1];
+    e->width = v->width;
+    e->height = v->height;
+    e->channels = v->channels;
+    e->bytes = sizeof(t_entry) + strlen(description) + 1 + rowBytes * v->height;
+    return e;
+}
+
+static void copyToImage(const t_entry *e, const t_view *v) {
+    size_t rowBytes = (size_t)v->width * v->channels;
+    for (int y = 0; y < v->height; y++) memcpy(v->rows[y], e->pixels + y * rowBytes, rowBytes);
+}
+
+static void copyFromImage(t_entry *e, const t_view *v) {
+    size_t rowBytes = (size_t)v->width * v->channels;
+    for (int y = 0; y < v->height; y++) memcpy(e->pixels + y * rowBytes, v->rows[y], rowBytes);
+}
+
+// ---- Disk tier ----
+// One file per key: magic, width, height, channels, description length
+// (uint32 in the byte order of the machine), the description, then the rows
+
+static char *entryPath(const t_cache *c, const uint64_t key[2], const char *suffix) {
+    size_t size = strlen(c->directory) + 64;
+    char *path = malloc(size);
+    if (path) {
+        snprintf(path, size, "%s/%016llx%016llx%s", c->directory, (unsigned long long)key[0],
+                 (unsigned long long)key[1], suffix);
+    }
+    return path;
+}
+
+static t_entry *readEntry(const t_cache *c, const uint64_t key[2], const t_view *v, const char *description) {
+    char *path = entryPath(c, key, ".bmpcache");
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    free(path);
+    if (!f) return NULL;
+
+    uint32_t head[5];
+    size_t length = strlen(description);
+    t_entry *e = NULL;
+    char *stored = malloc(length + 1);
+    if (stored && fread(head, sizeof(head), 1, f) == 1 && head[0] == CACHE_FILE_MAGIC &&
+        head[1] == (uint32_t)v->width && head[2] == (uint32_t)v->height && head[3] == (uint32_t)v->channels &&
+        head[4] == length && fread(stored, 1, length, f) == length) {
+        stored[length] = 0;
+        if (strcmp(stored, description) == 0) e = newEntry(key, v, description);
+        size_t size = (size_t)v->width * v->channels * v->height;
+        if (e && fread(e->pixels, 1, size, f) != size) {
+            freeEntry(e);
+            e = NULL;
+        }
+    }
+    free(stored);
+    fclose(f);
+    return e;
+}
+
+// Written under a temporary name then renamed, readers never see half a file
+static void writeEntry(t_cache *c, const t_entry *e) {
+    CACHE_LOCK(c);
+    unsigned int counter = c->tempCounter++;
+    CACHE_UNLOCK(c);
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), ".%u.%llx.tmp", counter, (unsigned long long)(uintptr_t)&counter);
+    char *temp = entryPath(c, e->key, suffix), *path = entryPath(c, e->key, ".bmpcache");
+    FILE *f = temp && path ? fopen(temp, "wb") : NULL;
+    if (f) {
+        size_t length = strlen(e->description), size = (size_t)e->width * e->channels * e->height;
+        uint32_t head[5] = {CACHE_FILE_MAGIC, (uint32_t)e->width, (uint32_t)e->height, (uint32_t)e->channels,
+                            (uint32_t)length};
+        int written = fwrite(head, sizeof(head), 1, f) == 1 && fwrite(e->description, 1, length, f) == length &&
+                      fwrite(e->pixels, 1, size, f) == size;
+        if (fclose(f) != 0) written = 0;
+        if (!written || rename(temp, path) != 0) remove(temp);
+    }
+    free(temp);
+    free(path);
+}
+
+// ---- Cache ----
+
+t_cache *cache_create(size_t memoryBudget, const char *directory) {
+    t_cache *c = calloc(1, sizeof(t_cache));
+    if (!c) return NULL;
+    c->budget = memoryBudget;
+    c->bucketCount = 64;
+    c->buckets = calloc(c->bucketCount, sizeof(t_entry *));
+    if (directory) {
+        c->directory = malloc(strlen(directory) + 1);
+        if (c->directory) strcpy(c->directory, directory);
+    }
+    if (!c->buckets || (directory && !c->directory)) {
+        free(c->buckets);
+        free(c->directory);
+        free(c);
+        return NULL;
+    }
+#ifdef _WIN32
+    InitializeSRWLock(&c->lock);
+#else
+    pthread_mutex_init(&c->lock, NULL);
+#endif
+    return c;
+}
+
+void cache_free(t_cache *c) {
+    if (!c) return;
+    while (c->oldest) removeEntry(c, c->oldest);
+#ifndef _WIN32
+    pthread_mutex_destroy(&c->lock);
+#endif
+    free(c->buckets);
+    free(c->directory);
+    free(c);
+}
+
+// 1 when v was filled from the cache
+static int lookup(t_cache *c, const uint64_t key[2], const t_view *v, const char *description) {
+    CACHE_LOCK(c);
+    t_entry *e = findEntry(c, key, v, description);
+    if (e) {
+        unlinkEntry(c, e);
+        pushNewest(c, e);
+        copyToImage(e, v);
+        c->hits++;
+    }
+    CACHE_UNLOCK(c);
+    if (e || !c->directory) return e != NULL;
+
+    e = readEntry(c, key, v, description);
+    if (!e) return 0;
+    copyToImage(e, v);
+    CACHE_LOCK(c);
+    c->diskHits++;
+    insertEntry(c, e, v);
+    CACHE_UNLOCK(c);
+    return 1;
+}
+
+static void store(t_cache *c, const uint64_t key[2], const t_view *v, const char *description) {
+    t_entry *e = newEntry(key, v, description);
+    if (!e) return;
+    copyFromImage(e, v);
+    if (c->directory) writeEntry(c, e);
+    CACHE_LOCK(c);
+    insertEntry(c, e, v);
+    CACHE_UNLOCK(c);
+}
+
+static char *describe(const t_pipeline *p) {
+    size_t length = pipeline_describe(p, NULL, 0);
+    char *text = malloc(length + 1);
+    if (text) pipeline_describe(p, text, length + 1);
+    return text;
+}
+
+t_status cache_materialize8(t_cache *c, t_pipeline *p, t_bmp8 *img, int *hit) {
+    t_view v;
+    t_status status = STATUS_OK;
+    char *description = describe(p);
+    if (hit) *hit = 0;
+    if (!description || view8(img, &v) != 0) {
+        free(description);
+        return pipeline_materialize8(p, img);
+    }
+    uint64_t key[2];
+    computeKey(&v, description, key);
+    if (lookup(c, key, &v, description)) {
+        pipeline_clear(p);
+        if (hit) *hit = 1;
+    } else {
+        status = pipeline_materialize8(p, img);
+        if (status == STATUS_OK) store(c, key, &v, description);
+        CACHE_LOCK(c);
+        c->misses++;
+        CACHE_UNLOCK(c);
+    }
+    free(v.rows);
+    free(description);
+    return status;
+}
+
+t_status cache_materialize24(t_cache *c, t_pipeline *p, t_bmp24 *img, int *hit) {
+    t_view v;
+    t_status status = STATUS_OK;
+    char *description = describe(p);
+    if (hit) *hit = 0;
+    if (!description || view24(img, &v) != 0) {
+        free(description);
+        return pipeline_materialize24(p, img);
+    }
+    uint64_t key[2];
+    computeKey(&v, description, key);
+    if (lookup(c, key, &v, description)) {
+        pipeline_clear(p);
+        if (hit) *hit = 1;
+    } else {
+        status = pipeline_materialize24(p, img);
+        // The convolutions replace the rows of a 24-bit image
+        free(v.rows);
+        if (status == STATUS_OK && view24(img, &v) == 0) store(c, key, &v, description);
+        else v.rows = NULL;
+        CACHE_LOCK(c);
+        c->misses++;
+        CACHE_UNLOCK(c);
+    }
+    free(v.rows);
+    free(description);
+    return status;
+}
+
+void cache_stats(t_cache *c, t_cacheStats *stats) {
+    CACHE_LOCK(c);
+    stats->hits = c->hits;
+    stats->diskHits = c->diskHits;
+    stats->misses = c->misses;
+    stats->bytes = c->bytes;
+    stats->entries = c->entries;
+    CACHE_UNLOCK(c);
+}
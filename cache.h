@@ -0,0 +1,42 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "pipeline.h"
+
+// === Result cache for filter pipelines ===
+// The key is a 128-bit hash of the pixels (padding excluded, rows top first)
+// together with the canonical text of the pipeline (pipeline_describe), so the
+// same preset on the same image is only computed once. Results are kept in memory up to
+// a byte budget, least recently used first out. With a directory, every
+// result is also written there, one file per key, and read back when it has
+// left the memory (or in another process). Files are never removed by the
+// cache, the directory can be emptied at any time.
+// The hash is fast but not cryptographic: do not share a cache between
+// users who could forge collisions. One cache may be used by several threads.
+
+typedef struct t_cache t_cache;
+
+typedef struct {
+    uint64_t hits;          // served from memory
+    uint64_t diskHits;      // read back from the directory
+    uint64_t misses;        // computed
+    size_t bytes;           // held in memory
+    size_t entries;
+} t_cacheStats;
+
+// directory may be NULL (memory only), it must exist. NULL on allocation failure
+t_cache *cache_create(size_t memoryBudget, const char *directory);
+void cache_free(t_cache *cache);
+
+// Same as pipeline_materialize8 / 24 (the pipeline is cleared), except that a
+// cached result is copied into img instead of being computed. Only successful
+// runs are stored. *hit (may be NULL) is 1 when the result came from the cache
+t_status cache_materialize8(t_cache *cache, t_pipeline *p, t_bmp8 *img, int *hit);
+t_status cache_materialize24(t_cache *cache, t_pipeline *p, t_bmp24 *img, int *hit);
+
+void cache_stats(t_cache *cache, t_cacheStats *stats);
+
+#endif // CACHE_H
@@ -0,0 +1,680 @@
+#include "convolution.h"
+#include "fft.h"
+#include "parallel.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The tasks are also compiled for AVX-512, which brings FMA: a fused
+// multiply-add would round the sums differently from the generic loops.
+// They are written for the vectorizer, which GCC only tries at -O2 on loops
+// it finds trivially profitable
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off", "vect-cost-model=dynamic")
+#endif
+
+// The loops below are written once and instantiated for each size and pixel
+// layout: forced inlining with constant arguments lets the compiler unroll them
+#if defined(__GNUC__)
+#define FORCE_INLINE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define FORCE_INLINE static __forceinline
+#else
+#define FORCE_INLINE static inline
+#endif
+
+#if defined(__clang__)
+#define UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define UNROLL _Pragma("GCC unroll 8")
+#else
+#define UNROLL
+#endif
+
+// 24-bit rows are read as bytes, 3 per pixel
+_Static_assert(sizeof(t_pixel) == 3, "t_pixel must be 3 bytes");
+
+// Cost of a tap on each path, in the unit of fft_isFasterThan (the generic
+// loop of bmp8.c / bmp24.c costs 4 per tap)
+#define DIRECT_TAP_COST 1.0
+#define SPARSE_TAP_COST 1.5
+#define SEPARABLE_TAP_COST 2.0
+#define GENERIC_TAP_COST 4.0
+
+static const float presets[][9] = {
+    [PRESET_BOX]      = {1/9.f, 1/9.f, 1/9.f, 1/9.f, 1/9.f, 1/9.f, 1/9.f, 1/9.f, 1/9.f},
+    [PRESET_GAUSSIAN] = {1/16.f, 2/16.f, 1/16.f, 2/16.f, 4/16.f, 2/16.f, 1/16.f, 2/16.f, 1/16.f},
+    [PRESET_OUTLINE]  = {-1, -1, -1, -1, 8, -1, -1, -1, -1},
+    [PRESET_EMBOSS]   = {-2, -1, 0, -1, 1, 1, 0, 1, 2},
+    [PRESET_SHARPEN]  = {0, -1, 0, -1, 5, -1, 0, -1, 0}
+};
+
+const float *convolution_preset(t_kernelPreset preset) {
+    return presets[preset];
+}
+
+// Same clamping as the generic loops: rounded in bmp8.c, truncated in bmp24.c.
+// Written with comparisons instead of roundf / fminf / fmaxf (library calls
+// that stop vectorization), with the same result for every float
+FORCE_INLINE uint8_t toByte(float v, const int channels) {
+    if (channels == 1) {
+        if (v < 0) v = 0;
+        if (v > 255) v = 255;
+        // Half away from zero like roundf, v - i is exact
+        int i = (int)v;
+        return (uint8_t)(i + (v - i >= 0.5f));
+    }
+    return (uint8_t)(v > 0 ? (v < 255 ? v : 255) : 0);
+}
+
+// ---- Direct loops ----
+
+typedef struct {
+    uint8_t **src;          // rows of the input, channels bytes per pixel
+    uint8_t **dst;
+    int width;
+    int height;
+    const float *kernel;    // size * size weights, row by row
+} t_directJob;
+
+// Border pixel: taps outside of the image are skipped, in the generic order
+FORCE_INLINE void directChecked(const t_directJob *job, int x, int y, const float *k, const int n,
+                                const int channels, const int constantTaps) {
+    int r = n / 2;
+    float sum[3] = {0, 0, 0};
+    for (int ky = 0; ky < n; ky++) {
+        int iy = y + ky - r;
+        if (iy < 0 || iy >= job->height) continue;
+        for (int kx = 0; kx < n; kx++) {
+            int ix = x + kx - r;
+            if (ix < 0 || ix >= job->width || (constantTaps && k[ky * n + kx] == 0)) continue;
+            const uint8_t *p = job->src[iy] + ix * channels;
+            for (int c = 0; c < channels; c++) sum[c] += p[c] * k[ky * n + kx];
+        }
+    }
+    for (int c = 0; c < channels; c++) job->dst[y][x * channels + c] = toByte(sum[c], channels);
+}
+
+// Adding p * 0 leaves a sum unchanged, so skipping the zero taps of a
+// constant kernel gives the same pixels
+FORCE_INLINE void directRow(const t_directJob *job, int y, const float *k, const int n, const int channels,
+                            const int constantTaps) {
+    int r = n / 2;
+    int x0 = r, x1 = job->width - r;
+    if (y < r || y >= job->height - r || x1 <= x0) {
+        for (int x = 0; x < job->width; x++) directChecked(job, x, y, k, n, channels, constantTaps);
+        return;
+    }
+    for (int x = 0; x < x0; x++) directChecked(job, x, y, k, n, channels, constantTaps);
+    for (int x = x1; x < job->width; x++) directChecked(job, x, y, k, n, channels, constantTaps);
+
+    const uint8_t *rows[7];
+    for (int ky = 0; ky < n; ky++) rows[ky] = job->src[y + ky - r];
+    // Channels are interleaved, each byte of the row is one output
+    uint8_t *out = job->dst[y];
+    for (int i = x0 * channels; i < x1 * channels; i++) {
+        float sum = 0;
+        UNROLL
+        for (int ky = 0; ky < n; ky++) {
+            const uint8_t *p = rows[ky] + i - r * channels;
+            UNROLL
+            for (int kx = 0; kx < n; kx++) {
+                if (constantTaps && k[ky * n + kx] == 0) continue;
+                sum += p[kx * channels] * k[ky * n + kx];
+            }
+        }
+        out[i] = toByte(sum, channels);
+    }
+}
+
+// Every pixel through the checked path: the arithmetic of the generic loops,
+// what dispatch_check compares the other loops with
+FORCE_INLINE void referenceRows(const t_directJob *job, int n, int channels) {
+    for (int y = 0; y < job->height; y++) {
+        for (int x = 0; x < job->width; x++) directChecked(job, x, y, job->kernel, n, channels, 0);
+    }
+}
+
+// ---- Separable kernels ----
+
+typedef struct {
+    uint8_t **src;
+    uint8_t **dst;
+    int width;
+    int height;
+    int size;
+    const float *column;    // kernel = column x row
+    const float *row;
+    int symmetricRow;       // row[i] == row[size - 1 - i]
+    int symmetricColumn;
+    float *tmp;             // horizontal pass, width * channels floats per row
+} t_separableJob;
+
+// Kernel as column x row, 0 when it is not a product (within float rounding)
+static int factorize(const float *k, int n, float *column, float *row) {
+    int pivot = 0;
+    for (int i = 1; i < n * n; i++) {
+        if (fabsf(k[i]) > fabsf(k[pivot])) pivot = i;
+    }
+    float max = fabsf(k[pivot]);
+    if (max == 0) return 0;
+    int py = pivot / n, px = pivot % n;
+    for (int i = 0; i < n; i++) {
+        column[i] = k[i * n + px];
+        row[i] = k[py * n + i] / k[pivot];
+    }
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            if (fabsf(k[y * n + x] - column[y] * row[x]) > max * 1e-5f) return 0;
+        }
+    }
+    return 1;
+}
+
+static int isSymmetric(const float *v, int n) {
+    for (int i = 0; i < n / 2; i++) {
+        if (v[i] != v[n - 1 - i]) return 0;
+    }
+    return 1;
+}
+
+FORCE_INLINE void horizontalRows(const t_separableJob *job, int begin, int end, const int channels) {
+    int n = job->size, r = n / 2, w = job->width;
+    const float *k = job->row;
+    for (int y = begin; y < end; y++) {
+        const uint8_t *in = job->src[y];
+        float *out = job->tmp + (size_t)y * w * channels;
+        for (int x = 0; x < w; x++) {
+            int interior = x >= r && x < w - r;
+            for (int c = 0; c < channels; c++) {
+                float sum = 0;
+                if (!interior) {
+                    for (int kx = 0; kx < n; kx++) {
+                        int ix = x + kx - r;
+                        if (ix >= 0 && ix < w) sum += in[ix * channels + c] * k[kx];
+                    }
+                } else if (job->symmetricRow) {
+                    // Pixels are integers, their sum is exact
+                    const uint8_t *p = in + x * channels + c;
+                    for (int kx = 0; kx < r; kx++) sum += (p[(kx - r) * channels] + p[(r - kx) * channels]) * k[kx];
+                    sum += p[0] * k[r];
+                } else {
+                    const uint8_t *p = in + (x - r) * channels + c;
+                    for (int kx = 0; kx < n; kx++) sum += p[kx * channels] * k[kx];
+                }
+                out[x * channels + c] = sum;
+            }
+        }
+    }
+}
+
+FORCE_INLINE void verticalRows(const t_separableJob *job, int begin, int end, const int channels) {
+    int n = job->size, r = n / 2;
+    size_t rowLength = (size_t)job->width * channels;
+    const float *k = job->column;
+    for (int y = begin; y < end; y++) {
+        int interior = y >= r && y < job->height - r;
+        const float *center = job->tmp + (size_t)y * rowLength;
+        for (size_t i = 0; i < rowLength; i++) {
+            float sum = 0;
+            if (!interior) {
+                for (int ky = 0; ky < n; ky++) {
+                    int iy = y + ky - r;
+                    if (iy >= 0 && iy < job->height) sum += job->tmp[(size_t)iy * rowLength + i] * k[ky];
+                }
+            } else if (job->symmetricColumn) {
+                for (int ky = 0; ky < r; ky++) {
+                    ptrdiff_t d = (ptrdiff_t)(r - ky) * rowLength;
+                    sum += (center[i - d] + center[i + d]) * k[ky];
+                }
+                sum += center[i] * k[r];
+            } else {
+                for (int ky = 0; ky < n; ky++) sum += center[i + (ptrdiff_t)(ky - r) * rowLength] * k[ky];
+            }
+            job->dst[y][i] = toByte(sum, channels);
+        }
+    }
+}
+
+// ---- Sparse kernels ----
+// The non-zero taps are listed in the order of the generic loop with their
+// position relative to the output pixel, weights of 1 and -1 become an add
+// or a subtraction (p * 1 and p * -1 are exact, so the sums are the same).
+
+typedef enum {
+    TAP_ADD,
+    TAP_SUBTRACT,
+    TAP_MULTIPLY
+} t_tapKind;
+
+typedef struct {
+    int dy;
+    int dx;
+    t_tapKind kind;
+    float weight;
+} t_tap;
+
+typedef struct {
+    uint8_t **src;
+    uint8_t **dst;
+    int width;
+    int height;
+    const t_tap *taps;
+    int count;
+    int radius;
+} t_sparseJob;
+
+// Number of taps written to taps (room for n * n)
+static int compileTaps(const float *k, int n, t_tap *taps) {
+    int count = 0;
+    for (int ky = 0; ky < n; ky++) {
+        for (int kx = 0; kx < n; kx++) {
+            float w = k[ky * n + kx];
+            if (w == 0) continue;
+            t_tap *t = &taps[count++];
+            t->dy = ky - n / 2;
+            t->dx = kx - n / 2;
+            t->kind = w == 1 ? TAP_ADD : w == -1 ? TAP_SUBTRACT : TAP_MULTIPLY;
+            t->weight = w;
+        }
+    }
+    return count;
+}
+
+FORCE_INLINE void sparseChecked(const t_sparseJob *job, int x, int y, const int channels) {
+    for (int c = 0; c < channels; c++) {
+        float sum = 0;
+        for (int i = 0; i < job->count; i++) {
+            const t_tap *t = &job->taps[i];
+            int ix = x + t->dx, iy = y + t->dy;
+            if (ix < 0 || ix >= job->width || iy < 0 || iy >= job->height) continue;
+            uint8_t p = job->src[iy][ix * channels + c];
+            if (t->kind == TAP_ADD) sum += p;
+            else if (t->kind == TAP_SUBTRACT) sum -= p;
+            else sum += p * t->weight;
+        }
+        job->dst[y][x * channels + c] = toByte(sum, channels);
+    }
+}
+
+// Tap by tap over the whole row: every output byte still gets its taps in
+// order, and each inner loop is a plain add, subtract or multiply-add
+FORCE_INLINE void sparseRow(const t_sparseJob *job, int y, float *acc, const int channels) {
+    int r = job->radius;
+    int x0 = r, x1 = job->width - r;
+    if (!acc || y < r || y >= job->height - r || x1 <= x0) {
+        for (int x = 0; x < job->width; x++) sparseChecked(job, x, y, channels);
+        return;
+    }
+    for (int x = 0; x < x0; x++) sparseChecked(job, x, y, channels);
+    for (int x = x1; x < job->width; x++) sparseChecked(job, x, y, channels);
+
+    int length = (x1 - x0) * channels;
+    memset(acc, 0, length * sizeof(float));
+    for (int i = 0; i < job->count; i++) {
+        const t_tap *t = &job->taps[i];
+        const uint8_t *p = job->src[y + t->dy] + (x0 + t->dx) * channels;
+        if (t->kind == TAP_ADD) {
+            for (int k = 0; k < length; k++) acc[k] += p[k];
+        } else if (t->kind == TAP_SUBTRACT) {
+            for (int k = 0; k < length; k++) acc[k] -= p[k];
+        } else {
+            float w = t->weight;
+            for (int k = 0; k < length; k++) acc[k] += p[k] * w;
+        }
+    }
+    uint8_t *out = job->dst[y] + x0 * channels;
+    for (int k = 0; k < length; k++) out[k] = toByte(acc[k], channels);
+}
+
+FORCE_INLINE void sparseRows(const t_sparseJob *job, int begin, int end, const int channels) {
+    // Without the accumulator every pixel takes the checked path
+    float *acc = malloc((size_t)job->width * channels * sizeof(float));
+    for (int y = begin; y < end; y++) sparseRow(job, y, acc, channels);
+    free(acc);
+}
+
+// ---- Tasks of each instruction set ----
+// The loops above are compiled once per level of dispatch.h, the bytes they
+// write are the same on every level
+
+typedef struct {
+    t_parallelTask direct[3][2];    // [size / 2 - 1][channels == 3]
+    t_parallelTask preset[5][2];
+    t_parallelTask sparse[2];
+    t_parallelTask horizontal[2];
+    t_parallelTask vertical[2];
+} t_tasks;
+
+// Runtime kernels: the taps go to a local array the stores cannot alias
+#define DIRECT_TASK(name, target, n, channels)                                      \
+    target static void name(int begin, int end, void *arg) {                        \
+        const t_directJob *job = arg;                                               \
+        float taps[n * n];                                                          \
+        memcpy(taps, job->kernel, sizeof(taps));                                    \
+        for (int y = begin; y < end; y++) directRow(job, y, taps, n, channels, 0);  \
+    }
+
+// Presets: the taps are compile-time constants
+#define PRESET_TASK(name, target, preset, channels)                                           \
+    target static void name(int begin, int end, void *arg) {                                  \
+        for (int y = begin; y < end; y++) directRow(arg, y, presets[preset], 3, channels, 1); \
+    }
+
+#define ROWS_TASK(name, target, rows, channels)               \
+    target static void name(int begin, int end, void *arg) {  \
+        rows(arg, begin, end, channels);                      \
+    }
+
+#define LEVEL_TASKS(level, target)                                                   \
+    DIRECT_TASK(level##Direct3Gray, target, 3, 1)                                    \
+    DIRECT_TASK(level##Direct3Color, target, 3, 3)                                   \
+    DIRECT_TASK(level##Direct5Gray, target, 5, 1)                                    \
+    DIRECT_TASK(level##Direct5Color, target, 5, 3)                                   \
+    DIRECT_TASK(level##Direct7Gray, target, 7, 1)                                    \
+    DIRECT_TASK(level##Direct7Color, target, 7, 3)                                   \
+    PRESET_TASK(level##BoxGray, target, PRESET_BOX, 1)                               \
+    PRESET_TASK(level##BoxColor, target, PRESET_BOX, 3)                              \
+    PRESET_TASK(level##GaussianGray, target, PRESET_GAUSSIAN, 1)                     \
+    PRESET_TASK(level##GaussianColor, target, PRESET_GAUSSIAN, 3)                    \
+    PRESET_TASK(level##OutlineGray, target, PRESET_OUTLINE, 1)                       \
+    PRESET_TASK(level##OutlineColor, target, PRESET_OUTLINE, 3)                      \
+    PRESET_TASK(level##EmbossGray, target, PRESET_EMBOSS, 1)                         \
+    PRESET_TASK(level##EmbossColor, target, PRESET_EMBOSS, 3)                        \
+    PRESET_TASK(level##SharpenGray, target, PRESET_SHARPEN, 1)                       \
+    PRESET_TASK(level##SharpenColor, target, PRESET_SHARPEN, 3)                      \
+    ROWS_TASK(level##SparseGray, target, sparseRows, 1)                              \
+    ROWS_TASK(level##SparseColor, target, sparseRows, 3)                             \
+    ROWS_TASK(level##HorizontalGray, target, horizontalRows, 1)                      \
+    ROWS_TASK(level##HorizontalColor, target, horizontalRows, 3)                     \
+    ROWS_TASK(level##VerticalGray, target, verticalRows, 1)                          \
+    ROWS_TASK(level##VerticalColor, target, verticalRows, 3)                         \
+    static const t_tasks level##Tasks = {                                            \
+        {{level##Direct3Gray, level##Direct3Color},                                  \
+         {level##Direct5Gray, level##Direct5Color},                                  \
+         {level##Direct7Gray, level##Direct7Color}},                                 \
+        {[PRESET_BOX]      = {level##BoxGray, level##BoxColor},                      \
+         [PRESET_GAUSSIAN] = {level##GaussianGray, level##GaussianColor},            \
+         [PRESET_OUTLINE]  = {level##OutlineGray, level##OutlineColor},              \
+         [PRESET_EMBOSS]   = {level##EmbossGray, level##EmbossColor},                \
+         [PRESET_SHARPEN]  = {level##SharpenGray, level##SharpenColor}},             \
+        {level##SparseGray, level##SparseColor},                                     \
+        {level##HorizontalGray, level##HorizontalColor},                             \
+        {level##VerticalGray, level##VerticalColor}                                  \
+    };
+
+LEVEL_TASKS(baseline, )
+#ifdef DISPATCH_X86
+LEVEL_TASKS(avx2, DISPATCH_AVX2)
+LEVEL_TASKS(avx512, DISPATCH_AVX512)
+#endif
+
+// NULL for the scalar level: the generic loops of bmp8.c / bmp24.c and the FFT
+static const t_tasks *levelTasks(t_isa isa) {
+    switch (isa) {
+#ifdef DISPATCH_X86
+    case ISA_AVX512:
+        return &avx512Tasks;
+    case ISA_AVX2:
+        return &avx2Tasks;
+#endif
+    case ISA_BASELINE:
+        return &baselineTasks;
+    default:
+        return NULL;
+    }
+}
+
+// ---- Routing ----
+
+// The cheapest path for k (row by row), -1 when it is the FFT or the generic
+// loop. scratch has room for n * n taps
+static int convolveKernel(const t_tasks *tasks, uint8_t **src, uint8_t **dst, int width, int height, int channels,
+                          const float *k, int n, t_tap *scratch) {
+    double cost = (n <= 7 ? DIRECT_TAP_COST : GENERIC_TAP_COST) * n * n;
+    int taps = compileTaps(k, n, scratch);
+    int sparse = taps < n * n && taps * SPARSE_TAP_COST < cost;
+    if (sparse) cost = taps * SPARSE_TAP_COST;
+
+    // Two 1-D passes
+    float factors[2 * 255];
+    if (n >= 5 && n <= 255 && 2 * n * SEPARABLE_TAP_COST < cost && !fft_isFasterThan(n, 2 * n * SEPARABLE_TAP_COST) &&
+        factorize(k, n, factors, factors + n)) {
+        float *tmp = malloc((size_t)width * height * channels * sizeof(float));
+        if (tmp) {
+            t_separableJob job = {src, dst, width, height, n, factors, factors + n,
+                                  isSymmetric(factors + n, n), isSymmetric(factors, n), tmp};
+            parallel_for(height, tasks->horizontal[channels == 3], &job);
+            parallel_for(height, tasks->vertical[channels == 3], &job);
+            free(tmp);
+            return 0;
+        }
+    }
+    if (fft_isFasterThan(n, cost)) return -1;
+
+    if (sparse) {
+        t_sparseJob job = {src, dst, width, height, scratch, taps, n / 2};
+        parallel_for(height, tasks->sparse[channels == 3], &job);
+        return 0;
+    }
+    if (n > 7) return -1;
+    t_directJob job = {src, dst, width, height, k};
+    parallel_for(height, tasks->direct[n / 2 - 1][channels == 3], &job);
+    return 0;
+}
+
+// src and dst rows of width * channels bytes, 0 when a specialized path ran
+static int convolveRows(const t_tasks *tasks, uint8_t **src, uint8_t **dst, int width, int height, int channels,
+                        float **kernel, int n) {
+    if (!tasks || n < 3 || n % 2 == 0) return -1;
+    float *k = malloc((size_t)n * n * sizeof(float));
+    t_tap *taps = malloc((size_t)n * n * sizeof(t_tap));
+    int done = -1;
+    if (k && taps) {
+        for (int y = 0; y < n; y++) memcpy(k + y * n, kernel[y], n * sizeof(float));
+        done = convolveKernel(tasks, src, dst, width, height, channels, k, n, taps);
+    }
+    free(k);
+    free(taps);
+    return done;
+}
+
+// Rows of data laid out like img, from the top whatever the order in memory
+static uint8_t **rows8(unsigned char *data, const t_bmp8 *img) {
+    int stride = ((img->width + 3) / 4) * 4;
+    uint8_t **rows = malloc(img->height * sizeof(uint8_t *));
+    if (rows) {
+        for (unsigned int y = 0; y < img->height; y++) {
+            rows[y] = data + (size_t)(img->topDown ? y : img->height - 1 - y) * stride;
+        }
+    }
+    return rows;
+}
+
+// task == NULL: general kernel
+static int run8(t_bmp8 *img, float **kernel, int kernelSize, t_parallelTask task) {
+    unsigned char *newData = calloc(img->dataSize, 1);
+    uint8_t **src = rows8(img->data, img);
+    uint8_t **dst = rows8(newData, img);
+    int done = -1;
+    if (newData && src && dst) {
+        if (task) {
+            t_directJob job = {src, dst, img->width, img->height, NULL};
+            parallel_for(img->height, task, &job);
+            done = 0;
+        } else {
+            done = convolveRows(levelTasks(dispatch_isa()), src, dst, img->width, img->height, 1, kernel, kernelSize);
+        }
+    }
+    // Written back like the generic loop: callers keep pointers into img->data
+    for (unsigned int y = 0; done == 0 && y < img->height; y++) memcpy(src[y], dst[y], img->width);
+    free(newData);
+    free(src);
+    free(dst);
+    return done;
+}
+
+static int run24(t_bmp24 *img, float **kernel, int kernelSize, t_parallelTask task) {
+    t_pixel **newData = bmp24_allocateDataPixels(img->width, img->height);
+    if (!newData) return -1;
+    int done;
+    if (task) {
+        t_directJob job = {(uint8_t **)img->data, (uint8_t **)newData, img->width, img->height, NULL};
+        parallel_for(img->height, task, &job);
+        done = 0;
+    } else {
+        done = convolveRows(levelTasks(dispatch_isa()), (uint8_t **)img->data, (uint8_t **)newData, img->width,
+                            img->height, 3, kernel, kernelSize);
+    }
+    if (done == 0) {
+        bmp24_freeDataPixels(img->data, img->height);
+        img->data = newData;
+    } else {
+        bmp24_freeDataPixels(newData, img->height);
+    }
+    return done;
+}
+
+int convolution_apply8(t_bmp8 *img, float **kernel, int kernelSize) {
+    if (!levelTasks(dispatch_isa())) return -1;
+    return run8(img, kernel, kernelSize, NULL);
+}
+
+int convolution_apply24(t_bmp24 *img, float **kernel, int kernelSize) {
+    if (!levelTasks(dispatch_isa())) return -1;
+    return run24(img, kernel, kernelSize, NULL);
+}
+
+// On the scalar level the presets are runtime kernels of the generic loop
+t_status bmp8_applyPreset(t_bmp8 *img, t_kernelPreset preset) {
+    const t_tasks *tasks = levelTasks(dispatch_isa());
+    if (!tasks) {
+        float k[9];
+        memcpy(k, presets[preset], sizeof(k));
+        float *rows[3] = {k, k + 3, k + 6};
+        return bmp8_applyFilter(img, rows, 3);
+    }
+    return run8(img, NULL, 3, tasks->preset[preset][0]) == 0 ? STATUS_OK : STATUS_NO_MEMORY;
+}
+
+t_status bmp24_applyPreset(t_bmp24 *img, t_kernelPreset preset) {
+    const t_tasks *tasks = levelTasks(dispatch_isa());
+    if (!tasks) {
+        float k[9];
+        memcpy(k, presets[preset], sizeof(k));
+        float *rows[3] = {k, k + 3, k + 6};
+        return bmp24_applyFilter(img, rows, 3);
+    }
+    return run24(img, NULL, 3, tasks->preset[preset][1]) == 0 ? STATUS_OK : STATUS_NO_MEMORY;
+}
+
+// ---- Check ----
+
+// Images of each size with 1 and 3 channels: rows shorter than the kernels,
+// rows with both borders and an interior
+#define CHECK_WIDTH 70
+#define CHECK_HEIGHT 23
+static const int checkSizes[][2] = {{1, 1}, {2, 3}, {9, 4}, {37, CHECK_HEIGHT}, {CHECK_WIDTH, 9}};
+
+// xorshift32, the same images on every run
+static uint8_t checkByte(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return (uint8_t)(*state >> 24);
+}
+
+static int sameRows(uint8_t **a, uint8_t **b, int length, int height, int tolerance) {
+    for (int y = 0; y < height; y++) {
+        for (int i = 0; i < length; i++) {
+            if (abs(a[y][i] - b[y][i]) > tolerance) return 0;
+        }
+    }
+    return 1;
+}
+
+// Every task of one level against referenceRows, on one image
+static int checkImage(const t_tasks *tasks, uint8_t **src, uint8_t **expected, uint8_t **got, int width,
+                      int height, int channels, float *tmp, uint32_t *state) {
+    float k[81];
+    t_tap taps[81];
+    t_directJob reference = {src, expected, width, height, k};
+    t_directJob job = {src, got, width, height, k};
+    int length = width * channels, color = channels == 3, same = 1;
+
+    // Dense kernels of the unrolled sizes, then the presets
+    for (int n = 3; n <= 7; n += 2) {
+        for (int i = 0; i < n * n; i++) k[i] = (checkByte(state) - 128) / 64.0f;
+        referenceRows(&reference, n, channels);
+        parallel_for(height, tasks->direct[n / 2 - 1][color], &job);
+        same &= sameRows(expected, got, length, height, 0);
+    }
+    for (int p = PRESET_BOX; p <= PRESET_SHARPEN; p++) {
+        memcpy(k, presets[p], 9 * sizeof(float));
+        referenceRows(&reference, 3, channels);
+        parallel_for(height, tasks->preset[p][color], &job);
+        same &= sameRows(expected, got, length, height, 0);
+    }
+
+    // 9 x 9 with a few taps, some of them 1 or -1
+    memset(k, 0, sizeof(k));
+    for (int i = 0; i < 12; i++) {
+        uint8_t v = checkByte(state);
+        k[checkByte(state) % 81] = v % 3 == 0 ? 1 : v % 3 == 1 ? -1 : (v - 128) / 32.0f;
+    }
+    referenceRows(&reference, 9, channels);
+    t_sparseJob sparse = {src, got, width, height, taps, compileTaps(k, 9, taps), 4};
+    parallel_for(height, tasks->sparse[color], &sparse);
+    same &= sameRows(expected, got, length, height, 0);
+
+    // 7 x 7 products, symmetric or not: the two passes round differently
+    for (int symmetric = 0; symmetric <= 1; symmetric++) {
+        float factors[14];
+        for (int i = 0; i < 14; i++) factors[i] = checkByte(state) / 255.0f;
+        for (int i = 0; symmetric && i < 3; i++) {
+            factors[6 - i] = factors[i];
+            factors[13 - i] = factors[7 + i];
+        }
+        for (int i = 0; i < 49; i++) k[i] = factors[i / 7] * factors[7 + i % 7];
+        if (!factorize(k, 7, factors, factors + 7)) continue;
+        referenceRows(&reference, 7, channels);
+        t_separableJob separable = {src, got, width, height, 7, factors, factors + 7,
+                                    isSymmetric(factors + 7, 7), isSymmetric(factors, 7), tmp};
+        parallel_for(height, tasks->horizontal[color], &separable);
+        parallel_for(height, tasks->vertical[color], &separable);
+        same &= sameRows(expected, got, length, height, 1);
+    }
+    return same;
+}
+
+int convolution_check(t_isa isa) {
+    if (!dispatch_supported(isa)) return -1;
+    const t_tasks *tasks = levelTasks(isa);
+    if (!tasks) return 0;
+
+    size_t bytes = (size_t)CHECK_WIDTH * CHECK_HEIGHT * 3;
+    uint8_t *block = malloc(3 * bytes);
+    float *tmp = malloc(bytes * sizeof(float));
+    int same = block && tmp;
+    uint32_t state = 0x9E3779B9;
+    for (size_t i = 0; same && i < bytes; i++) block[i] = checkByte(&state);
+
+    uint8_t *src[CHECK_HEIGHT], *expected[CHECK_HEIGHT], *got[CHECK_HEIGHT];
+    for (size_t s = 0; same && s < sizeof(checkSizes) / sizeof(checkSizes[0]); s++) {
+        for (int channels = 1; same && channels <= 3; channels += 2) {
+            int width = checkSizes[s][0], height = checkSizes[s][1];
+            for (int y = 0; y < height; y++) {
+                size_t offset = (size_t)y * width * channels;
+                src[y] = block + offset;
+                expected[y] = block + bytes + offset;
+                got[y] = block + 2 * bytes + offset;
+            }
+            same = checkImage(tasks, src, expected, got, width, height, channels, tmp, &state);
+        }
+    }
+    free(block);
+    free(tmp);
+    return same ? 0 : -1;
+}
@@ -0,0 +1,50 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+#include "bmp8.h"
+#include "bmp24.h"
+#include "status.h"
+#include "dispatch.h"
+
+// === Convolution loops specialized by kernel size and shape ===
+// bmp8_applyFilter / bmp24_applyFilter try these before the FFT and the
+// generic loop:
+//  - 3x3, 5x5 and 7x7: the size is a compile-time constant so the tap loops
+//    are unrolled, the taps are copied to a local array (no reload after each
+//    store) and the bounds are only checked in the border band,
+//  - kernels with zero taps, of any size: a list of the non-zero taps and
+//    their offsets, weights of 1 and -1 added or subtracted,
+//  - separable kernels of size 5 and more: one horizontal and one vertical
+//    pass (2 * size taps per pixel instead of size * size), symmetric taps
+//    folded,
+// whichever is expected to be the cheapest, the FFT included.
+// The presets of the menu run a 3x3 loop compiled with their taps as
+// constants, the zero taps of sharpen and emboss are not computed.
+// The unrolled and sparse loops give the same pixels as the generic loop,
+// the separable passes round differently and may move a pixel by one level.
+// The loops are compiled for every level of dispatch.h and run with the one
+// selected, on the scalar level only the generic loop and the FFT are used.
+
+typedef enum {
+    PRESET_BOX,
+    PRESET_GAUSSIAN,
+    PRESET_OUTLINE,
+    PRESET_EMBOSS,
+    PRESET_SHARPEN
+} t_kernelPreset;
+
+// 3 x 3 weights, row by row
+const float *convolution_preset(t_kernelPreset preset);
+t_status bmp8_applyPreset(t_bmp8 *img, t_kernelPreset preset);
+t_status bmp24_applyPreset(t_bmp24 *img, t_kernelPreset preset);
+
+// Specialized path for this kernel: 0 when img was filtered, -1 when the
+// kernel has none (or memory ran out) and the caller must use another one
+int convolution_apply8(t_bmp8 *img, float **kernel, int kernelSize);
+int convolution_apply24(t_bmp24 *img, float **kernel, int kernelSize);
+
+// Part of dispatch_check: 0 when the loops compiled for isa give the pixels
+// of the generic loop on small pseudo-random images (separable kernels within
+// one level), -1 otherwise
+int convolution_check(t_isa isa);
+
+#endif // CONVOLUTION_H
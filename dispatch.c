@@ -0,0 +1,468 @@
+#include "dispatch.h"
+#include "convolution.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#ifdef DISPATCH_X86
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BASELINE_NAME "sse2"
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BASELINE_NAME "neon"
+#else
+#define BASELINE_NAME "baseline"
+#endif
+
+static const char *const names[ISA_COUNT] = {"scalar", BASELINE_NAME, "avx2", "avx512"};
+
+// ---- Scalar ----
+// The loops of bmp8.c, bmp24.c and lut.c as they were written, every other
+// level is compared with them
+
+static void lutScalar(uint8_t *p, size_t n, const uint8_t *map) {
+    for (size_t i = 0; i < n; i++) p[i] = map[p[i]];
+}
+
+static void histogramScalar(const uint8_t *p, size_t width, size_t height, size_t stride, unsigned int *hist) {
+    for (size_t y = 0; y < height; y++) {
+        const uint8_t *row = p + y * stride;
+        for (size_t x = 0; x < width; x++) hist[row[x]]++;
+    }
+}
+
+static void grayscaleScalar(uint8_t *p, size_t pixels) {
+    for (size_t x = 0; x < pixels; x++, p += 3) {
+        uint8_t g = (p[0] + p[1] + p[2]) / 3;
+        p[0] = p[1] = p[2] = g;
+    }
+}
+
+static void swapScalar(uint8_t *dst, const uint8_t *src, size_t pixels) {
+    for (size_t x = 0; x < pixels; x++) {
+        uint8_t first = src[3 * x], second = src[3 * x + 1], third = src[3 * x + 2];
+        dst[3 * x] = third;
+        dst[3 * x + 1] = second;
+        dst[3 * x + 2] = first;
+    }
+}
+
+// ---- Baseline ----
+
+// Table lookups, 4 values per iteration
+static void lutBaseline(uint8_t *p, size_t n, const uint8_t *map) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint8_t a = map[p[i]], b = map[p[i + 1]], c = map[p[i + 2]], d = map[p[i + 3]];
+        p[i] = a;
+        p[i + 1] = b;
+        p[i + 2] = c;
+        p[i + 3] = d;
+    }
+    for (; i < n; i++) p[i] = map[p[i]];
+}
+
+// Four tables: a run of equal values does not wait for the previous increment
+static void histogramBaseline(const uint8_t *p, size_t width, size_t height, size_t stride, unsigned int *hist) {
+    unsigned int part[4][256];
+    memset(part, 0, sizeof(part));
+    for (size_t y = 0; y < height; y++) {
+        const uint8_t *row = p + y * stride;
+        size_t x = 0;
+        for (; x + 4 <= width; x += 4) {
+            part[0][row[x]]++;
+            part[1][row[x + 1]]++;
+            part[2][row[x + 2]]++;
+            part[3][row[x + 3]]++;
+        }
+        for (; x < width; x++) part[0][row[x]]++;
+    }
+    for (int v = 0; v < 256; v++) hist[v] += part[0][v] + part[1][v] + part[2][v] + part[3][v];
+}
+
+#if defined(__aarch64__)
+// Four 64-byte tables: indices out of a table leave the byte unchanged
+static void lutNeon(uint8_t *p, size_t n, const uint8_t *map) {
+    uint8x16x4_t table[4];
+    for (int t = 0; t < 4; t++) {
+        for (int k = 0; k < 4; k++) table[t].val[k] = vld1q_u8(map + 64 * t + 16 * k);
+    }
+    const uint8x16_t step = vdupq_n_u8(64);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16_t r = vqtbl4q_u8(table[0], v);
+        v = vsubq_u8(v, step);
+        r = vqtbx4q_u8(r, table[1], v);
+        v = vsubq_u8(v, step);
+        r = vqtbx4q_u8(r, table[2], v);
+        v = vsubq_u8(v, step);
+        r = vqtbx4q_u8(r, table[3], v);
+        vst1q_u8(p + i, r);
+    }
+    for (; i < n; i++) p[i] = map[p[i]];
+}
+
+// s / 3 == (s * 0xAAAB) >> 17 for every sum of three bytes
+static uint8x8_t divideBy3(uint16x8_t s) {
+    const uint16x4_t third = vdup_n_u16(0xAAAB);
+    uint32x4_t low = vmull_u16(vget_low_u16(s), third);
+    uint32x4_t high = vmull_u16(vget_high_u16(s), third);
+    return vshrn_n_u16(vcombine_u16(vshrn_n_u32(low, 16), vshrn_n_u32(high, 16)), 1);
+}
+
+// vld3 splits the channels, vst3 interleaves them back
+static void grayscaleNeon(uint8_t *p, size_t pixels) {
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x3_t v = vld3q_u8(p + 3 * i);
+        uint16x8_t low = vaddw_u8(vaddl_u8(vget_low_u8(v.val[0]), vget_low_u8(v.val[1])), vget_low_u8(v.val[2]));
+        uint16x8_t high = vaddw_u8(vaddl_u8(vget_high_u8(v.val[0]), vget_high_u8(v.val[1])), vget_high_u8(v.val[2]));
+        v.val[0] = vcombine_u8(divideBy3(low), divideBy3(high));
+        v.val[1] = v.val[2] = v.val[0];
+        vst3q_u8(p + 3 * i, v);
+    }
+    grayscaleScalar(p + 3 * i, pixels - i);
+}
+
+static void swapNeon(uint8_t *dst, const uint8_t *src, size_t pixels) {
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x3_t v = vld3q_u8(src + 3 * i);
+        uint8x16_t first = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = first;
+        vst3q_u8(dst + 3 * i, v);
+    }
+    swapScalar(dst + 3 * i, src + 3 * i, pixels - i);
+}
+#endif
+
+// ---- AVX2 and AVX-512 ----
+
+#ifdef DISPATCH_X86
+// pick[c][b]: shuffle taking channel c of 16 pixels from the 16-byte block b
+// of their 48 bytes, -1 where the byte is in another block
+static const int8_t pick[3][3][16] = {
+    {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+    {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+    {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}}
+};
+
+// Channel c of 32 pixels among 96 bytes (the second half is unused)
+static const uint8_t pickWide[3][64] = {
+    {0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 42, 45,
+     48, 51, 54, 57, 60, 63, 66, 69, 72, 75, 78, 81, 84, 87, 90, 93},
+    {1, 4, 7, 10, 13, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+     49, 52, 55, 58, 61, 64, 67, 70, 73, 76, 79, 82, 85, 88, 91, 94},
+    {2, 5, 8, 11, 14, 17, 20, 23, 26, 29, 32, 35, 38, 41, 44, 47,
+     50, 53, 56, 59, 62, 65, 68, 71, 74, 77, 80, 83, 86, 89, 92, 95}
+};
+
+// Byte k of interleaved pixels comes from pixel k / 3
+static const uint8_t thirds[128] = {
+    0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5,
+    5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10,
+    10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15,
+    16, 16, 16, 17, 17, 17, 18, 18, 18, 19, 19, 19, 20, 20, 20, 21,
+    21, 21, 22, 22, 22, 23, 23, 23, 24, 24, 24, 25, 25, 25, 26, 26,
+    26, 27, 27, 27, 28, 28, 28, 29, 29, 29, 30, 30, 30, 31, 31, 31
+};
+
+// First and third byte of each pixel exchanged (the first 48 bytes are used)
+static const uint8_t swapOrder[64] = {
+    2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 17,
+    16, 15, 20, 19, 18, 23, 22, 21, 26, 25, 24, 29, 28, 27, 32, 31,
+    30, 35, 34, 33, 38, 37, 36, 41, 40, 39, 44, 43, 42, 47, 46, 45,
+    50, 49, 48, 53, 52, 51, 56, 55, 54, 59, 58, 57, 62, 61, 60, 63
+};
+
+// 16 pixels per iteration: channels gathered with shuffles, summed on 16 bits,
+// divided by 3 and spread back over the 48 bytes
+DISPATCH_AVX2 static void grayscaleAvx2(uint8_t *p, size_t pixels) {
+    __m128i channel[3][3], spread[3];
+    for (int c = 0; c < 3; c++) {
+        for (int b = 0; b < 3; b++) channel[c][b] = _mm_loadu_si128((const __m128i *)pick[c][b]);
+        spread[c] = _mm_loadu_si128((const __m128i *)(thirds + 16 * c));
+    }
+    const __m128i third = _mm_set1_epi16((short)0xAAAB), zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        uint8_t *q = p + 3 * i;
+        __m128i in[3];
+        for (int b = 0; b < 3; b++) in[b] = _mm_loadu_si128((const __m128i *)(q + 16 * b));
+        __m128i low = zero, high = zero;
+        for (int c = 0; c < 3; c++) {
+            __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in[0], channel[c][0]), _mm_shuffle_epi8(in[1], channel[c][1])),
+                                     _mm_shuffle_epi8(in[2], channel[c][2]));
+            low = _mm_add_epi16(low, _mm_unpacklo_epi8(v, zero));
+            high = _mm_add_epi16(high, _mm_unpackhi_epi8(v, zero));
+        }
+        // s / 3 == (s * 0xAAAB) >> 17 for every sum of three bytes
+        low = _mm_srli_epi16(_mm_mulhi_epu16(low, third), 1);
+        high = _mm_srli_epi16(_mm_mulhi_epu16(high, third), 1);
+        __m128i gray = _mm_packus_epi16(low, high);
+        for (int b = 0; b < 3; b++) _mm_storeu_si128((__m128i *)(q + 16 * b), _mm_shuffle_epi8(gray, spread[b]));
+    }
+    grayscaleScalar(p + 3 * i, pixels - i);
+}
+
+// 8 pixels per iteration: each 128-bit lane gets 4 pixels, their bytes are
+// exchanged then packed back. Only the 24 bytes of the pixels are stored: a
+// store overlapping the next load would stall it when dst is src
+DISPATCH_AVX2 static void swapAvx2(uint8_t *dst, const uint8_t *src, size_t pixels) {
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    const __m256i order = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)swapOrder));
+    size_t i = 0;
+    for (; i + 11 <= pixels; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + 3 * i));
+        __m256i s = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, spread), order), pack);
+        _mm_storeu_si128((__m128i *)(dst + 3 * i), _mm256_castsi256_si128(s));
+        _mm_storel_epi64((__m128i *)(dst + 3 * i + 16), _mm256_extracti128_si256(s, 1));
+    }
+    swapScalar(dst + 3 * i, src + 3 * i, pixels - i);
+}
+
+// Two 128-entry permutes, the top bit of the index picks one of them.
+// The tail is done with masked loads and stores
+DISPATCH_AVX512 static void lutAvx512(uint8_t *p, size_t n, const uint8_t *map) {
+    __m512i table[4];
+    for (int t = 0; t < 4; t++) table[t] = _mm512_loadu_si512(map + 64 * t);
+    for (size_t i = 0; i < n; i += 64) {
+        __mmask64 mask = n - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (n - i)) - 1;
+        __m512i v = _mm512_maskz_loadu_epi8(mask, p + i);
+        __m512i low = _mm512_permutex2var_epi8(table[0], v, table[1]);
+        __m512i high = _mm512_permutex2var_epi8(table[2], v, table[3]);
+        _mm512_mask_storeu_epi8(p + i, mask, _mm512_mask_blend_epi8(_mm512_movepi8_mask(v), low, high));
+    }
+}
+
+// 32 pixels per iteration, byte permutes across the whole 96 bytes
+DISPATCH_AVX512 static void grayscaleAvx512(uint8_t *p, size_t pixels) {
+    __m512i channel[3];
+    for (int c = 0; c < 3; c++) channel[c] = _mm512_loadu_si512(pickWide[c]);
+    const __m512i spreadLow = _mm512_loadu_si512(thirds), spreadHigh = _mm512_loadu_si512(thirds + 64);
+    const __m512i third = _mm512_set1_epi16((short)0xAAAB);
+    size_t i = 0;
+    for (; i + 32 <= pixels; i += 32) {
+        uint8_t *q = p + 3 * i;
+        __m512i a = _mm512_loadu_si512(q);
+        __m512i b = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i *)(q + 64)));
+        __m512i sum = _mm512_setzero_si512();
+        for (int c = 0; c < 3; c++) {
+            __m256i v = _mm512_castsi512_si256(_mm512_permutex2var_epi8(a, channel[c], b));
+            sum = _mm512_add_epi16(sum, _mm512_cvtepu8_epi16(v));
+        }
+        __m512i gray = _mm512_castsi256_si512(_mm512_cvtepi16_epi8(_mm512_srli_epi16(_mm512_mulhi_epu16(sum, third), 1)));
+        _mm512_storeu_si512(q, _mm512_permutexvar_epi8(spreadLow, gray));
+        _mm256_storeu_si256((__m256i *)(q + 64), _mm512_castsi512_si256(_mm512_permutexvar_epi8(spreadHigh, gray)));
+    }
+    grayscaleScalar(p + 3 * i, pixels - i);
+}
+
+// 16 pixels per permute, stored as 32 + 16 bytes for the same reason as
+// swapAvx2, the tail with a masked load and store
+DISPATCH_AVX512 static void swapAvx512(uint8_t *dst, const uint8_t *src, size_t pixels) {
+    const __m512i order = _mm512_loadu_si512(swapOrder);
+    const __mmask64 pixelBytes = ((__mmask64)1 << 48) - 1;
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        __m512i v = _mm512_permutexvar_epi8(order, _mm512_maskz_loadu_epi8(pixelBytes, src + 3 * i));
+        _mm256_storeu_si256((__m256i *)(dst + 3 * i), _mm512_castsi512_si256(v));
+        _mm_storeu_si128((__m128i *)(dst + 3 * i + 32), _mm512_extracti32x4_epi32(v, 2));
+    }
+    __mmask64 tail = ((__mmask64)1 << (3 * (pixels - i))) - 1;
+    __m512i v = _mm512_maskz_loadu_epi8(tail, src + 3 * i);
+    _mm512_mask_storeu_epi8(dst + 3 * i, tail, _mm512_permutexvar_epi8(order, v));
+}
+#endif
+
+// ---- Tables ----
+
+static const t_kernels scalarKernels = {lutScalar, histogramScalar, grayscaleScalar, swapScalar};
+#if defined(__aarch64__)
+static const t_kernels baselineKernels = {lutNeon, histogramBaseline, grayscaleNeon, swapNeon};
+#else
+static const t_kernels baselineKernels = {lutBaseline, histogramBaseline, grayscaleScalar, swapScalar};
+#endif
+#ifdef DISPATCH_X86
+// Histograms gain nothing from wider registers, nor tables from AVX2 (16
+// shuffles of 16 entries were slower than the lookups)
+static const t_kernels avx2Kernels = {lutBaseline, histogramBaseline, grayscaleAvx2, swapAvx2};
+static const t_kernels avx512Kernels = {lutAvx512, histogramBaseline, grayscaleAvx512, swapAvx512};
+#endif
+
+int dispatch_supported(t_isa isa) {
+    switch (isa) {
+    case ISA_SCALAR:
+    case ISA_BASELINE:
+        return 1;
+#ifdef DISPATCH_X86
+    case ISA_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    case ISA_AVX512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512vbmi");
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *dispatch_name(t_isa isa) {
+    return (unsigned)isa < ISA_COUNT ? names[isa] : "unknown";
+}
+
+const t_kernels *dispatch_kernels(t_isa isa) {
+    if (!dispatch_supported(isa)) return NULL;
+    switch (isa) {
+#ifdef DISPATCH_X86
+    case ISA_AVX512:
+        return &avx512Kernels;
+    case ISA_AVX2:
+        return &avx2Kernels;
+#endif
+    case ISA_BASELINE:
+        return &baselineKernels;
+    default:
+        return &scalarKernels;
+    }
+}
+
+// ---- Selection ----
+
+// Read once, whichever thread gets there first
+static t_isa selected = ISA_SCALAR;
+
+static void dispatch_detect(void) {
+    int isa = ISA_COUNT - 1;
+    while (!dispatch_supported(isa)) isa--;
+    const char *env = getenv("IMAGEPROC_ISA");
+    if (env) {
+        int wanted = -1;
+        for (int i = 0; i < ISA_COUNT; i++) {
+            if (strcmp(env, names[i]) == 0) wanted = i;
+        }
+        if (strcmp(env, "baseline") == 0 || strcmp(env, "sse2") == 0 || strcmp(env, "neon") == 0) wanted = ISA_BASELINE;
+        if (wanted >= 0 && dispatch_supported(wanted)) isa = wanted;
+    }
+    selected = isa;
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK dispatch_detectOnce(PINIT_ONCE once, PVOID param, PVOID *context) {
+    (void)once;
+    (void)param;
+    (void)context;
+    dispatch_detect();
+    return TRUE;
+}
+#endif
+
+t_isa dispatch_isa(void) {
+#ifdef _WIN32
+    static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+    InitOnceExecuteOnce(&once, dispatch_detectOnce, NULL, NULL);
+#else
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, dispatch_detect);
+#endif
+    return selected;
+}
+
+const t_kernels *dispatch_selected(void) {
+    return dispatch_kernels(dispatch_isa());
+}
+
+// ---- Check ----
+
+#define CHECK_PIXELS 700
+#define CHECK_BYTES (3 * CHECK_PIXELS + 64)
+
+// xorshift32, the same bytes on every run
+static uint8_t nextByte(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return (uint8_t)(*state >> 24);
+}
+
+// Every length up to 80 pixels (all the tails), then longer rows, at 4
+// alignments. Whole buffers are compared to catch writes past the end
+static int checkKernels(const t_kernels *k, uint8_t *in, uint8_t *a, uint8_t *b) {
+    const t_kernels *ref = &scalarKernels;
+    uint32_t state = 0x2545F491;
+    uint8_t map[256];
+    for (int i = 0; i < CHECK_BYTES; i++) in[i] = nextByte(&state);
+    for (int i = 0; i < 256; i++) map[i] = nextByte(&state);
+
+    for (size_t n = 0; n <= CHECK_PIXELS; n += n < 80 ? 1 : 37) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            memcpy(a, in, CHECK_BYTES);
+            memcpy(b, in, CHECK_BYTES);
+            ref->lut(a + offset, 3 * n, map);
+            k->lut(b + offset, 3 * n, map);
+            if (memcmp(a, b, CHECK_BYTES) != 0) return -1;
+
+            memcpy(a, in, CHECK_BYTES);
+            memcpy(b, in, CHECK_BYTES);
+            ref->grayscale(a + offset, n);
+            k->grayscale(b + offset, n);
+            if (memcmp(a, b, CHECK_BYTES) != 0) return -1;
+
+            // In place, then into another buffer
+            memcpy(a, in, CHECK_BYTES);
+            memcpy(b, in, CHECK_BYTES);
+            ref->swapRedBlue(a + offset, a + offset, n);
+            k->swapRedBlue(b + offset, b + offset, n);
+            if (memcmp(a, b, CHECK_BYTES) != 0) return -1;
+            memset(a, 0, CHECK_BYTES);
+            memset(b, 0, CHECK_BYTES);
+            ref->swapRedBlue(a + 3 - offset, in + offset, n);
+            k->swapRedBlue(b + 3 - offset, in + offset, n);
+            if (memcmp(a, b, CHECK_BYTES) != 0) return -1;
+
+            // Three rows with padding, then a single value
+            unsigned int expected[256] = {0}, counted[256] = {0};
+            ref->histogram(in + offset, n, 3, n + offset, expected);
+            k->histogram(in + offset, n, 3, n + offset, counted);
+            memset(a, (int)n, 3 * n);
+            ref->histogram(a, 3 * n, 1, 3 * n, expected);
+            k->histogram(a, 3 * n, 1, 3 * n, counted);
+            if (memcmp(expected, counted, sizeof(expected)) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+int dispatch_check(t_isa isa) {
+    const t_kernels *k = dispatch_kernels(isa);
+    if (!k) return -1;
+    uint8_t *in = malloc(CHECK_BYTES);
+    uint8_t *a = malloc(CHECK_BYTES);
+    uint8_t *b = malloc(CHECK_BYTES);
+    int result = in && a && b ? checkKernels(k, in, a, b) : -1;
+    free(in);
+    free(a);
+    free(b);
+    if (result == 0) result = convolution_check(isa);
+    return result;
+}
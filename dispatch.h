@@ -0,0 +1,59 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+#include <stddef.h>
+#include <stdint.h>
+
+// === Instruction set chosen at run time ===
+// One binary runs on every CPU of its architecture: the hot loops are also
+// compiled for newer instruction sets and the best one this CPU supports is
+// picked the first time it is needed. IMAGEPROC_ISA=scalar|baseline|avx2|avx512
+// (sse2 and neon are names of baseline) selects another level for tests and
+// benchmarks, a level the CPU lacks falls back to the best one it has.
+// Every level gives the same bytes as the scalar loops (dispatch_check).
+
+typedef enum {
+    ISA_SCALAR,     // plain loops, convolutions only through the generic loop and the FFT
+    ISA_BASELINE,   // what the compiler emits without flags: SSE2 on x86-64, NEON on AArch64
+    ISA_AVX2,
+    ISA_AVX512,     // F, BW and VBMI: Ice Lake, Zen 4 and later. Older AVX-512 CPUs run AVX2
+    ISA_COUNT
+} t_isa;
+
+// Functions compiled for one level with GCC and Clang on x86-64. AVX-512
+// comes with FMA: files with float loops turn contraction off so that
+// a * b + c is still rounded twice like on the other levels
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define DISPATCH_X86 1
+#define DISPATCH_AVX2 __attribute__((target("avx2")))
+#define DISPATCH_AVX512 __attribute__((target("avx2,avx512f,avx512bw,avx512vbmi")))
+#endif
+
+// Row kernels of one level
+typedef struct {
+    // p[i] = map[p[i]]
+    void (*lut)(uint8_t *p, size_t n, const uint8_t *map);
+    // hist[v] += number of bytes equal to v in width * height bytes, rows stride bytes apart
+    void (*histogram)(const uint8_t *p, size_t width, size_t height, size_t stride, unsigned int *hist);
+    // RGB triplets replaced by (r + g + b) / 3
+    void (*grayscale)(uint8_t *p, size_t pixels);
+    // BGR <-> RGB, dst may be src
+    void (*swapRedBlue)(uint8_t *dst, const uint8_t *src, size_t pixels);
+} t_kernels;
+
+// Level in use, detected once
+t_isa dispatch_isa(void);
+int dispatch_supported(t_isa isa);
+// "scalar", "sse2", "neon", "avx2"...
+const char *dispatch_name(t_isa isa);
+// NULL when this CPU cannot run isa
+const t_kernels *dispatch_kernels(t_isa isa);
+// Kernels of the level in use
+const t_kernels *dispatch_selected(void);
+
+// Runs every kernel of isa and the convolution loops compiled for it on
+// pseudo-random rows of every length up to a few hundred pixels and compares
+// the bytes with the scalar loops: 0 when they all match, -1 otherwise (or
+// when isa is not supported, or memory ran out)
+int dispatch_check(t_isa isa);
+
+#endif // DISPATCH_H
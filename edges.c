@@ -0,0 +1,430 @@
+#include "edges.h"
+#include "gaussian.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// ---- Gradient ----
+
+typedef struct {
+    const uint8_t *const *rows;     // gray rows, top row first
+    int side;                       // weight of the side rows / columns
+    int center;                     // weight of the center row / column
+    t_gradient *g;
+} t_gradientJob;
+
+static void gradientAt(const uint8_t *r0, const uint8_t *r1, const uint8_t *r2, int xl, int x, int xr,
+                       int side, int center, int16_t *gx, int16_t *gy) {
+    *gx = (int16_t)(side * (r0[xr] - r0[xl]) + center * (r1[xr] - r1[xl]) + side * (r2[xr] - r2[xl]));
+    *gy = (int16_t)(side * (r2[xl] - r0[xl]) + center * (r2[x] - r0[x]) + side * (r2[xr] - r0[xr]));
+}
+
+static void gradientRows(int begin, int end, void *arg) {
+    const t_gradientJob *job = arg;
+    int w = job->g->width, h = job->g->height;
+    int side = job->side, center = job->center;
+
+    for (int y = begin; y < end; y++) {
+        const uint8_t *r0 = job->rows[y > 0 ? y - 1 : 0];
+        const uint8_t *r1 = job->rows[y];
+        const uint8_t *r2 = job->rows[y < h - 1 ? y + 1 : h - 1];
+        int16_t *gx = job->g->gx + (size_t)y * w;
+        int16_t *gy = job->g->gy + (size_t)y * w;
+
+        gradientAt(r0, r1, r2, 0, 0, w > 1 ? 1 : 0, side, center, &gx[0], &gy[0]);
+        if (w == 1) continue;
+        int x = 1;
+#ifdef __SSE2__
+        // 8 pixels at a time in 16-bit lanes
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i vs = _mm_set1_epi16((short)side), vc = _mm_set1_epi16((short)center);
+        for (; x + 8 <= w - 1; x += 8) {
+#define LOAD(r, o) _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)((r) + x + (o))), zero)
+            __m128i a0l = LOAD(r0, -1), a0c = LOAD(r0, 0), a0r = LOAD(r0, 1);
+            __m128i a1l = LOAD(r1, -1), a1r = LOAD(r1, 1);
+            __m128i a2l = LOAD(r2, -1), a2c = LOAD(r2, 0), a2r = LOAD(r2, 1);
+#undef LOAD
+            __m128i dx = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(_mm_sub_epi16(a0r, a0l), _mm_sub_epi16(a2r, a2l)), vs),
+                                       _mm_mullo_epi16(_mm_sub_epi16(a1r, a1l), vc));
+            __m128i dy = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(_mm_sub_epi16(a2l, a0l), _mm_sub_epi16(a2r, a0r)), vs),
+                                       _mm_mullo_epi16(_mm_sub_epi16(a2c, a0c), vc));
+            _mm_storeu_si128((__m128i *)(gx + x), dx);
+            _mm_storeu_si128((__m128i *)(gy + x), dy);
+        }
+#endif
+        for (; x < w - 1; x++) gradientAt(r0, r1, r2, x - 1, x, x + 1, side, center, &gx[x], &gy[x]);
+        gradientAt(r0, r1, r2, w - 2, w - 1, w - 1, side, center, &gx[w - 1], &gy[w - 1]);
+    }
+}
+
+void gradient_free(t_gradient *g) {
+    if (g) {
+        free(g->gx);
+        free(g->gy);
+        free(g);
+    }
+}
+
+static t_gradient *gradient_compute(const uint8_t *const *rows, int width, int height, t_gradientOperator op) {
+    t_gradient *g = malloc(sizeof(t_gradient));
+    if (!g) return NULL;
+    g->width = width;
+    g->height = height;
+    g->gx = malloc((size_t)width * height * sizeof(int16_t));
+    g->gy = malloc((size_t)width * height * sizeof(int16_t));
+    if (!g->gx || !g->gy) {
+        gradient_free(g);
+        return NULL;
+    }
+    t_gradientJob job = {rows, op == GRADIENT_SCHARR ? 3 : 1, op == GRADIENT_SCHARR ? 10 : 2, g};
+    parallel_for(height, gradientRows, &job);
+    return g;
+}
+
+// Rows of an 8-bit image from the top, whatever the order in memory
+static uint8_t **rows8(const t_bmp8 *img) {
+    uint8_t **rows = malloc(img->height * sizeof(uint8_t *));
+    if (!rows) return NULL;
+    int stride = ((img->width + 3) / 4) * 4;
+    for (unsigned int y = 0; y < img->height; y++) {
+        rows[y] = img->data + (size_t)(img->topDown ? y : img->height - 1 - y) * stride;
+    }
+    return rows;
+}
+
+// Gray plane of a color image, width * height bytes
+static uint8_t *gray24(const t_bmp24 *img) {
+    uint8_t *gray = malloc((size_t)img->width * img->height);
+    if (!gray) return NULL;
+    for (int y = 0; y < img->height; y++) {
+        const t_pixel *p = img->data[y];
+        uint8_t *out = gray + (size_t)y * img->width;
+        for (int x = 0; x < img->width; x++) out[x] = (uint8_t)((p[x].red + p[x].green + p[x].blue) / 3);
+    }
+    return gray;
+}
+
+static const uint8_t **planeRows(const uint8_t *plane, int width, int height) {
+    const uint8_t **rows = malloc(height * sizeof(uint8_t *));
+    if (!rows) return NULL;
+    for (int y = 0; y < height; y++) rows[y] = plane + (size_t)y * width;
+    return rows;
+}
+
+t_gradient *bmp8_gradient(const t_bmp8 *img, t_gradientOperator op) {
+    uint8_t **rows = rows8(img);
+    if (!rows) return NULL;
+    t_gradient *g = gradient_compute((const uint8_t *const *)rows, img->width, img->height, op);
+    free(rows);
+    return g;
+}
+
+t_gradient *bmp24_gradient(const t_bmp24 *img, t_gradientOperator op) {
+    uint8_t *gray = gray24(img);
+    const uint8_t **rows = gray ? planeRows(gray, img->width, img->height) : NULL;
+    t_gradient *g = rows ? gradient_compute(rows, img->width, img->height, op) : NULL;
+    free(rows);
+    free(gray);
+    return g;
+}
+
+// ---- Per-pixel planes, by bands of rows ----
+
+typedef struct {
+    const t_gradient *g;
+    float *out;                 // width * height values
+    uint8_t *const *rows;       // or magnitude bytes, top row first
+    float norm;
+} t_planeJob;
+
+#ifdef __SSE2__
+// Four int16 values sign-extended to floats
+static __m128 toFloats(const int16_t *p) {
+    __m128i v = _mm_loadl_epi64((const __m128i *)p);
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+// sqrt(gx^2 + gy^2) of four pixels, rounded like sqrtf
+static __m128 magnitude4(const int16_t *gx, const int16_t *gy) {
+    __m128 x = toFloats(gx), y = toFloats(gy);
+    return _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+}
+#endif
+
+static void magnitudeFloatRows(int begin, int end, void *arg) {
+    const t_planeJob *job = arg;
+    size_t i = (size_t)begin * job->g->width, last = (size_t)end * job->g->width;
+    const int16_t *gx = job->g->gx, *gy = job->g->gy;
+#ifdef __SSE2__
+    for (; i + 4 <= last; i += 4) _mm_storeu_ps(job->out + i, magnitude4(gx + i, gy + i));
+#endif
+    for (; i < last; i++) {
+        float x = gx[i], y = gy[i];
+        job->out[i] = sqrtf(x * x + y * y);
+    }
+}
+
+static void directionRows(int begin, int end, void *arg) {
+    const t_planeJob *job = arg;
+    size_t last = (size_t)end * job->g->width;
+    for (size_t i = (size_t)begin * job->g->width; i < last; i++) job->out[i] = atan2f(job->g->gy[i], job->g->gx[i]);
+}
+
+void gradient_magnitude(const t_gradient *g, float *magnitude) {
+    t_planeJob job = {g, magnitude, NULL, 0};
+    parallel_for(g->height, magnitudeFloatRows, &job);
+}
+
+void gradient_direction(const t_gradient *g, float *direction) {
+    t_planeJob job = {g, direction, NULL, 0};
+    parallel_for(g->height, directionRows, &job);
+}
+
+double gradient_energy(const t_gradient *g) {
+    size_t n = (size_t)g->width * g->height;
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += (int32_t)g->gx[i] * g->gx[i] + (int32_t)g->gy[i] * g->gy[i];
+    return n ? (double)sum / n : 0;
+}
+
+// ---- Magnitude images ----
+
+static void magnitudeByteRows(int begin, int end, void *arg) {
+    const t_planeJob *job = arg;
+    int w = job->g->width;
+    for (int y = begin; y < end; y++) {
+        const int16_t *gx = job->g->gx + (size_t)y * w, *gy = job->g->gy + (size_t)y * w;
+        uint8_t *out = job->rows[y];
+        int x = 0;
+#ifdef __SSE2__
+        // The magnitude stays below 32767, so the packs only clamp to 255
+        const __m128 norm = _mm_set1_ps(job->norm), half = _mm_set1_ps(0.5f);
+        for (; x + 8 <= w; x += 8) {
+            __m128i lo = _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(magnitude4(gx + x, gy + x), norm), half));
+            __m128i hi = _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(magnitude4(gx + x + 4, gy + x + 4), norm), half));
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128()));
+        }
+#endif
+        for (; x < w; x++) {
+            float m = sqrtf((float)gx[x] * gx[x] + (float)gy[x] * gy[x]) / job->norm + 0.5f;
+            out[x] = (uint8_t)(m > 255 ? 255 : m);
+        }
+    }
+}
+
+// Magnitude divided by the kernel weight: a full black to white step gives 255
+static void magnitudeToBytes(const t_gradient *g, t_gradientOperator op, uint8_t *const *out) {
+    t_planeJob job = {g, NULL, out, op == GRADIENT_SCHARR ? 16.0f : 4.0f};
+    parallel_for(g->height, magnitudeByteRows, &job);
+}
+
+t_status bmp8_sobel(t_bmp8 *img, t_gradientOperator op) {
+    t_gradient *g = bmp8_gradient(img, op);
+    uint8_t **rows = rows8(img);
+    t_status status = g && rows ? STATUS_OK : STATUS_NO_MEMORY;
+    if (status == STATUS_OK) magnitudeToBytes(g, op, rows);
+    free(rows);
+    gradient_free(g);
+    return status;
+}
+
+t_status bmp24_sobel(t_bmp24 *img, t_gradientOperator op) {
+    t_gradient *g = bmp24_gradient(img, op);
+    uint8_t *mag = malloc((size_t)img->width * img->height);
+    uint8_t **rows = malloc(img->height * sizeof(uint8_t *));
+    t_status status = g && mag && rows ? STATUS_OK : STATUS_NO_MEMORY;
+    if (status == STATUS_OK) {
+        for (int y = 0; y < img->height; y++) rows[y] = mag + (size_t)y * img->width;
+        magnitudeToBytes(g, op, rows);
+        for (int y = 0; y < img->height; y++) {
+            for (int x = 0; x < img->width; x++) {
+                t_pixel *p = &img->data[y][x];
+                p->red = p->green = p->blue = rows[y][x];
+            }
+        }
+    }
+    free(rows);
+    free(mag);
+    gradient_free(g);
+    return status;
+}
+
+// ---- Canny ----
+
+#define EDGE_NONE   0
+#define EDGE_WEAK   1
+#define EDGE_STRONG 2
+
+typedef struct {
+    const t_gradient *g;
+    int32_t *mag2;      // gx^2 + gy^2, same order as the true magnitude
+    double low2;
+    double high2;
+    uint8_t *classes;
+} t_cannyJob;
+
+static void magnitudeRows(int begin, int end, void *arg) {
+    const t_cannyJob *job = arg;
+    size_t w = job->g->width;
+    for (size_t i = begin * w; i < end * w; i++) {
+        job->mag2[i] = (int32_t)job->g->gx[i] * job->g->gx[i] + (int32_t)job->g->gy[i] * job->g->gy[i];
+    }
+}
+
+// Keep the pixels that are a maximum across the edge: the gradient direction is
+// rounded to 0, 45, 90 or 135 degrees with tan(22.5) ~ 0.4142, without atan2
+static void suppressRows(int begin, int end, void *arg) {
+    const t_cannyJob *job = arg;
+    int w = job->g->width, h = job->g->height;
+    for (int y = begin; y < end; y++) {
+        uint8_t *out = job->classes + (size_t)y * w;
+        if (y == 0 || y == h - 1) {
+            memset(out, EDGE_NONE, w);
+            continue;
+        }
+        const int32_t *m = job->mag2 + (size_t)y * w;
+        const int16_t *gx = job->g->gx + (size_t)y * w, *gy = job->g->gy + (size_t)y * w;
+        out[0] = out[w - 1] = EDGE_NONE;
+        for (int x = 1; x < w - 1; x++) {
+            int32_t v = m[x];
+            if (v < job->low2 || v == 0) {
+                out[x] = EDGE_NONE;
+                continue;
+            }
+            int ax = abs(gx[x]), ay = abs(gy[x]);
+            int a, b;   // offsets of the two neighbours across the edge
+            if (ay * 10000 <= ax * 4142) {
+                a = -1;
+                b = 1;
+            } else if (ax * 10000 <= ay * 4142) {
+                a = -w;
+                b = w;
+            } else if ((gx[x] > 0) == (gy[x] > 0)) {
+                a = -w - 1;
+                b = w + 1;
+            } else {
+                a = -w + 1;
+                b = w - 1;
+            }
+            int keep = v > m[x + a] && v >= m[x + b];
+            out[x] = !keep ? EDGE_NONE : (v >= job->high2 ? EDGE_STRONG : EDGE_WEAK);
+        }
+    }
+}
+
+// Grow the strong pixels through the weak ones (8-connected) with an explicit stack
+static int hysteresis(uint8_t *classes, int w, int h, uint8_t *const *out) {
+    int capacity = 4096, top = 0;
+    int *stack = malloc(capacity * sizeof(int));
+    if (!stack) return -1;
+
+    for (int y = 0; y < h; y++) memset(out[y], 0, w);
+    for (int start = 0; start < w * h; start++) {
+        if (classes[start] != EDGE_STRONG) continue;
+        classes[start] = EDGE_NONE;
+        stack[top++] = start;
+        while (top > 0) {
+            int i = stack[--top];
+            int y = i / w, x = i % w;
+            out[y][x] = 255;
+            // Suppression leaves the border at EDGE_NONE, so the neighbours are inside
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int j = i + dy * w + dx;
+                    if (classes[j] != EDGE_NONE) {
+                        if (top == capacity) {
+                            int *grown = realloc(stack, 2 * capacity * sizeof(int));
+                            if (!grown) {
+                                free(stack);
+                                return -1;
+                            }
+                            stack = grown;
+                            capacity *= 2;
+                        }
+                        classes[j] = EDGE_NONE;
+                        stack[top++] = j;
+                    }
+                }
+            }
+        }
+    }
+    free(stack);
+    return 0;
+}
+
+// gray is modified by the smoothing, out receives the edges
+static t_status canny(uint8_t *gray, int w, int h, float sigma, float low, float high, uint8_t *const *out) {
+    if (sigma > 0) {
+        float *f = malloc((size_t)w * h * sizeof(float));
+        if (!f) return STATUS_NO_MEMORY;
+        for (size_t i = 0; i < (size_t)w * h; i++) f[i] = gray[i];
+        t_status blurred = gaussian_blurFloat(f, w, h, 1, sigma);
+        if (blurred != STATUS_OK) {
+            free(f);
+            return blurred;
+        }
+        for (size_t i = 0; i < (size_t)w * h; i++) {
+            float v = f[i] + 0.5f;
+            gray[i] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+        free(f);
+    }
+
+    const uint8_t **rows = planeRows(gray, w, h);
+    t_gradient *g = rows ? gradient_compute(rows, w, h, GRADIENT_SOBEL) : NULL;
+    free(rows);
+    t_cannyJob job = {g, malloc((size_t)w * h * sizeof(int32_t)), (double)low * low, (double)high * high,
+                      malloc((size_t)w * h)};
+    t_status status = STATUS_NO_MEMORY;
+    if (g && job.mag2 && job.classes) {
+        parallel_for(h, magnitudeRows, &job);
+        parallel_for(h, suppressRows, &job);
+        if (hysteresis(job.classes, w, h, out) == 0) status = STATUS_OK;
+    }
+    free(job.mag2);
+    free(job.classes);
+    gradient_free(g);
+    return status;
+}
+
+t_status bmp8_canny(t_bmp8 *img, float sigma, float low, float high) {
+    int w = img->width, h = img->height;
+    uint8_t *gray = malloc((size_t)w * h);
+    uint8_t **rows = rows8(img);
+    t_status status = STATUS_NO_MEMORY;
+    if (gray && rows) {
+        for (int y = 0; y < h; y++) memcpy(gray + (size_t)y * w, rows[y], w);
+        status = canny(gray, w, h, sigma, low, high, rows);
+    }
+    free(rows);
+    free(gray);
+    return status;
+}
+
+t_status bmp24_canny(t_bmp24 *img, float sigma, float low, float high) {
+    int w = img->width, h = img->height;
+    uint8_t *gray = gray24(img);
+    uint8_t *edges = malloc((size_t)w * h);
+    uint8_t **rows = calloc(h, sizeof(uint8_t *));
+    t_status status = STATUS_NO_MEMORY;
+    if (gray && edges && rows) {
+        for (int y = 0; y < h; y++) rows[y] = edges + (size_t)y * w;
+        status = canny(gray, w, h, sigma, low, high, rows);
+    }
+    if (status == STATUS_OK) {
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                t_pixel *p = &img->data[y][x];
+                p->red = p->green = p->blue = rows[y][x];
+            }
+        }
+    }
+    free(rows);
+    free(edges);
+    free(gray);
+    return status;
+}
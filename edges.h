@@ -0,0 +1,48 @@
+#ifndef EDGES_H
+#define EDGES_H
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// === Gradients and Canny edge detection ===
+// Both derivatives come out of one pass over the image as int16 planes
+// (top row first). Every pass is split over the worker threads by bands of
+// rows and uses SSE2 where it helps.
+// Pixels outside of the image repeat the nearest edge pixel.
+// 24-bit images work on their gray level (r + g + b) / 3.
+
+typedef enum {
+    GRADIENT_SOBEL,     // 1 2 1 smoothing, |g| <= 1020 per axis
+    GRADIENT_SCHARR     // 3 10 3 smoothing, |g| <= 4080 per axis, better rotation invariance
+} t_gradientOperator;
+
+typedef struct {
+    int width;
+    int height;
+    int16_t *gx;        // positive when the image gets brighter to the right
+    int16_t *gy;        // positive when the image gets brighter downwards
+} t_gradient;
+
+t_gradient *bmp8_gradient(const t_bmp8 *img, t_gradientOperator op);
+t_gradient *bmp24_gradient(const t_bmp24 *img, t_gradientOperator op);
+void gradient_free(t_gradient *g);
+
+// width * height values: sqrt(gx^2 + gy^2) and atan2(gy, gx) in radians
+void gradient_magnitude(const t_gradient *g, float *magnitude);
+void gradient_direction(const t_gradient *g, float *direction);
+// Mean of gx^2 + gy^2 (Tenengrad), drops when the image gets blurry
+double gradient_energy(const t_gradient *g);
+
+// Replace the image with its gradient magnitude, scaled to 0..255. On failure
+// the image is left unchanged
+t_status bmp8_sobel(t_bmp8 *img, t_gradientOperator op);
+t_status bmp24_sobel(t_bmp24 *img, t_gradientOperator op);
+
+// Canny: Gaussian smoothing (skipped when sigma <= 0), Sobel gradient,
+// non-maximum suppression and hysteresis between the low and high magnitudes.
+// The image becomes 255 on edges and 0 elsewhere. A 24-bit image is left
+// unchanged on failure, an 8-bit one may already be partly cleared
+t_status bmp8_canny(t_bmp8 *img, float sigma, float low, float high);
+t_status bmp24_canny(t_bmp24 *img, float sigma, float low, float high);
+
+#endif // EDGES_H
@@ -0,0 +1,341 @@
+#include "fft.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Biggest tile used by the convolution
+#define FFT_MAX_TILE 1024
+
+t_fftPlan *fft_createPlan(int n) {
+    if (n < 2 || (n & (n - 1))) return NULL;
+    t_fftPlan *plan = malloc(sizeof(t_fftPlan));
+    if (!plan) return NULL;
+    plan->n = n;
+    plan->cosTable = malloc(n / 2 * sizeof(float));
+    plan->sinTable = malloc(n / 2 * sizeof(float));
+    plan->reverse = malloc(n * sizeof(int));
+    if (!plan->cosTable || !plan->sinTable || !plan->reverse) {
+        fft_freePlan(plan);
+        return NULL;
+    }
+
+    for (int k = 0; k < n / 2; k++) {
+        plan->cosTable[k] = (float)cos(2 * M_PI * k / n);
+        plan->sinTable[k] = (float)sin(2 * M_PI * k / n);
+    }
+    int bits = 0;
+    while ((1 << bits) < n) bits++;
+    for (int i = 0; i < n; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        plan->reverse[i] = r;
+    }
+    return plan;
+}
+
+void fft_freePlan(t_fftPlan *plan) {
+    if (plan) {
+        free(plan->cosTable);
+        free(plan->sinTable);
+        free(plan->reverse);
+        free(plan);
+    }
+}
+
+void fft_transform(const t_fftPlan *plan, float *re, float *im, int inverse) {
+    int n = plan->n;
+    for (int i = 0; i < n; i++) {
+        int j = plan->reverse[i];
+        if (i < j) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    // Butterflies, e^(-2i pi k / len) forward, e^(+2i pi k / len) inverse
+    float sign = inverse ? 1.0f : -1.0f;
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len / 2;
+        int step = n / len;
+        for (int i = 0; i < n; i += len) {
+            for (int k = 0; k < half; k++) {
+                float wr = plan->cosTable[k * step];
+                float wi = sign * plan->sinTable[k * step];
+                int a = i + k, b = a + half;
+                float vr = re[b] * wr - im[b] * wi;
+                float vi = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - vr;
+                im[b] = im[a] - vi;
+                re[a] += vr;
+                im[a] += vi;
+            }
+        }
+    }
+
+    if (inverse) {
+        float scale = 1.0f / n;
+        for (int i = 0; i < n; i++) {
+            re[i] *= scale;
+            im[i] *= scale;
+        }
+    }
+}
+
+void fft_transform2D(const t_fftPlan *plan, float *re, float *im, int inverse, float *tmp) {
+    int n = plan->n;
+    for (int y = 0; y < n; y++) fft_transform(plan, re + (size_t)y * n, im + (size_t)y * n, inverse);
+
+    // Columns are copied out so the transform works on contiguous data
+    float *cr = tmp, *ci = tmp + n;
+    for (int x = 0; x < n; x++) {
+        for (int y = 0; y < n; y++) {
+            cr[y] = re[(size_t)y * n + x];
+            ci[y] = im[(size_t)y * n + x];
+        }
+        fft_transform(plan, cr, ci, inverse);
+        for (int y = 0; y < n; y++) {
+            re[(size_t)y * n + x] = cr[y];
+            im[(size_t)y * n + x] = ci[y];
+        }
+    }
+}
+
+// Tile size with the lowest cost per output pixel, 0 when the kernel is too big
+// Tiles are never much bigger than the padded image (maxSide = 0: no limit)
+static int fft_tileSize(int kernelSize, int maxSide, double *costPerPixel) {
+    int best = 0;
+    double bestCost = 0;
+    for (int n = 16; n <= FFT_MAX_TILE; n <<= 1) {
+        if (best && maxSide && n / 2 >= maxSide + kernelSize - 1) break;
+        int useful = n - kernelSize + 1;
+        // Tiles of a row must not overlap more than their neighbours
+        if (useful < kernelSize - 1) continue;
+        int logn = 0;
+        while ((1 << logn) < n) logn++;
+        // Forward + inverse 2D transforms (n * n * log2(n) butterflies each) + product,
+        // shared by the two tiles packed in one complex tile, then loading / adding the tiles
+        double cost = (2.0 * n * n * logn * 5 + n * n * 6) / (2.0 * useful * useful) + 20;
+        if (!best || cost < bestCost) {
+            best = n;
+            bestCost = cost;
+        }
+    }
+    if (costPerPixel) *costPerPixel = bestCost;
+    return best;
+}
+
+int fft_isFasterThan(int kernelSize, double directCost) {
+    double cost;
+    if (!fft_tileSize(kernelSize, 0, &cost)) return 0;
+    return cost < directCost;
+}
+
+int fft_isFaster(int kernelSize) {
+    // A tap of the direct loop is a multiply-add plus the bounds check
+    return fft_isFasterThan(kernelSize, 4.0 * kernelSize * kernelSize);
+}
+
+typedef struct {
+    const float *src;
+    float *dst;
+    int width;
+    int height;
+    int kernelSize;
+    int n;                  // tile size
+    int useful;             // image pixels per tile side
+    int tilesX;
+    int phase;              // tile rows of the same parity never overlap
+    const t_fftPlan *plan;
+    const float *kre;       // kernel spectrum
+    const float *kim;
+} t_fftJob;
+
+// Add one tile result into the output, tile origin (ox, oy) in the image
+static void fft_accumulate(const t_fftJob *job, const float *tile, int ox, int oy) {
+    int half = job->kernelSize / 2;
+    int extent = job->useful + job->kernelSize - 1;
+    for (int ly = 0; ly < extent; ly++) {
+        int y = oy + ly - half;
+        if (y < 0 || y >= job->height) continue;
+        float *out = job->dst + (size_t)y * job->width;
+        const float *in = tile + (size_t)ly * job->n;
+        for (int lx = 0; lx < extent; lx++) {
+            int x = ox + lx - half;
+            if (x >= 0 && x < job->width) out[x] += in[lx];
+        }
+    }
+}
+
+// Copy an image tile into the zero-padded n x n buffer
+static void fft_loadTile(const t_fftJob *job, float *tile, int ox, int oy) {
+    int n = job->n;
+    memset(tile, 0, (size_t)n * n * sizeof(float));
+    if (ox >= job->width) return;
+    int w = ox + job->useful > job->width ? job->width - ox : job->useful;
+    int h = oy + job->useful > job->height ? job->height - oy : job->useful;
+    for (int y = 0; y < h; y++) {
+        memcpy(tile + (size_t)y * n, job->src + (size_t)(oy + y) * job->width + ox, w * sizeof(float));
+    }
+}
+
+static int fft_tileRows(int begin, int end, void *arg) {
+    const t_fftJob *job = arg;
+    int n = job->n;
+    float *re = malloc((size_t)n * n * sizeof(float));
+    float *im = malloc((size_t)n * n * sizeof(float));
+    float *tmp = malloc(2 * n * sizeof(float));
+    if (!re || !im || !tmp) {
+        free(re); free(im); free(tmp);
+        return -1;
+    }
+
+    for (int i = begin; i < end; i++) {
+        int oy = (2 * i + job->phase) * job->useful;
+        for (int tx = 0; tx < job->tilesX; tx += 2) {
+            int ox = tx * job->useful;
+            fft_loadTile(job, re, ox, oy);
+            fft_loadTile(job, im, ox + job->useful, oy);
+
+            fft_transform2D(job->plan, re, im, 0, tmp);
+            for (size_t k = 0; k < (size_t)n * n; k++) {
+                float r = re[k] * job->kre[k] - im[k] * job->kim[k];
+                im[k] = re[k] * job->kim[k] + im[k] * job->kre[k];
+                re[k] = r;
+            }
+            fft_transform2D(job->plan, re, im, 1, tmp);
+
+            fft_accumulate(job, re, ox, oy);
+            if (tx + 1 < job->tilesX) fft_accumulate(job, im, ox + job->useful, oy);
+        }
+    }
+    free(re);
+    free(im);
+    free(tmp);
+    return 0;
+}
+
+int fft_convolvePlane(const float *src, float *dst, int width, int height, const float *kernel, int kernelSize) {
+    int n = fft_tileSize(kernelSize, width > height ? width : height, NULL);
+    if (!n) return -1;
+    t_fftPlan *plan = fft_createPlan(n);
+    float *kre = calloc((size_t)n * n, sizeof(float));
+    float *kim = calloc((size_t)n * n, sizeof(float));
+    float *tmp = malloc(2 * n * sizeof(float));
+    if (!plan || !kre || !kim || !tmp) {
+        fft_freePlan(plan);
+        free(kre); free(kim); free(tmp);
+        return -1;
+    }
+
+    // The filters correlate: the kernel is flipped to get a convolution
+    for (int y = 0; y < kernelSize; y++) {
+        for (int x = 0; x < kernelSize; x++) {
+            kre[(size_t)y * n + x] = kernel[(kernelSize - 1 - y) * kernelSize + (kernelSize - 1 - x)];
+        }
+    }
+    fft_transform2D(plan, kre, kim, 0, tmp);
+
+    t_fftJob job;
+    job.src = src;
+    job.dst = dst;
+    job.width = width;
+    job.height = height;
+    job.kernelSize = kernelSize;
+    job.n = n;
+    job.useful = n - kernelSize + 1;
+    job.tilesX = (width + job.useful - 1) / job.useful;
+    job.plan = plan;
+    job.kre = kre;
+    job.kim = kim;
+
+    memset(dst, 0, (size_t)width * height * sizeof(float));
+    int tilesY = (height + job.useful - 1) / job.useful;
+    int status = 0;
+    for (job.phase = 0; job.phase < 2 && status == 0; job.phase++) {
+        status = parallel_forChecked((tilesY - job.phase + 1) / 2, fft_tileRows, &job);
+    }
+
+    fft_freePlan(plan);
+    free(kre);
+    free(kim);
+    free(tmp);
+    return status;
+}
+
+// Kernel given as rows, flattened
+static float *fft_flattenKernel(float **kernel, int kernelSize) {
+    float *k = malloc((size_t)kernelSize * kernelSize * sizeof(float));
+    if (!k) return NULL;
+    for (int y = 0; y < kernelSize; y++) memcpy(k + y * kernelSize, kernel[y], kernelSize * sizeof(float));
+    return k;
+}
+
+t_status bmp8_applyFilterFFT(t_bmp8 *img, float **kernel, int kernelSize) {
+    int width = img->width, height = img->height;
+    int stride = ((width + 3) / 4) * 4;
+    size_t size = (size_t)width * height;
+    float *src = malloc(size * sizeof(float));
+    float *dst = malloc(size * sizeof(float));
+    float *k = fft_flattenKernel(kernel, kernelSize);
+    int status = -1;
+
+    if (src && dst && k) {
+        // The plane starts with the top row
+        for (int y = 0; y < height; y++) {
+            const unsigned char *row = img->data + (size_t)(img->topDown ? y : height - 1 - y) * stride;
+            for (int x = 0; x < width; x++) src[(size_t)y * width + x] = row[x];
+        }
+        status = fft_convolvePlane(src, dst, width, height, k, kernelSize);
+        for (int y = 0; status == 0 && y < height; y++) {
+            unsigned char *row = img->data + (size_t)(img->topDown ? y : height - 1 - y) * stride;
+            for (int x = 0; x < width; x++) {
+                float pixel = dst[(size_t)y * width + x];
+                if (pixel < 0) pixel = 0;
+                if (pixel > 255) pixel = 255;
+                row[x] = (unsigned char)roundf(pixel);
+            }
+        }
+    }
+    free(src);
+    free(dst);
+    free(k);
+    return status == 0 ? STATUS_OK : STATUS_NO_MEMORY;
+}
+
+t_status bmp24_applyFilterFFT(t_bmp24 *img, float **kernel, int kernelSize) {
+    int width = img->width, height = img->height;
+    size_t size = (size_t)width * height;
+    float *src = malloc(size * sizeof(float));
+    float *dst = malloc(3 * size * sizeof(float));
+    float *k = fft_flattenKernel(kernel, kernelSize);
+    int status = src && dst && k ? 0 : -1;
+
+    // Every plane is convolved before the image is touched, so a failure leaves it as it was
+    for (int c = 0; c < 3 && status == 0; c++) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                t_pixel p = img->data[y][x];
+                src[(size_t)y * width + x] = c == 0 ? p.red : (c == 1 ? p.green : p.blue);
+            }
+        }
+        status = fft_convolvePlane(src, dst + c * size, width, height, k, kernelSize);
+    }
+    for (int y = 0; status == 0 && y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            // Values are truncated like bmp24_convolution, the offset absorbs the FFT round-off
+            const float *v = dst + (size_t)y * width + x;
+            img->data[y][x].red = (uint8_t)fminf(fmaxf(v[0] + 0.001f, 0), 255);
+            img->data[y][x].green = (uint8_t)fminf(fmaxf(v[size] + 0.001f, 0), 255);
+            img->data[y][x].blue = (uint8_t)fminf(fmaxf(v[2 * size] + 0.001f, 0), 255);
+        }
+    }
+    free(src);
+    free(dst);
+    free(k);
+    return status == 0 ? STATUS_OK : STATUS_NO_MEMORY;
+}
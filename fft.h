@@ -0,0 +1,39 @@
+#ifndef FFT_H
+#define FFT_H
+#include "bmp8.h"
+#include "bmp24.h"
+
+// === In-tree FFT and FFT-based convolution ===
+// Radix-2 complex transform. Real images are transformed two tiles at a
+// time (one in the real part, one in the imaginary part), and big images
+// are cut in tiles whose results are added together (overlap-add).
+
+typedef struct {
+    int n;              // power of two
+    float *cosTable;    // n / 2 twiddles
+    float *sinTable;
+    int *reverse;       // bit-reversed indices
+} t_fftPlan;
+
+t_fftPlan *fft_createPlan(int n);
+void fft_freePlan(t_fftPlan *plan);
+// In place, the inverse transform is scaled by 1 / n
+void fft_transform(const t_fftPlan *plan, float *re, float *im, int inverse);
+// n x n in place, tmp holds 2 * n floats
+void fft_transform2D(const t_fftPlan *plan, float *re, float *im, int inverse, float *tmp);
+
+// 1 when the FFT path is expected to beat the generic direct loop for this kernel size
+int fft_isFaster(int kernelSize);
+// 1 when it is expected to cost less per pixel than directCost multiply-adds
+int fft_isFasterThan(int kernelSize, double directCost);
+
+// Same result as the direct convolution (pixels outside of the image count as 0)
+// kernel is kernelSize * kernelSize weights, row by row. 0 on success, -1 otherwise
+int fft_convolvePlane(const float *src, float *dst, int width, int height, const float *kernel, int kernelSize);
+
+// FFT versions of bmp8_applyFilter / bmp24_applyFilter, STATUS_NO_MEMORY with
+// the image unchanged when memory runs out
+t_status bmp8_applyFilterFFT(t_bmp8 *img, float **kernel, int kernelSize);
+t_status bmp24_applyFilterFFT(t_bmp24 *img, float **kernel, int kernelSize);
+
+#endif // FFT_H
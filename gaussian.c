@@ -0,0 +1,220 @@
+#include "gaussian.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Columns are filtered by strips of this many floats, one row of a strip at a time
+#define STRIP 64
+
+typedef struct {
+    float *buf;
+    int width;
+    int height;
+    int channels;
+    // Exact kernel
+    const float *weights;  // 2 * radius + 1 values
+    int radius;
+    // Recursive filter, w[n] = B * in[n] + b1 * w[n-1] + b2 * w[n-2] + b3 * w[n-3]
+    float B, b1, b2, b3;
+} t_gaussJob;
+
+// Young & van Vliet coefficients, in the 2002 form (van Vliet, Young, Verbeek)
+// whose impulse response has exactly the requested variance
+static void gaussian_iirCoefficients(t_gaussJob *job, float sigma) {
+    const double m0 = 1.16680, m1 = 1.10783, m2 = 1.40586;
+    double q = 1.31564 * (sqrt(1 + 0.490811 * sigma * sigma) - 1);
+    double scale = (m0 + q) * (m1 * m1 + m2 * m2 + 2 * m1 * q + q * q);
+    job->b1 = (float)(q * (2 * m0 * m1 + m1 * m1 + m2 * m2 + (2 * m0 + 4 * m1) * q + 3 * q * q) / scale);
+    job->b2 = (float)(-q * q * (m0 + 2 * m1 + 3 * q) / scale);
+    job->b3 = (float)(q * q * q / scale);
+    job->B = 1 - (job->b1 + job->b2 + job->b3);
+}
+
+// 1D recursive filter on n values spaced by step, in place
+static void gaussian_iir1D(float *p, int n, int step, const t_gaussJob *job) {
+    float B = job->B, b1 = job->b1, b2 = job->b2, b3 = job->b3;
+    // Edges are extended: the filter starts in its steady state
+    float w1 = p[0], w2 = p[0], w3 = p[0];
+    for (int i = 0; i < n; i++) {
+        float w = B * p[i * step] + b1 * w1 + b2 * w2 + b3 * w3;
+        p[i * step] = w;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+    w1 = w2 = w3 = p[(n - 1) * step];
+    for (int i = n - 1; i >= 0; i--) {
+        float w = B * p[i * step] + b1 * w1 + b2 * w2 + b3 * w3;
+        p[i * step] = w;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+}
+
+// 1D exact kernel from src to dst (n values spaced by step)
+static void gaussian_fir1D(const float *src, float *dst, int n, int step, const t_gaussJob *job) {
+    int r = job->radius;
+    for (int i = 0; i < n; i++) {
+        float sum = 0;
+        if (i >= r && i < n - r) {
+            const float *s = src + (i - r) * step;
+            for (int k = 0; k <= 2 * r; k++) sum += s[k * step] * job->weights[k];
+        } else {
+            for (int k = -r; k <= r; k++) {
+                int j = i + k;
+                j = j < 0 ? 0 : (j >= n ? n - 1 : j);
+                sum += src[j * step] * job->weights[k + r];
+            }
+        }
+        dst[i * step] = sum;
+    }
+}
+
+static int gaussian_rows(int begin, int end, void *arg) {
+    t_gaussJob *job = arg;
+    int rowLength = job->width * job->channels;
+    float *tmp = job->weights ? malloc(rowLength * sizeof(float)) : NULL;
+    if (job->weights && !tmp) return -1;
+
+    for (int y = begin; y < end; y++) {
+        float *row = job->buf + (size_t)y * rowLength;
+        if (tmp) memcpy(tmp, row, rowLength * sizeof(float));
+        for (int c = 0; c < job->channels; c++) {
+            if (job->weights) gaussian_fir1D(tmp + c, row + c, job->width, job->channels, job);
+            else gaussian_iir1D(row + c, job->width, job->channels, job);
+        }
+    }
+    free(tmp);
+    return 0;
+}
+
+// Vertical pass, a strip of columns is walked row by row so memory stays contiguous
+static int gaussian_columns(int begin, int end, void *arg) {
+    t_gaussJob *job = arg;
+    int rowLength = job->width * job->channels;
+    int h = job->height;
+    // Strip copy for the exact kernel, 3 rows of filter state for the recursive one
+    float *tmp = malloc((size_t)STRIP * (h > 3 ? h : 3) * sizeof(float));
+    if (!tmp) return -1;
+
+    for (int strip = begin; strip < end; strip++) {
+        int c0 = strip * STRIP;
+        int c1 = c0 + STRIP > rowLength ? rowLength : c0 + STRIP;
+        int n = c1 - c0;
+        float *base = job->buf + c0;
+
+        if (!job->weights) {
+            float B = job->B, b1 = job->b1, b2 = job->b2, b3 = job->b3;
+            float *w1 = tmp, *w2 = tmp + STRIP, *w3 = tmp + 2 * STRIP;
+            for (int c = 0; c < n; c++) w1[c] = w2[c] = w3[c] = base[c];
+            for (int y = 0; y < h; y++) {
+                float *p = base + (size_t)y * rowLength;
+                for (int c = 0; c < n; c++) {
+                    float w = B * p[c] + b1 * w1[c] + b2 * w2[c] + b3 * w3[c];
+                    w3[c] = w2[c]; w2[c] = w1[c]; w1[c] = w;
+                    p[c] = w;
+                }
+            }
+            const float *last = base + (size_t)(h - 1) * rowLength;
+            for (int c = 0; c < n; c++) w1[c] = w2[c] = w3[c] = last[c];
+            for (int y = h - 1; y >= 0; y--) {
+                float *p = base + (size_t)y * rowLength;
+                for (int c = 0; c < n; c++) {
+                    float w = B * p[c] + b1 * w1[c] + b2 * w2[c] + b3 * w3[c];
+                    w3[c] = w2[c]; w2[c] = w1[c]; w1[c] = w;
+                    p[c] = w;
+                }
+            }
+            continue;
+        }
+
+        // Exact kernel: copy the strip, then accumulate the taps row by row
+        for (int y = 0; y < h; y++) memcpy(tmp + (size_t)y * STRIP, base + (size_t)y * rowLength, n * sizeof(float));
+        int r = job->radius;
+        for (int y = 0; y < h; y++) {
+            float *dst = base + (size_t)y * rowLength;
+            for (int c = 0; c < n; c++) dst[c] = 0;
+            for (int k = -r; k <= r; k++) {
+                int yy = y + k;
+                yy = yy < 0 ? 0 : (yy >= h ? h - 1 : yy);
+                const float *src = tmp + (size_t)yy * STRIP;
+                float wk = job->weights[k + r];
+                for (int c = 0; c < n; c++) dst[c] += src[c] * wk;
+            }
+        }
+    }
+    free(tmp);
+    return 0;
+}
+
+t_status gaussian_blurFloat(float *buf, int width, int height, int channels, float sigma) {
+    if (sigma <= 0 || width <= 0 || height <= 0) return STATUS_OK;
+
+    t_gaussJob job = {buf, width, height, channels, NULL, 0, 0, 0, 0, 0};
+    float *weights = NULL;
+    if (sigma < GAUSSIAN_IIR_SIGMA) {
+        job.radius = (int)ceilf(3 * sigma);
+        weights = malloc((2 * job.radius + 1) * sizeof(float));
+        if (!weights) return STATUS_NO_MEMORY;
+        float sum = 0;
+        for (int k = -job.radius; k <= job.radius; k++) {
+            weights[k + job.radius] = expf(-(k * k) / (2 * sigma * sigma));
+            sum += weights[k + job.radius];
+        }
+        for (int k = 0; k <= 2 * job.radius; k++) weights[k] /= sum;
+        job.weights = weights;
+    } else {
+        gaussian_iirCoefficients(&job, sigma);
+    }
+
+    int failed = parallel_forChecked(height, gaussian_rows, &job) != 0 ||
+                 parallel_forChecked((width * channels + STRIP - 1) / STRIP, gaussian_columns, &job) != 0;
+    free(weights);
+    return failed ? STATUS_NO_MEMORY : STATUS_OK;
+}
+
+static unsigned char toByte(float v) {
+    v = roundf(v);
+    return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+t_status bmp8_gaussianBlurSigma(t_bmp8 *img, float sigma) {
+    int width = img->width, height = img->height;
+    int stride = ((width + 3) / 4) * 4;
+    float *buf = malloc((size_t)width * height * sizeof(float));
+    if (!buf) return STATUS_NO_MEMORY;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) buf[(size_t)y * width + x] = img->data[(size_t)y * stride + x];
+    }
+    t_status status = gaussian_blurFloat(buf, width, height, 1, sigma);
+    for (int y = 0; status == STATUS_OK && y < height; y++) {
+        for (int x = 0; x < width; x++) img->data[(size_t)y * stride + x] = toByte(buf[(size_t)y * width + x]);
+    }
+    free(buf);
+    return status;
+}
+
+t_status bmp24_gaussianBlurSigma(t_bmp24 *img, float sigma) {
+    int width = img->width, height = img->height;
+    float *buf = malloc((size_t)width * height * 3 * sizeof(float));
+    if (!buf) return STATUS_NO_MEMORY;
+
+    for (int y = 0; y < height; y++) {
+        float *row = buf + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            row[3 * x] = img->data[y][x].red;
+            row[3 * x + 1] = img->data[y][x].green;
+            row[3 * x + 2] = img->data[y][x].blue;
+        }
+    }
+    t_status status = gaussian_blurFloat(buf, width, height, 3, sigma);
+    for (int y = 0; status == STATUS_OK && y < height; y++) {
+        const float *row = buf + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            img->data[y][x].red = toByte(row[3 * x]);
+            img->data[y][x].green = toByte(row[3 * x + 1]);
+            img->data[y][x].blue = toByte(row[3 * x + 2]);
+        }
+    }
+    free(buf);
+    return status;
+}
@@ -0,0 +1,23 @@
+#ifndef GAUSSIAN_H
+#define GAUSSIAN_H
+#include "bmp8.h"
+#include "bmp24.h"
+
+// === Gaussian blur with any sigma ===
+// Small sigmas use an exact separable kernel (radius 3 * sigma), bigger ones
+// the recursive filter of Young & van Vliet whose cost does not depend on sigma.
+// Rows and columns are split over the worker threads.
+// Pixels outside of the image repeat the nearest edge pixel.
+
+// Below this sigma the exact kernel is used
+#define GAUSSIAN_IIR_SIGMA 3.0f
+
+// On failure the image is left unchanged
+t_status bmp8_gaussianBlurSigma(t_bmp8 *img, float sigma);
+t_status bmp24_gaussianBlurSigma(t_bmp24 *img, float sigma);
+
+// In-place blur of an interleaved float image (channels values per pixel),
+// buf is partly blurred after a failure
+t_status gaussian_blurFloat(float *buf, int width, int height, int channels, float sigma);
+
+#endif // GAUSSIAN_H
@@ -0,0 +1,40 @@
+#ifndef IMAGEPROC_H
+#define IMAGEPROC_H
+
+// === Public header of libimageproc ===
+// Every function works only on its arguments, nothing is printed. The only
+// process-wide state is set up once and shared by all callers: the worker
+// threads with their job queue and the instruction set level in use.
+// Operations on images that can fail return a t_status; constructors return
+// NULL and pipeline recording returns -1 when memory runs out.
+// Two threads may use the library at the same time on different images.
+
+#define IMAGEPROC_VERSION_MAJOR 1
+#define IMAGEPROC_VERSION_MINOR 0
+
+#include "status.h"
+#include "buffer.h"
+#include "bmp8.h"
+#include "bmp24.h"
+#include "bmp32.h"
+#include "bmp1.h"
+#include "lut.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "gaussian.h"
+#include "fft.h"
+#include "convolution.h"
+#include "dispatch.h"
+#include "resample.h"
+#include "orient.h"
+#include "edges.h"
+#include "morphology.h"
+#include "threshold.h"
+#include "integral.h"
+#include "labeling.h"
+#include "smoothing.h"
+#include "cache.h"
+#include "roi.h"
+#include "tiled.h"
+
+#endif // IMAGEPROC_H
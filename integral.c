@@ -0,0 +1,171 @@
+#include "integral.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Table entries per column strip of the parallel column pass
+#define STRIP 512
+
+static t_integral *integral_allocate(int width, int height, int channels, int flags) {
+    t_integral *in = malloc(sizeof(t_integral));
+    if (!in) return NULL;
+    size_t size = (size_t)(width + 1) * (height + 1) * channels;
+    in->width = width;
+    in->height = height;
+    in->channels = channels;
+    in->sum = malloc(size * sizeof(uint64_t));
+    in->squares = (flags & INTEGRAL_SQUARES) ? malloc(size * sizeof(uint64_t)) : NULL;
+    if (!in->sum || ((flags & INTEGRAL_SQUARES) && !in->squares)) {
+        integral_free(in);
+        return NULL;
+    }
+    // First row and column
+    memset(in->sum, 0, (size_t)(width + 1) * channels * sizeof(uint64_t));
+    if (in->squares) memset(in->squares, 0, (size_t)(width + 1) * channels * sizeof(uint64_t));
+    return in;
+}
+
+void integral_free(t_integral *in) {
+    if (in) {
+        free(in->sum);
+        free(in->squares);
+        free(in);
+    }
+}
+
+typedef struct {
+    const uint8_t *const *rows;     // top row first, channels bytes per pixel
+    t_integral *in;
+    int accumulate;                 // add the row above while building (single pass)
+} t_integralJob;
+
+// Prefix sums along the rows, plus the row above when accumulating
+static void prefixRows(int begin, int end, void *arg) {
+    const t_integralJob *job = arg;
+    t_integral *in = job->in;
+    int ch = in->channels;
+    size_t rowLength = (size_t)(in->width + 1) * ch;
+
+    for (int y = begin; y < end; y++) {
+        const uint8_t *src = job->rows[y];
+        uint64_t *s = in->sum + (y + 1) * rowLength;
+        uint64_t *q = in->squares ? in->squares + (y + 1) * rowLength : NULL;
+        uint64_t runSum[3] = {0, 0, 0}, runSquares[3] = {0, 0, 0};
+        for (int c = 0; c < ch; c++) {
+            s[c] = 0;
+            if (q) q[c] = 0;
+        }
+        for (int x = 0; x < in->width; x++) {
+            for (int c = 0; c < ch; c++) {
+                uint32_t v = src[x * ch + c];
+                runSum[c] += v;
+                s[(x + 1) * ch + c] = runSum[c] + (job->accumulate ? s[(x + 1) * ch + c - rowLength] : 0);
+                if (q) {
+                    runSquares[c] += v * v;
+                    q[(x + 1) * ch + c] = runSquares[c] + (job->accumulate ? q[(x + 1) * ch + c - rowLength] : 0);
+                }
+            }
+        }
+    }
+}
+
+// Running sums down strips of columns, each strip is a contiguous add over the rows
+static void prefixColumns(int begin, int end, void *arg) {
+    const t_integralJob *job = arg;
+    t_integral *in = job->in;
+    size_t rowLength = (size_t)(in->width + 1) * in->channels;
+
+    for (int strip = begin; strip < end; strip++) {
+        size_t first = (size_t)strip * STRIP;
+        size_t count = rowLength - first < STRIP ? rowLength - first : STRIP;
+        for (int y = 2; y <= in->height; y++) {
+            uint64_t *s = in->sum + y * rowLength + first;
+            for (size_t i = 0; i < count; i++) s[i] += s[i - rowLength];
+            if (in->squares) {
+                uint64_t *q = in->squares + y * rowLength + first;
+                for (size_t i = 0; i < count; i++) q[i] += q[i - rowLength];
+            }
+        }
+    }
+}
+
+static void integral_build(const uint8_t *const *rows, t_integral *in, int flags) {
+    if (flags & INTEGRAL_PARALLEL) {
+        t_integralJob job = {rows, in, 0};
+        parallel_for(in->height, prefixRows, &job);
+        size_t rowLength = (size_t)(in->width + 1) * in->channels;
+        parallel_for((int)((rowLength + STRIP - 1) / STRIP), prefixColumns, &job);
+    } else {
+        // One pass: each entry is its row prefix plus the entry above
+        t_integralJob job = {rows, in, 1};
+        prefixRows(0, in->height, &job);
+    }
+}
+
+t_integral *integral_fromBmp8(const t_bmp8 *img, int flags) {
+    t_integral *in = integral_allocate(img->width, img->height, 1, flags);
+    const uint8_t **rows = malloc(img->height * sizeof(uint8_t *));
+    if (!in || !rows) {
+        integral_free(in);
+        free(rows);
+        return NULL;
+    }
+    int stride = ((img->width + 3) / 4) * 4;
+    for (unsigned int y = 0; y < img->height; y++) {
+        rows[y] = img->data + (size_t)(img->topDown ? y : img->height - 1 - y) * stride;
+    }
+    integral_build(rows, in, flags);
+    free(rows);
+    return in;
+}
+
+t_integral *integral_fromBmp24(const t_bmp24 *img, int flags) {
+    t_integral *in = integral_allocate(img->width, img->height, 3, flags);
+    const uint8_t **rows = malloc(img->height * sizeof(uint8_t *));
+    if (!in || !rows) {
+        integral_free(in);
+        free(rows);
+        return NULL;
+    }
+    for (int y = 0; y < img->height; y++) rows[y] = (const uint8_t *)img->data[y];
+    integral_build(rows, in, flags);
+    free(rows);
+    return in;
+}
+
+// ---- Queries ----
+
+// Clip the rectangle, 0 when it is empty
+static int clipRect(const t_integral *in, int *x0, int *y0, int *x1, int *y1) {
+    if (*x0 < 0) *x0 = 0;
+    if (*y0 < 0) *y0 = 0;
+    if (*x1 > in->width) *x1 = in->width;
+    if (*y1 > in->height) *y1 = in->height;
+    return *x0 < *x1 && *y0 < *y1;
+}
+
+static uint64_t rectSum(const uint64_t *table, const t_integral *in, int x0, int y0, int x1, int y1, int channel) {
+    size_t rowLength = (size_t)(in->width + 1) * in->channels;
+    const uint64_t *top = table + y0 * rowLength + channel, *bottom = table + y1 * rowLength + channel;
+    int ch = in->channels;
+    return bottom[x1 * ch] - bottom[x0 * ch] - top[x1 * ch] + top[x0 * ch];
+}
+
+uint64_t integral_sum(const t_integral *in, int x0, int y0, int x1, int y1, int channel) {
+    if (!clipRect(in, &x0, &y0, &x1, &y1)) return 0;
+    return rectSum(in->sum, in, x0, y0, x1, y1, channel);
+}
+
+double integral_mean(const t_integral *in, int x0, int y0, int x1, int y1, int channel) {
+    if (!clipRect(in, &x0, &y0, &x1, &y1)) return 0;
+    return (double)rectSum(in->sum, in, x0, y0, x1, y1, channel) / ((double)(x1 - x0) * (y1 - y0));
+}
+
+// E[v^2] - E[v]^2, needs INTEGRAL_SQUARES (0 otherwise)
+double integral_variance(const t_integral *in, int x0, int y0, int x1, int y1, int channel) {
+    if (!in->squares || !clipRect(in, &x0, &y0, &x1, &y1)) return 0;
+    double n = (double)(x1 - x0) * (y1 - y0);
+    double mean = rectSum(in->sum, in, x0, y0, x1, y1, channel) / n;
+    double variance = rectSum(in->squares, in, x0, y0, x1, y1, channel) / n - mean * mean;
+    return variance > 0 ? variance : 0;
+}
@@ -0,0 +1,35 @@
+#ifndef INTEGRAL_H
+#define INTEGRAL_H
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// === Summed-area tables (integral images) ===
+// Entry (x, y) holds the sum of the pixels in [0, x) x [0, y), top row first,
+// so the sum over any rectangle is 4 lookups. The tables have one more row and
+// column than the image (all 0) and use 64-bit sums, enough for any image
+// size. 24-bit images get one table per channel, interleaved red, green, blue.
+
+// Flags of the builders
+#define INTEGRAL_SQUARES 1  // also build the table of squared values (variance queries)
+#define INTEGRAL_PARALLEL 2 // row prefixes then column prefixes on the worker threads
+
+typedef struct {
+    int width;
+    int height;
+    int channels;
+    uint64_t *sum;          // (width + 1) * (height + 1) * channels
+    uint64_t *squares;      // NULL without INTEGRAL_SQUARES
+} t_integral;
+
+t_integral *integral_fromBmp8(const t_bmp8 *img, int flags);
+t_integral *integral_fromBmp24(const t_bmp24 *img, int flags);
+void integral_free(t_integral *in);
+
+// Rectangle [x0, x1) x [y0, y1), clipped to the image, channel 0 for 8-bit images.
+// Mean and variance of an empty rectangle are 0
+uint64_t integral_sum(const t_integral *in, int x0, int y0, int x1, int y1, int channel);
+double integral_mean(const t_integral *in, int x0, int y0, int x1, int y1, int channel);
+double integral_variance(const t_integral *in, int x0, int y0, int x1, int y1, int channel);
+
+#endif // INTEGRAL_H
@@ -0,0 +1,183 @@
+#include "labeling.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+
+// labels[i] - 1 is the parent of pixel i, a root points to itself.
+// Parents always have a smaller index, so every root is the first pixel of its set.
+static uint32_t findRoot(uint32_t *labels, uint32_t i) {
+    while (labels[i] - 1 != i) {
+        uint32_t parent = labels[i] - 1;
+        // Path halving
+        labels[i] = labels[parent];
+        i = parent;
+    }
+    return i;
+}
+
+static void unite(uint32_t *labels, uint32_t a, uint32_t b) {
+    a = findRoot(labels, a);
+    b = findRoot(labels, b);
+    if (a < b) labels[b] = a + 1;
+    else if (b < a) labels[a] = b + 1;
+}
+
+typedef struct {
+    const t_bmp8 *img8;
+    const t_bmp1 *img1;
+    int connectivity;
+    int stripes;
+    uint32_t *labels;
+} t_labelJob;
+
+static int stripeStart(const t_labelJob *job, int stripe, int height) {
+    return (int)((int64_t)height * stripe / job->stripes);
+}
+
+// Row y as bytes, non-zero for the foreground
+static const uint8_t *foregroundRow(const t_labelJob *job, int y, uint8_t *buffer) {
+    if (job->img8) {
+        const t_bmp8 *img = job->img8;
+        int stride = ((img->width + 3) / 4) * 4;
+        return img->data + (size_t)(img->topDown ? y : (int)img->height - 1 - y) * stride;
+    }
+    const t_bmp1 *img = job->img1;
+    for (int x = 0; x < img->width; x++) buffer[x] = (uint8_t)BMP1_GET(img, x, y);
+    return buffer;
+}
+
+// Links with the row above (pixel i is at (x, y))
+static void linkAbove(uint32_t *labels, uint32_t i, int x, int width, int connectivity) {
+    const uint32_t *up = labels + i - width;
+    if (up[0]) unite(labels, i, i - width);
+    if (connectivity == 8) {
+        if (x > 0 && up[-1]) unite(labels, i, i - width - 1);
+        if (x < width - 1 && up[1]) unite(labels, i, i - width + 1);
+    }
+}
+
+static int labelStripes(int begin, int end, void *arg) {
+    const t_labelJob *job = arg;
+    int w = job->img8 ? (int)job->img8->width : job->img1->width;
+    int h = job->img8 ? (int)job->img8->height : job->img1->height;
+    uint8_t *buffer = job->img1 ? malloc(w) : NULL;
+    if (job->img1 && !buffer) return -1;
+
+    for (int stripe = begin; stripe < end; stripe++) {
+        int y0 = stripeStart(job, stripe, h), y1 = stripeStart(job, stripe + 1, h);
+        for (int y = y0; y < y1; y++) {
+            const uint8_t *row = foregroundRow(job, y, buffer);
+            uint32_t *l = job->labels + (size_t)y * w;
+            for (int x = 0; x < w; x++) {
+                if (!row[x]) {
+                    l[x] = 0;
+                    continue;
+                }
+                uint32_t i = (uint32_t)((size_t)y * w + x);
+                l[x] = i + 1;
+                if (x > 0 && l[x - 1]) unite(job->labels, i, i - 1);
+                // The row above belongs to another stripe at y0, merged afterwards
+                if (y > y0) linkAbove(job->labels, i, x, w, job->connectivity);
+            }
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+static t_labeling *label(t_labelJob *job, int w, int h) {
+    t_labeling *out = malloc(sizeof(t_labeling));
+    if (!out) return NULL;
+    out->width = w;
+    out->height = h;
+    out->count = 0;
+    out->components = NULL;
+    out->labels = malloc((size_t)w * h * sizeof(uint32_t));
+    if (!out->labels) {
+        free(out);
+        return NULL;
+    }
+    job->labels = out->labels;
+
+    // A few stripes per thread, each at least 64 rows
+    job->stripes = parallel_threadCount() * 4;
+    if (job->stripes > h / 64) job->stripes = h / 64;
+    if (job->stripes < 1) job->stripes = 1;
+    // A stripe left unlabeled would send the passes below through garbage parents
+    if (parallel_forChecked(job->stripes, labelStripes, job) != 0) {
+        labeling_free(out);
+        return NULL;
+    }
+
+    // Merge step: the first row of each stripe with the last row of the previous one
+    for (int stripe = 1; stripe < job->stripes; stripe++) {
+        int y = stripeStart(job, stripe, h);
+        uint32_t *l = out->labels + (size_t)y * w;
+        for (int x = 0; x < w; x++) {
+            if (l[x]) linkAbove(out->labels, (uint32_t)((size_t)y * w + x), x, w, job->connectivity);
+        }
+    }
+
+    // Final labels in raster order: a root comes before the rest of its set, and the
+    // parent of a pixel is already relabeled when the pixel is reached
+    int capacity = 0;
+    for (int y = 0; y < h; y++) {
+        uint32_t *l = out->labels + (size_t)y * w;
+        for (int x = 0; x < w; x++) {
+            if (!l[x]) continue;
+            uint32_t i = (uint32_t)((size_t)y * w + x);
+            uint32_t parent = l[x] - 1;
+            if (parent != i) {
+                l[x] = out->labels[parent];
+            } else {
+                if (out->count == capacity) {
+                    capacity = capacity ? 2 * capacity : 256;
+                    t_component *grown = realloc(out->components, capacity * sizeof(t_component));
+                    if (!grown) {
+                        labeling_free(out);
+                        return NULL;
+                    }
+                    out->components = grown;
+                }
+                t_component *c = &out->components[out->count++];
+                c->area = 0;
+                c->minX = c->maxX = x;
+                c->minY = c->maxY = y;
+                c->centroidX = c->centroidY = 0;
+                l[x] = out->count;
+            }
+
+            // Centroids hold the coordinate sums until the end
+            t_component *c = &out->components[l[x] - 1];
+            c->area++;
+            if (x < c->minX) c->minX = x;
+            if (x > c->maxX) c->maxX = x;
+            c->maxY = y;
+            c->centroidX += x;
+            c->centroidY += y;
+        }
+    }
+    for (int i = 0; i < out->count; i++) {
+        out->components[i].centroidX /= out->components[i].area;
+        out->components[i].centroidY /= out->components[i].area;
+    }
+    return out;
+}
+
+t_labeling *bmp8_label(const t_bmp8 *img, int connectivity) {
+    t_labelJob job = {img, NULL, connectivity == 4 ? 4 : 8, 1, NULL};
+    return label(&job, img->width, img->height);
+}
+
+t_labeling *bmp1_label(const t_bmp1 *img, int connectivity) {
+    t_labelJob job = {NULL, img, connectivity == 4 ? 4 : 8, 1, NULL};
+    return label(&job, img->width, img->height);
+}
+
+void labeling_free(t_labeling *l) {
+    if (l) {
+        free(l->labels);
+        free(l->components);
+        free(l);
+    }
+}
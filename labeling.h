@@ -0,0 +1,37 @@
+#ifndef LABELING_H
+#define LABELING_H
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp1.h"
+
+// === Connected-component labeling ===
+// Foreground pixels (non-zero in an 8-bit image, set bits in a t_bmp1) that
+// touch each other get the same label. Horizontal stripes are labeled in
+// parallel with a union-find stored in the label array itself (every link
+// goes to a smaller pixel index), the stripe borders are then merged and one
+// raster pass gives the final labels and the statistics.
+
+typedef struct {
+    uint32_t area;              // pixels
+    int minX;                   // bounding box, inclusive
+    int minY;
+    int maxX;
+    int maxY;
+    double centroidX;
+    double centroidY;
+} t_component;
+
+typedef struct {
+    int width;
+    int height;
+    uint32_t *labels;           // width * height, top row first, 0 is the background
+    int count;                  // labels are 1..count, in raster order of appearance
+    t_component *components;    // components[label - 1]
+} t_labeling;
+
+// connectivity is 4 or 8, NULL on allocation failure
+t_labeling *bmp8_label(const t_bmp8 *img, int connectivity);
+t_labeling *bmp1_label(const t_bmp1 *img, int connectivity);
+void labeling_free(t_labeling *l);
+
+#endif // LABELING_H
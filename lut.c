@@ -0,0 +1,206 @@
+#include "lut.h"
+#include "dispatch.h"
+#include <math.h>
+#include <string.h>
+
+static uint8_t clampByte(float v) {
+    v = roundf(v);
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// map = f(map) on the selected channels
+static void lut_then(t_lut *lut, int channels, const uint8_t *f) {
+    for (int c = 0; c < 3; c++) {
+        if (!(channels & (1 << c))) continue;
+        for (int v = 0; v < 256; v++) lut->map[c][v] = f[lut->map[c][v]];
+    }
+}
+
+void lut_identity(t_lut *lut) {
+    for (int c = 0; c < 3; c++) {
+        for (int v = 0; v < 256; v++) lut->map[c][v] = v;
+    }
+}
+
+void lut_compose(t_lut *result, const t_lut *first, const t_lut *second) {
+    t_lut tmp;
+    for (int c = 0; c < 3; c++) {
+        for (int v = 0; v < 256; v++) tmp.map[c][v] = second->map[c][first->map[c][v]];
+    }
+    *result = tmp;
+}
+
+int lut_isIdentity(const t_lut *lut) {
+    for (int c = 0; c < 3; c++) {
+        for (int v = 0; v < 256; v++) if (lut->map[c][v] != v) return 0;
+    }
+    return 1;
+}
+
+int lut_isConstant(const t_lut *lut) {
+    for (int c = 0; c < 3; c++) {
+        for (int v = 1; v < 256; v++) if (lut->map[c][v] != lut->map[c][0]) return 0;
+    }
+    return 1;
+}
+
+void lut_negative(t_lut *lut, int channels) {
+    uint8_t f[256];
+    for (int v = 0; v < 256; v++) f[v] = 255 - v;
+    lut_then(lut, channels, f);
+}
+
+void lut_brightness(t_lut *lut, int channels, int value) {
+    uint8_t f[256];
+    for (int v = 0; v < 256; v++) {
+        int temp = v + value;
+        f[v] = (temp > 255) ? 255 : (temp < 0 ? 0 : (uint8_t)temp);
+    }
+    lut_then(lut, channels, f);
+}
+
+void lut_threshold(t_lut *lut, int channels, int threshold) {
+    uint8_t f[256];
+    for (int v = 0; v < 256; v++) f[v] = (v >= threshold) ? 255 : 0;
+    lut_then(lut, channels, f);
+}
+
+void lut_gamma(t_lut *lut, int channels, float gamma) {
+    if (gamma <= 0) return;
+    uint8_t f[256];
+    for (int v = 0; v < 256; v++) f[v] = clampByte(255.0f * powf(v / 255.0f, 1.0f / gamma));
+    lut_then(lut, channels, f);
+}
+
+void lut_contrast(t_lut *lut, int channels, float factor) {
+    uint8_t f[256];
+    for (int v = 0; v < 256; v++) f[v] = clampByte((v - 128) * factor + 128);
+    lut_then(lut, channels, f);
+}
+
+void lut_levels(t_lut *lut, int channels, int inBlack, int inWhite, float gamma, int outBlack, int outWhite) {
+    if (inWhite <= inBlack || gamma <= 0) return;
+    uint8_t f[256];
+    for (int v = 0; v < 256; v++) {
+        float t = (float)(v - inBlack) / (inWhite - inBlack);
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+        t = powf(t, 1.0f / gamma);
+        f[v] = clampByte(outBlack + t * (outWhite - outBlack));
+    }
+    lut_then(lut, channels, f);
+}
+
+// Monotone cubic interpolation (Fritsch-Carlson), no overshoot between points
+void lut_curves(t_lut *lut, int channels, const int *xs, const int *ys, int count) {
+    if (count < 2 || count > 256) return;
+    float d[256], m[256];
+    for (int k = 0; k < count - 1; k++) {
+        if (xs[k + 1] <= xs[k]) return;
+        d[k] = (float)(ys[k + 1] - ys[k]) / (xs[k + 1] - xs[k]);
+    }
+
+    // Tangents
+    m[0] = d[0];
+    m[count - 1] = d[count - 2];
+    for (int k = 1; k < count - 1; k++) {
+        m[k] = (d[k - 1] * d[k] <= 0) ? 0 : (d[k - 1] + d[k]) / 2;
+    }
+    for (int k = 0; k < count - 1; k++) {
+        if (d[k] == 0) {
+            m[k] = m[k + 1] = 0;
+            continue;
+        }
+        float a = m[k] / d[k], b = m[k + 1] / d[k];
+        float s = a * a + b * b;
+        if (s > 9) {
+            float tau = 3 / sqrtf(s);
+            m[k] = tau * a * d[k];
+            m[k + 1] = tau * b * d[k];
+        }
+    }
+
+    uint8_t f[256];
+    int k = 0;
+    for (int v = 0; v < 256; v++) {
+        if (v <= xs[0]) {
+            f[v] = clampByte(ys[0]);
+            continue;
+        }
+        if (v >= xs[count - 1]) {
+            f[v] = clampByte(ys[count - 1]);
+            continue;
+        }
+        while (v > xs[k + 1]) k++;
+        float h = xs[k + 1] - xs[k];
+        float t = (v - xs[k]) / h;
+        float t2 = t * t, t3 = t2 * t;
+        float y = (2 * t3 - 3 * t2 + 1) * ys[k] + (t3 - 2 * t2 + t) * h * m[k] +
+                  (-2 * t3 + 3 * t2) * ys[k + 1] + (t3 - t2) * h * m[k + 1];
+        f[v] = clampByte(y);
+    }
+    lut_then(lut, channels, f);
+}
+
+// Same formula as bmp8_equalize, on the histogram seen after the table
+void lut_equalize(t_lut *lut, int channels, const unsigned int *hist, unsigned int totalPixels) {
+    for (int c = 0; c < 3; c++) {
+        if (!(channels & (1 << c))) continue;
+
+        unsigned int moved[256] = {0};
+        for (int v = 0; v < 256; v++) moved[lut->map[c][v]] += hist[v];
+
+        unsigned int cdf[256];
+        cdf[0] = moved[0];
+        for (int i = 1; i < 256; i++) cdf[i] = cdf[i - 1] + moved[i];
+
+        unsigned int cdf_min = 0;
+        for (int i = 0; i < 256; i++) {
+            if (cdf[i] != 0) {
+                cdf_min = cdf[i];
+                break;
+            }
+        }
+
+        uint8_t f[256];
+        for (int i = 0; i < 256; i++) {
+            if (totalPixels != cdf_min)
+                f[i] = (uint8_t)roundf(((float)(cdf[i] - cdf_min) / (totalPixels - cdf_min)) * 255.0f);
+            else
+                f[i] = 0;
+        }
+        lut_then(lut, 1 << c, f);
+    }
+}
+
+// Table lookups with the kernel of the selected instruction set
+void bmp8_applyLUT(t_bmp8 *img, const t_lut *lut) {
+    dispatch_selected()->lut(img->data, img->dataSize, lut->map[0]);
+}
+
+void bmp24_applyLUT(t_bmp24 *img, const t_lut *lut) {
+    // The same map for the three channels: the rows are plain bytes
+    if (memcmp(lut->map[0], lut->map[1], 256) == 0 && memcmp(lut->map[0], lut->map[2], 256) == 0) {
+        const t_kernels *kernels = dispatch_selected();
+        for (int y = 0; y < img->height; y++) kernels->lut((uint8_t *)img->data[y], (size_t)img->width * 3, lut->map[0]);
+        return;
+    }
+    for (int y = 0; y < img->height; y++) {
+        t_pixel *row = img->data[y];
+        for (int x = 0; x < img->width; x++) {
+            row[x].red = lut->map[0][row[x].red];
+            row[x].green = lut->map[1][row[x].green];
+            row[x].blue = lut->map[2][row[x].blue];
+        }
+    }
+}
+
+void bmp32_applyLUT(t_bmp32 *img, const t_lut *lut) {
+    for (int y = 0; y < img->height; y++) {
+        t_pixel32 *row = BMP32_ROW(img, y);
+        for (int x = 0; x < img->width; x++) {
+            row[x].red = lut->map[0][row[x].red];
+            row[x].green = lut->map[1][row[x].green];
+            row[x].blue = lut->map[2][row[x].blue];
+        }
+    }
+}
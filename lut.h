@@ -0,0 +1,49 @@
+#ifndef LUT_H
+#define LUT_H
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "bmp32.h"
+
+// Channels selected by the lut_* functions
+#define LUT_RED   1
+#define LUT_GREEN 2
+#define LUT_BLUE  4
+#define LUT_RGB   (LUT_RED | LUT_GREEN | LUT_BLUE)
+
+// === Point-operation table, one 256-entry map per channel ===
+// 8-bit images use the red map. Every lut_* call composes a new operation
+// after the ones already in the table, so any sequence of point operations
+// costs a single lookup per value when applied.
+typedef struct {
+    uint8_t map[3][256];  // red, green, blue
+} t_lut;
+
+void lut_identity(t_lut *lut);
+// result = second(first(v))
+void lut_compose(t_lut *result, const t_lut *first, const t_lut *second);
+int lut_isIdentity(const t_lut *lut);
+int lut_isConstant(const t_lut *lut);
+
+// Same arithmetic as bmp8_negative / bmp8_brightness / bmp8_threshold
+void lut_negative(t_lut *lut, int channels);
+void lut_brightness(t_lut *lut, int channels, int value);
+void lut_threshold(t_lut *lut, int channels, int threshold);
+
+// out = 255 * (v / 255) ^ (1 / gamma)
+void lut_gamma(t_lut *lut, int channels, float gamma);
+// out = (v - 128) * factor + 128
+void lut_contrast(t_lut *lut, int channels, float factor);
+// Input range [inBlack, inWhite] with a midtone gamma, mapped to [outBlack, outWhite]
+void lut_levels(t_lut *lut, int channels, int inBlack, int inWhite, float gamma, int outBlack, int outWhite);
+// Smooth monotone curve through count control points (x increasing, in 0..255)
+void lut_curves(t_lut *lut, int channels, const int *xs, const int *ys, int count);
+// Histogram equalization, hist is the histogram of the values before the table
+void lut_equalize(t_lut *lut, int channels, const unsigned int *hist, unsigned int totalPixels);
+
+// One pass over the pixels
+void bmp8_applyLUT(t_bmp8 *img, const t_lut *lut);
+void bmp24_applyLUT(t_bmp24 *img, const t_lut *lut);
+void bmp32_applyLUT(t_bmp32 *img, const t_lut *lut);
+
+#endif // LUT_H
@@ -1,8 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "bmp8.h"
-#include "bmp24.h"
+#include "imageproc.h"
+#include "server.h"
 
 // ---- Menus ----
 void printMainMenu() {
@@ -45,13 +45,106 @@ void printFilterMenu24() {
     printf(">>> Your choice: ");
 }
 
+void printInfo8(const t_bmp8 *img) {
+    printf("\nImage information:\n");
+    printf("Width        : %u pixels\n", img->width);
+    printf("Height       : %u pixels\n", img->height);
+    printf("Color Depth  : %u bits\n", img->colorDepth);
+    printf("Image Size   : %u bytes\n", img->dataSize);
+    printf("Compression  : %s\n", img->compression == BMP_BI_RLE8 ? "RLE8" : "none");
+}
+
+void printStatus(t_status status, const char *filename) {
+    if (status == STATUS_OK) printf("Image save successfully in %s\n", filename);
+    else printf("%s: %s\n", filename, status_message(status));
+}
+
+#ifndef _WIN32
+// --client: send a file to the daemon and write the result
+int runClient(const char *socketPath, const char *input, const char *output, const char *pipeline) {
+    FILE *f = fopen(input, "rb");
+    if (!f) {
+        printf("Unable to open file %s\n", input);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *image = size > 0 ? malloc(size) : NULL;
+    if (!image || fread(image, 1, size, f) != (size_t)size) {
+        printf("Failed to read %s\n", input);
+        free(image);
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    t_buffer result;
+    buffer_init(&result);
+    t_status status = server_request(socketPath, pipeline, NULL, image, size, &result);
+    free(image);
+    if (status == STATUS_OK) {
+        f = fopen(output, "wb");
+        if (!f || fwrite(result.data, 1, result.size, f) != result.size) status = STATUS_WRITE_FAILED;
+        if (f) fclose(f);
+    }
+    buffer_free(&result);
+    printStatus(status, output);
+    return status == STATUS_OK ? 0 : 1;
+}
+#endif
+
+// --isa: the instruction sets of this CPU, each compared with the scalar loops
+int runIsaCheck(void) {
+    int failed = 0;
+    for (int isa = ISA_SCALAR; isa < ISA_COUNT; isa++) {
+        const char *result = "not supported";
+        if (dispatch_supported(isa)) {
+            int same = dispatch_check(isa) == 0;
+            failed |= !same;
+            result = same ? "ok" : "FAILED";
+        }
+        printf("%-8s %s%s\n", dispatch_name(isa), result, isa == (int)dispatch_isa() ? " (selected)" : "");
+    }
+    return failed;
+}
+
 // ---- Main ----
-int main() {
+int main(int argc, char **argv) {
+    // Instruction sets: image_processing --isa (IMAGEPROC_ISA selects another one)
+    if (argc == 2 && strcmp(argv[1], "--isa") == 0) return runIsaCheck();
+#ifndef _WIN32
+    // Daemon mode: image_processing --server SOCKET
+    //              image_processing --client SOCKET INPUT OUTPUT [PIPELINE]
+    // Results are cached in memory (IMAGEPROC_CACHE_MB, 256 by default, 0 to
+    // disable) and in the directory IMAGEPROC_CACHE_DIR when it is set
+    if (argc == 3 && strcmp(argv[1], "--server") == 0) {
+        const char *megabytes = getenv("IMAGEPROC_CACHE_MB");
+        size_t budget = (size_t)(megabytes ? atol(megabytes) : 256) << 20;
+        const char *directory = getenv("IMAGEPROC_CACHE_DIR");
+        t_cache *cache = budget > 0 || directory ? cache_create(budget, directory) : NULL;
+        if (server_run(argv[2], cache) != 0) printf("Unable to listen on %s\n", argv[2]);
+        cache_free(cache);
+        return 1;
+    }
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "--client") == 0) {
+        return runClient(argv[2], argv[3], argv[4], argc == 6 ? argv[5] : "");
+    }
+#endif
+    if (argc > 1) {
+        printf("Usage: %s [--isa | --server SOCKET | --client SOCKET INPUT OUTPUT [PIPELINE]]\n", argv[0]);
+        return 1;
+    }
+
     t_bmp8 *img8 = NULL;
     t_bmp24 *img24 = NULL;
     int currentType = 0;
     int choice;
     char filename[256];
+    t_status status;
+    // Filters are recorded here and only computed when the image is saved
+    t_pipeline *pending = pipeline_create();
+    if (!pending) return 1;
 
     // Define convolution kernels
     float* boxBlurKernel[3] = {
@@ -93,31 +186,47 @@ int main() {
             case 1:
                 if (img8) bmp8_free(img8);
                 if (img24) { bmp24_free(img24); img24 = NULL; }
+                pipeline_clear(pending);
                 currentType = 8;
                 printf("Enter 8-bit image path: ");
                 fgets(filename, 256, stdin);
                 filename[strcspn(filename, "\n")] = 0;
-                img8 = bmp8_loadImage(filename);
-                printf(img8 ? "Image loaded.\n" : "Failed to load image.\n");
+                img8 = bmp8_loadImage(filename, &status);
+                if (img8) printf("Image loaded : %ux%u\n", img8->width, img8->height);
+                else printf("Failed to load image: %s\n", status_message(status));
                 break;
 
             case 2:
                 if (img24) bmp24_free(img24);
                 if (img8) { bmp8_free(img8); img8 = NULL; }
+                pipeline_clear(pending);
                 currentType = 24;
                 printf("Enter 24-bit image path: ");
                 fgets(filename, 256, stdin);
                 filename[strcspn(filename, "\n")] = 0;
-                img24 = bmp24_loadImage(filename);
-                printf(img24 ? "Image loaded.\n" : "Failed to load image.\n");
+                img24 = bmp24_loadImage(filename, &status);
+                if (img24) printf("Image loaded : %dx%d\n", img24->width, img24->height);
+                else printf("Failed to load image: %s\n", status_message(status));
                 break;
 
             case 3:
                 printf("Enter save path: ");
                 fgets(filename, 256, stdin);
                 filename[strcspn(filename, "\n")] = 0;
-                if (currentType == 8 && img8) bmp8_saveImage(filename, img8);
-                else if (currentType == 24 && img24) bmp24_saveImage(img24, filename);
+                if (currentType == 8 && img8) {
+                    printf("Compress with RLE8? (y/n): ");
+                    int answer = getchar();
+                    if (answer != '\n') while (getchar() != '\n');
+                    img8->compression = (answer == 'y' || answer == 'Y') ? BMP_BI_RLE8 : BMP_BI_RGB;
+                    t_status status = pipeline_materialize8(pending, img8);
+                    if (status != STATUS_OK) printf("Filters failed: %s\n", status_message(status));
+                    else printStatus(bmp8_saveImage(filename, img8), filename);
+                }
+                else if (currentType == 24 && img24) {
+                    t_status status = pipeline_materialize24(pending, img24);
+                    if (status != STATUS_OK) printf("Filters failed: %s\n", status_message(status));
+                    else printStatus(bmp24_saveImage(img24, filename), filename);
+                }
                 else printf("No image loaded.\n");
                 break;
 
@@ -128,18 +237,18 @@ int main() {
                     scanf("%d", &fchoice);
                     getchar();
                     switch (fchoice) {
-                        case 1: bmp24_negative(img24); break;
-                        case 2: bmp24_grayscale(img24); break;
-                        case 3: printf("Brightness (-255 to 255): "); scanf("%d", &value); getchar(); bmp24_brightness(img24, value); break;
-                        case 4: bmp24_boxBlur(img24); break;
-                        case 5: bmp24_gaussianBlur(img24); break;
-                        case 6: bmp24_outline(img24); break;
-                        case 7: bmp24_emboss(img24); break;
-                        case 8: bmp24_sharpen(img24); break;
-                        case 9: bmp24_equalize(img24); break;
+                        case 1: pipeline_negative(pending); break;
+                        case 2: pipeline_grayscale(pending); break;
+                        case 3: printf("Brightness (-255 to 255): "); scanf("%d", &value); getchar(); pipeline_brightness(pending, value); break;
+                        case 4: pipeline_filter(pending, boxBlurKernel, 3); break;
+                        case 5: pipeline_filter(pending, gaussianBlurKernel, 3); break;
+                        case 6: pipeline_filter(pending, outlineKernel, 3); break;
+                        case 7: pipeline_filter(pending, embossKernel, 3); break;
+                        case 8: pipeline_filter(pending, sharpenKernel, 3); break;
+                        case 9: pipeline_equalize(pending); break;
                         default: break;
                     }
-                    printf("Filter applied.\n");
+                    printf("Filter queued (computed on save).\n");
                 } else if (currentType == 8 && img8) {
                     while (1) {
                         printFilterMenu8();
@@ -147,17 +256,17 @@ int main() {
                         getchar();
                         if (choice == 9) break;
                         switch (choice) {
-                            case 1: bmp8_negative(img8); break;
-                            case 2: printf("Brightness: "); int v; scanf("%d", &v); getchar(); bmp8_brightness(img8, v); break;
-                            case 3: printf("Threshold (0-255): "); int t; scanf("%d", &t); getchar(); bmp8_threshold(img8, t); break;
-                            case 4: bmp8_applyFilter(img8, boxBlurKernel, 3); break;
-                            case 5: bmp8_applyFilter(img8, gaussianBlurKernel, 3); break;
-                            case 6: bmp8_applyFilter(img8, sharpenKernel, 3); break;
-                            case 7: bmp8_applyFilter(img8, outlineKernel, 3); break;
-                            case 8: bmp8_applyFilter(img8, embossKernel, 3); break;
+                            case 1: pipeline_negative(pending); break;
+                            case 2: printf("Brightness: "); int v; scanf("%d", &v); getchar(); pipeline_brightness(pending, v); break;
+                            case 3: printf("Threshold (0-255): "); int t; scanf("%d", &t); getchar(); pipeline_threshold(pending, t); break;
+                            case 4: pipeline_filter(pending, boxBlurKernel, 3); break;
+                            case 5: pipeline_filter(pending, gaussianBlurKernel, 3); break;
+                            case 6: pipeline_filter(pending, sharpenKernel, 3); break;
+                            case 7: pipeline_filter(pending, outlineKernel, 3); break;
+                            case 8: pipeline_filter(pending, embossKernel, 3); break;
                             default: printf("Invalid choice.\n");
                         }
-                        printf("Filter applied.\n");
+                        printf("Filter queued (computed on save).\n");
                     }
                 } else {
                     printf("No image loaded.\n");
@@ -165,7 +274,7 @@ int main() {
                 break;
 
             case 5:
-                if (currentType == 8 && img8) bmp8_printInfo(img8);
+                if (currentType == 8 && img8) printInfo8(img8);
                 else if (currentType == 24 && img24) {
                     printf("Image Info:\n");
                     printf("    Width: %d\n", img24->width);
@@ -175,6 +284,8 @@ int main() {
                 break;
 
             case 6:
+                // Unsaved filters are simply dropped
+                pipeline_free(pending);
                 if (img8) bmp8_free(img8);
                 if (img24) bmp24_free(img24);
                 return 0;
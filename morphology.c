@@ -0,0 +1,423 @@
+#include "morphology.h"
+#include "parallel.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pixels per column strip, words per column strip in the binary path
+#define STRIP 64
+#define WORD_STRIP 8
+
+// Rows of bytes, channels values per pixel; block is set when the plane owns its pixels
+typedef struct {
+    uint8_t **rows;
+    int width;
+    int height;
+    int channels;
+    uint8_t *block;
+} t_plane;
+
+static void plane_free(t_plane *p) {
+    free(p->rows);
+    free(p->block);
+}
+
+static int plane_copy(const t_plane *src, t_plane *dst) {
+    size_t rowLength = (size_t)src->width * src->channels;
+    *dst = *src;
+    dst->rows = malloc(src->height * sizeof(uint8_t *));
+    dst->block = malloc(rowLength * src->height);
+    if (!dst->rows || !dst->block) {
+        plane_free(dst);
+        return -1;
+    }
+    for (int y = 0; y < src->height; y++) {
+        dst->rows[y] = dst->block + y * rowLength;
+        memcpy(dst->rows[y], src->rows[y], rowLength);
+    }
+    return 0;
+}
+
+// Smallest multiple of k holding n + k - 1 values (the line with its padding)
+static int paddedCount(int n, int k) {
+    return (n + k - 1 + k - 1) / k * k;
+}
+
+// ---- van Herk / Gil-Werman on bytes ----
+
+static void combineBytes(uint8_t *d, const uint8_t *a, const uint8_t *b, int n, int isMax) {
+    if (isMax) {
+        for (int i = 0; i < n; i++) d[i] = a[i] > b[i] ? a[i] : b[i];
+    } else {
+        for (int i = 0; i < n; i++) d[i] = a[i] < b[i] ? a[i] : b[i];
+    }
+}
+
+// v holds count values of lanes bytes (count is a multiple of k). Per block of k values,
+// h gets the running min/max from the block end and v the one from the block start,
+// so any window of k values is op(h[i], v[i + k - 1]): 3 operations whatever k is.
+// out[i] = op(v[i] .. v[i + k - 1]) for i < n
+static void vhgwBytes(uint8_t *v, uint8_t *h, int count, int lanes, int k, int n, int isMax, uint8_t *out) {
+    for (int b = 0; b < count; b += k) {
+        memcpy(h + (size_t)(b + k - 1) * lanes, v + (size_t)(b + k - 1) * lanes, lanes);
+        for (int p = b + k - 2; p >= b; p--) {
+            combineBytes(h + (size_t)p * lanes, v + (size_t)p * lanes, h + (size_t)(p + 1) * lanes, lanes, isMax);
+        }
+        for (int p = b + 1; p < b + k; p++) {
+            combineBytes(v + (size_t)p * lanes, v + (size_t)p * lanes, v + (size_t)(p - 1) * lanes, lanes, isMax);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        combineBytes(out + (size_t)i * lanes, h + (size_t)i * lanes, v + (size_t)(i + k - 1) * lanes, lanes, isMax);
+    }
+}
+
+typedef struct {
+    const t_plane *plane;
+    int k;          // window length
+    int r;          // pixels before the current one in the window
+    int isMax;
+} t_passJob;
+
+static int rowPass(int begin, int end, void *arg) {
+    const t_passJob *job = arg;
+    int ch = job->plane->channels, n = job->plane->width, k = job->k;
+    int count = paddedCount(n, k);
+    uint8_t pad = job->isMax ? 0 : 255;
+    uint8_t *v = malloc((size_t)count * ch);
+    uint8_t *h = malloc((size_t)count * ch);
+    if (v && h) {
+        for (int y = begin; y < end; y++) {
+            uint8_t *row = job->plane->rows[y];
+            memset(v, pad, (size_t)count * ch);
+            memcpy(v + (size_t)job->r * ch, row, (size_t)n * ch);
+            vhgwBytes(v, h, count, ch, k, n, job->isMax, row);
+        }
+    }
+    int status = v && h ? 0 : -1;
+    free(v);
+    free(h);
+    return status;
+}
+
+// Whole strips of rows at a time, so the min/max loops run over contiguous bytes
+static int columnPass(int begin, int end, void *arg) {
+    const t_passJob *job = arg;
+    const t_plane *p = job->plane;
+    int ch = p->channels, n = p->height, k = job->k;
+    int count = paddedCount(n, k);
+    uint8_t pad = job->isMax ? 0 : 255;
+    uint8_t *v = malloc((size_t)count * STRIP * ch);
+    uint8_t *h = malloc((size_t)count * STRIP * ch);
+    uint8_t *out = malloc((size_t)n * STRIP * ch);
+    if (v && h && out) {
+        for (int s = begin; s < end; s++) {
+            int x0 = s * STRIP;
+            int lanes = (p->width - x0 < STRIP ? p->width - x0 : STRIP) * ch;
+            for (int i = 0; i < count; i++) {
+                int y = i - job->r;
+                if (y >= 0 && y < n) memcpy(v + (size_t)i * lanes, p->rows[y] + x0 * ch, lanes);
+                else memset(v + (size_t)i * lanes, pad, lanes);
+            }
+            vhgwBytes(v, h, count, lanes, k, n, job->isMax, out);
+            for (int y = 0; y < n; y++) memcpy(p->rows[y] + x0 * ch, out + (size_t)y * lanes, lanes);
+        }
+    }
+    int status = v && h && out ? 0 : -1;
+    free(v);
+    free(h);
+    free(out);
+    return status;
+}
+
+// Min (erosion) or max (dilation) over the rectangle [x - rx, x - rx + kw) x [y - ry, y - ry + kh).
+// -1 when a worker could not allocate its buffers
+static int morphBytes(const t_plane *p, int kw, int kh, int rx, int ry, int isMax) {
+    if (kw > 1) {
+        t_passJob job = {p, kw, rx, isMax};
+        if (parallel_forChecked(p->height, rowPass, &job) != 0) return -1;
+    }
+    if (kh > 1) {
+        t_passJob job = {p, kh, ry, isMax};
+        if (parallel_forChecked((p->width + STRIP - 1) / STRIP, columnPass, &job) != 0) return -1;
+    }
+    return 0;
+}
+
+// ---- Binary images, 64 pixels per word ----
+
+static int bits_pack(const t_plane *p, t_bmp1 **b) {
+    *b = bmp1_create(p->width, p->height);
+    if (!*b) return -1;
+    for (int y = 0; y < p->height; y++) {
+        uint64_t *w = BMP1_ROW(*b, y);
+        for (int x = 0; x < p->width; x++) w[x >> 6] |= (uint64_t)(p->rows[y][x] != 0) << (x & 63);
+    }
+    return 0;
+}
+
+static void bits_unpack(const t_bmp1 *b, const t_plane *p) {
+    for (int y = 0; y < p->height; y++) {
+        for (int x = 0; x < p->width; x++) p->rows[y][x] = BMP1_GET(b, x, y) ? 255 : 0;
+    }
+}
+
+static t_bmp1 *bits_copy(const t_bmp1 *src) {
+    t_bmp1 *dst = bmp1_create(src->width, src->height);
+    if (dst) memcpy(dst->data, src->data, (size_t)src->wordsPerRow * src->height * sizeof(uint64_t));
+    return dst;
+}
+
+// Word i of the bits starting at bit offset, words past total are neutral
+static uint64_t bitsAt(const uint64_t *a, int total, long offset, int i, uint64_t neutral) {
+    long j = offset / 64 + i;
+    int s = offset % 64;
+    uint64_t lo = j < total ? a[j] : neutral;
+    if (!s) return lo;
+    uint64_t hi = j + 1 < total ? a[j + 1] : neutral;
+    return (lo >> s) | (hi << (64 - s));
+}
+
+// Bit q becomes op(bit q, bit q + m), in place from the start
+static void combineShifted(uint64_t *a, int total, int m, int isMax) {
+    uint64_t neutral = isMax ? 0 : ~(uint64_t)0;
+    for (int i = 0; i < total; i++) {
+        uint64_t b = bitsAt(a, total, m, i, neutral);
+        a[i] = isMax ? a[i] | b : a[i] & b;
+    }
+}
+
+typedef struct {
+    const t_bmp1 *bits;
+    int k;
+    int r;
+    int isMax;
+} t_bitsJob;
+
+// Windows of 1, 2, 4... pixels by doubling, then two overlapping windows of the
+// largest power of two give the k pixel window: log2(k) word operations per 64 pixels
+static int bitsRowPass(int begin, int end, void *arg) {
+    const t_bitsJob *job = arg;
+    const t_bmp1 *b = job->bits;
+    int k = job->k, words = b->wordsPerRow;
+    int margin = (k + 63) / 64;
+    int total = margin + words;
+    uint64_t neutral = job->isMax ? 0 : ~(uint64_t)0;
+    uint64_t *tmp = malloc(total * sizeof(uint64_t));
+    if (!tmp) return -1;
+
+    for (int y = begin; y < end; y++) {
+        uint64_t *row = BMP1_ROW(b, y);
+        for (int i = 0; i < margin; i++) tmp[i] = neutral;
+        memcpy(tmp + margin, row, words * sizeof(uint64_t));
+        if (b->width % 64) {
+            uint64_t mask = ((uint64_t)1 << (b->width % 64)) - 1;
+            tmp[total - 1] = job->isMax ? tmp[total - 1] & mask : tmp[total - 1] | ~mask;
+        }
+        int length = 1;
+        while (2 * length <= k) {
+            combineShifted(tmp, total, length, job->isMax);
+            length *= 2;
+        }
+        if (k > length) combineShifted(tmp, total, k - length, job->isMax);
+        for (int i = 0; i < words; i++) row[i] = bitsAt(tmp, total, (long)margin * 64 - job->r, i, neutral);
+        // Keep the bits past the width at 0
+        if (b->width % 64) row[words - 1] &= ((uint64_t)1 << (b->width % 64)) - 1;
+    }
+    free(tmp);
+    return 0;
+}
+
+// Same as vhgwBytes with AND / OR on words
+static void vhgwWords(uint64_t *v, uint64_t *h, int count, int lanes, int k, int n, int isMax, uint64_t *out) {
+    for (int b = 0; b < count; b += k) {
+        memcpy(h + (size_t)(b + k - 1) * lanes, v + (size_t)(b + k - 1) * lanes, lanes * sizeof(uint64_t));
+        for (int p = b + k - 2; p >= b; p--) {
+            for (int l = 0; l < lanes; l++) {
+                uint64_t a = v[(size_t)p * lanes + l], c = h[(size_t)(p + 1) * lanes + l];
+                h[(size_t)p * lanes + l] = isMax ? a | c : a & c;
+            }
+        }
+        for (int p = b + 1; p < b + k; p++) {
+            for (int l = 0; l < lanes; l++) {
+                uint64_t a = v[(size_t)p * lanes + l], c = v[(size_t)(p - 1) * lanes + l];
+                v[(size_t)p * lanes + l] = isMax ? a | c : a & c;
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        for (int l = 0; l < lanes; l++) {
+            uint64_t a = h[(size_t)i * lanes + l], c = v[(size_t)(i + k - 1) * lanes + l];
+            out[(size_t)i * lanes + l] = isMax ? a | c : a & c;
+        }
+    }
+}
+
+static int bitsColumnPass(int begin, int end, void *arg) {
+    const t_bitsJob *job = arg;
+    const t_bmp1 *b = job->bits;
+    int n = b->height, k = job->k;
+    int count = paddedCount(n, k);
+    uint64_t neutral = job->isMax ? 0 : ~(uint64_t)0;
+    uint64_t *v = malloc((size_t)count * WORD_STRIP * sizeof(uint64_t));
+    uint64_t *h = malloc((size_t)count * WORD_STRIP * sizeof(uint64_t));
+    uint64_t *out = malloc((size_t)n * WORD_STRIP * sizeof(uint64_t));
+    if (v && h && out) {
+        for (int s = begin; s < end; s++) {
+            int w0 = s * WORD_STRIP;
+            int lanes = b->wordsPerRow - w0 < WORD_STRIP ? b->wordsPerRow - w0 : WORD_STRIP;
+            for (int i = 0; i < count; i++) {
+                int y = i - job->r;
+                for (int l = 0; l < lanes; l++) {
+                    v[(size_t)i * lanes + l] = (y >= 0 && y < n) ? BMP1_ROW(b, y)[w0 + l] : neutral;
+                }
+            }
+            vhgwWords(v, h, count, lanes, k, n, job->isMax, out);
+            for (int y = 0; y < n; y++) {
+                memcpy(BMP1_ROW(b, y) + w0, out + (size_t)y * lanes, lanes * sizeof(uint64_t));
+            }
+        }
+    }
+    int status = v && h && out ? 0 : -1;
+    free(v);
+    free(h);
+    free(out);
+    return status;
+}
+
+static int morphBits(const t_bmp1 *b, int kw, int kh, int rx, int ry, int isMax) {
+    if (kw > 1) {
+        t_bitsJob job = {b, kw, rx, isMax};
+        if (parallel_forChecked(b->height, bitsRowPass, &job) != 0) return -1;
+    }
+    if (kh > 1) {
+        t_bitsJob job = {b, kh, ry, isMax};
+        if (parallel_forChecked((b->wordsPerRow + WORD_STRIP - 1) / WORD_STRIP, bitsColumnPass, &job) != 0) return -1;
+    }
+    return 0;
+}
+
+// ---- Operations ----
+
+static int isBinary(const t_plane *p) {
+    for (int y = 0; y < p->height; y++) {
+        const uint8_t *row = p->rows[y];
+        for (int x = 0; x < p->width * p->channels; x++) {
+            if (row[x] != 0 && row[x] != 255) return 0;
+        }
+    }
+    return 1;
+}
+
+// Opening and closing use the reflected rectangle for their second step
+t_status bmp1_morphology(t_bmp1 *img, t_morphOp op, int width, int height) {
+    if (width < 1 || height < 1) return STATUS_INVALID_ARGUMENT;
+    int rx = width / 2, ry = height / 2, fx = width - 1 - rx, fy = height - 1 - ry;
+    t_bmp1 *other = NULL;
+    if (op == MORPH_TOPHAT || op == MORPH_BLACKHAT || op == MORPH_GRADIENT) {
+        other = bits_copy(img);
+        if (!other) return STATUS_NO_MEMORY;
+    }
+
+    size_t n = (size_t)img->wordsPerRow * img->height;
+    int failed = 0;
+    switch (op) {
+        case MORPH_ERODE: failed = morphBits(img, width, height, rx, ry, 0); break;
+        case MORPH_DILATE: failed = morphBits(img, width, height, rx, ry, 1); break;
+        case MORPH_OPEN:
+            failed = morphBits(img, width, height, rx, ry, 0) || morphBits(img, width, height, fx, fy, 1);
+            break;
+        case MORPH_CLOSE:
+            failed = morphBits(img, width, height, rx, ry, 1) || morphBits(img, width, height, fx, fy, 0);
+            break;
+        case MORPH_TOPHAT:
+            failed = morphBits(other, width, height, rx, ry, 0) || morphBits(other, width, height, fx, fy, 1);
+            for (size_t i = 0; !failed && i < n; i++) img->data[i] &= ~other->data[i];
+            break;
+        case MORPH_BLACKHAT:
+            failed = morphBits(other, width, height, rx, ry, 1) || morphBits(other, width, height, fx, fy, 0);
+            for (size_t i = 0; !failed && i < n; i++) img->data[i] = other->data[i] & ~img->data[i];
+            break;
+        case MORPH_GRADIENT:
+            failed = morphBits(other, width, height, rx, ry, 1) || morphBits(img, width, height, rx, ry, 0);
+            for (size_t i = 0; !failed && i < n; i++) img->data[i] = other->data[i] & ~img->data[i];
+            break;
+    }
+    bmp1_free(other);
+    return failed ? STATUS_NO_MEMORY : STATUS_OK;
+}
+
+static t_status morphBinary(const t_plane *p, t_morphOp op, int kw, int kh) {
+    t_bmp1 *b;
+    if (bits_pack(p, &b) != 0) return STATUS_NO_MEMORY;
+    t_status status = bmp1_morphology(b, op, kw, kh);
+    if (status == STATUS_OK) bits_unpack(b, p);
+    bmp1_free(b);
+    return status;
+}
+
+// dst = a - b, a >= b everywhere
+static void subtractPlanes(const t_plane *dst, const t_plane *a, const t_plane *b) {
+    for (int y = 0; y < dst->height; y++) {
+        for (int x = 0; x < dst->width * dst->channels; x++) dst->rows[y][x] = a->rows[y][x] - b->rows[y][x];
+    }
+}
+
+static t_status morph(const t_plane *p, t_morphOp op, int kw, int kh) {
+    if (kw < 1 || kh < 1) return STATUS_INVALID_ARGUMENT;
+    if (p->channels == 1 && isBinary(p)) return morphBinary(p, op, kw, kh);
+
+    int rx = kw / 2, ry = kh / 2, fx = kw - 1 - rx, fy = kh - 1 - ry;
+    t_plane other = {NULL, 0, 0, 0, NULL};
+    if ((op == MORPH_TOPHAT || op == MORPH_BLACKHAT || op == MORPH_GRADIENT) && plane_copy(p, &other) != 0) {
+        return STATUS_NO_MEMORY;
+    }
+
+    int failed = 0;
+    switch (op) {
+        case MORPH_ERODE: failed = morphBytes(p, kw, kh, rx, ry, 0); break;
+        case MORPH_DILATE: failed = morphBytes(p, kw, kh, rx, ry, 1); break;
+        case MORPH_OPEN:
+            failed = morphBytes(p, kw, kh, rx, ry, 0) || morphBytes(p, kw, kh, fx, fy, 1);
+            break;
+        case MORPH_CLOSE:
+            failed = morphBytes(p, kw, kh, rx, ry, 1) || morphBytes(p, kw, kh, fx, fy, 0);
+            break;
+        case MORPH_TOPHAT:
+            failed = morphBytes(&other, kw, kh, rx, ry, 0) || morphBytes(&other, kw, kh, fx, fy, 1);
+            if (!failed) subtractPlanes(p, p, &other);
+            break;
+        case MORPH_BLACKHAT:
+            failed = morphBytes(&other, kw, kh, rx, ry, 1) || morphBytes(&other, kw, kh, fx, fy, 0);
+            if (!failed) subtractPlanes(p, &other, p);
+            break;
+        case MORPH_GRADIENT:
+            failed = morphBytes(&other, kw, kh, rx, ry, 1) || morphBytes(p, kw, kh, rx, ry, 0);
+            if (!failed) subtractPlanes(p, &other, p);
+            break;
+    }
+    plane_free(&other);
+    return failed ? STATUS_NO_MEMORY : STATUS_OK;
+}
+
+t_status bmp8_morphology(t_bmp8 *img, t_morphOp op, int width, int height) {
+    // Top row first, whatever the order in memory
+    int stride = ((img->width + 3) / 4) * 4;
+    t_plane p = {malloc(img->height * sizeof(uint8_t *)), img->width, img->height, 1, NULL};
+    if (!p.rows) return STATUS_NO_MEMORY;
+    for (unsigned int y = 0; y < img->height; y++) {
+        p.rows[y] = img->data + (size_t)(img->topDown ? y : img->height - 1 - y) * stride;
+    }
+    t_status status = morph(&p, op, width, height);
+    free(p.rows);
+    return status;
+}
+
+t_status bmp24_morphology(t_bmp24 *img, t_morphOp op, int width, int height) {
+    t_plane p = {malloc(img->height * sizeof(uint8_t *)), img->width, img->height, 3, NULL};
+    if (!p.rows) return STATUS_NO_MEMORY;
+    for (int y = 0; y < img->height; y++) p.rows[y] = (uint8_t *)img->data[y];
+    t_status status = morph(&p, op, width, height);
+    free(p.rows);
+    return status;
+}
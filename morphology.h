@@ -0,0 +1,33 @@
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+#include "bmp8.h"
+#include "bmp24.h"
+#include "bmp1.h"
+
+// === Morphology with rectangular structuring elements ===
+// Erosion and dilation are separable on a rectangle: a row pass then a
+// column pass, each with the van Herk / Gil-Werman algorithm, so the cost per
+// pixel does not depend on the size of the rectangle. The element is anchored
+// on its center (width / 2, height / 2) and pixels outside of the image never
+// win (they count as white for an erosion, black for a dilation).
+// 8-bit images holding only 0 and 255 (thresholded) are packed like a t_bmp1,
+// 64 pixels per word, and processed with AND / OR on whole words.
+// 24-bit images are processed channel by channel.
+
+typedef enum {
+    MORPH_ERODE,
+    MORPH_DILATE,
+    MORPH_OPEN,         // erode then dilate: removes small bright spots
+    MORPH_CLOSE,        // dilate then erode: fills small dark holes
+    MORPH_TOPHAT,       // image - open
+    MORPH_BLACKHAT,     // close - image
+    MORPH_GRADIENT      // dilate - erode
+} t_morphOp;
+
+// STATUS_INVALID_ARGUMENT for an empty rectangle. After STATUS_NO_MEMORY the
+// image may be partly processed
+t_status bmp8_morphology(t_bmp8 *img, t_morphOp op, int width, int height);
+t_status bmp24_morphology(t_bmp24 *img, t_morphOp op, int width, int height);
+t_status bmp1_morphology(t_bmp1 *img, t_morphOp op, int width, int height);
+
+#endif // MORPHOLOGY_H
@@ -0,0 +1,240 @@
+#include "orient.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TILE 16
+
+// Output pixel (x, y) reads source pixel (sx, sy):
+//  not transposed: sx = flipX ? width - 1 - x : x,  sy = flipY ? height - 1 - y : y
+//  transposed:     sx = flipX ? width - 1 - y : y,  sy = flipY ? height - 1 - x : x
+typedef struct {
+    int transpose;
+    int flipX;
+    int flipY;
+} t_orientMap;
+
+static t_orientMap orient_map(t_orientation o) {
+    static const t_orientMap maps[9] = {
+        {0, 0, 0}, {0, 0, 0}, {0, 1, 0}, {0, 1, 1}, {0, 0, 1},
+        {1, 0, 0}, {1, 0, 1}, {1, 1, 1}, {1, 1, 0}
+    };
+    return (o >= ORIENT_NORMAL && o <= ORIENT_ROTATE_270) ? maps[o] : maps[ORIENT_NORMAL];
+}
+
+int orient_swapsAxes(t_orientation o) {
+    return orient_map(o).transpose;
+}
+
+static void copyPixel(uint8_t *d, const uint8_t *s, int pixelSize) {
+    if (pixelSize == 1) *d = *s;
+    else memcpy(d, s, pixelSize);
+}
+
+static void copyStraight(uint8_t *const *src, int width, int height, int pixelSize, t_orientMap m,
+                         int first, int count, uint8_t *const *dst) {
+    for (int i = 0; i < count; i++) {
+        int y = first + i;
+        const uint8_t *s = src[m.flipY ? height - 1 - y : y];
+        uint8_t *d = dst[i];
+        if (!m.flipX) {
+            memcpy(d, s, (size_t)width * pixelSize);
+            continue;
+        }
+        for (int x = 0; x < width; x++) copyPixel(d + x * pixelSize, s + (width - 1 - x) * pixelSize, pixelSize);
+    }
+}
+
+#ifdef __SSE2__
+// 8 x 8 bytes: rows[k] + 0..7 becomes column k of out[0..7] (out[7..0] when reversed)
+static void transpose8x8(const uint8_t *const *rows, uint8_t *const *out, int reversed) {
+    __m128i a0 = _mm_loadl_epi64((const __m128i *)rows[0]), a1 = _mm_loadl_epi64((const __m128i *)rows[1]);
+    __m128i a2 = _mm_loadl_epi64((const __m128i *)rows[2]), a3 = _mm_loadl_epi64((const __m128i *)rows[3]);
+    __m128i a4 = _mm_loadl_epi64((const __m128i *)rows[4]), a5 = _mm_loadl_epi64((const __m128i *)rows[5]);
+    __m128i a6 = _mm_loadl_epi64((const __m128i *)rows[6]), a7 = _mm_loadl_epi64((const __m128i *)rows[7]);
+
+    __m128i b0 = _mm_unpacklo_epi8(a0, a1), b1 = _mm_unpacklo_epi8(a2, a3);
+    __m128i b2 = _mm_unpacklo_epi8(a4, a5), b3 = _mm_unpacklo_epi8(a6, a7);
+    __m128i c0 = _mm_unpacklo_epi16(b0, b1), c1 = _mm_unpackhi_epi16(b0, b1);
+    __m128i c2 = _mm_unpacklo_epi16(b2, b3), c3 = _mm_unpackhi_epi16(b2, b3);
+    __m128i d[4] = {
+        _mm_unpacklo_epi32(c0, c2), _mm_unpackhi_epi32(c0, c2),
+        _mm_unpacklo_epi32(c1, c3), _mm_unpackhi_epi32(c1, c3)
+    };
+
+    for (int j = 0; j < 4; j++) {
+        _mm_storel_epi64((__m128i *)out[reversed ? 7 - 2 * j : 2 * j], d[j]);
+        _mm_storel_epi64((__m128i *)out[reversed ? 6 - 2 * j : 2 * j + 1], _mm_unpackhi_epi64(d[j], d[j]));
+    }
+}
+#endif
+
+// Output row y is source column sx, output column x is source row sy:
+// a tile reads TILE source rows over TILE pixels each, all of them stay in cache
+static void copyTransposed(uint8_t *const *src, int width, int height, int pixelSize, t_orientMap m,
+                           int first, int count, uint8_t *const *dst) {
+    int outWidth = height;
+    for (int y0 = 0; y0 < count; y0 += TILE) {
+        int ny = count - y0 < TILE ? count - y0 : TILE;
+        for (int x0 = 0; x0 < outWidth; x0 += TILE) {
+            int nx = outWidth - x0 < TILE ? outWidth - x0 : TILE;
+#ifdef __SSE2__
+            if (pixelSize == 1 && nx == TILE && ny == TILE) {
+                for (int by = 0; by < TILE; by += 8) {
+                    int y = first + y0 + by;
+                    // First source column of the block, read forwards in memory
+                    int sx = m.flipX ? width - 1 - (y + 7) : y;
+                    for (int bx = 0; bx < TILE; bx += 8) {
+                        const uint8_t *rows[8];
+                        uint8_t *out[8];
+                        for (int k = 0; k < 8; k++) {
+                            int x = x0 + bx + k;
+                            rows[k] = src[m.flipY ? height - 1 - x : x] + sx;
+                            out[k] = dst[y0 + by + k] + x0 + bx;
+                        }
+                        transpose8x8(rows, out, m.flipX);
+                    }
+                }
+                continue;
+            }
+#endif
+            for (int i = 0; i < ny; i++) {
+                int y = first + y0 + i;
+                int sx = (m.flipX ? width - 1 - y : y) * pixelSize;
+                uint8_t *d = dst[y0 + i] + x0 * pixelSize;
+                for (int j = 0; j < nx; j++) {
+                    int x = x0 + j;
+                    copyPixel(d + j * pixelSize, src[m.flipY ? height - 1 - x : x] + sx, pixelSize);
+                }
+            }
+        }
+    }
+}
+
+void orient_copyRows(uint8_t *const *src, int width, int height, int pixelSize, t_orientation o,
+                     int bottomUp, int first, int count, uint8_t *const *dst) {
+    t_orientMap m = orient_map(o);
+    // Numbering the output rows from the bottom is one more vertical flip
+    if (bottomUp) {
+        if (m.transpose) m.flipX = !m.flipX;
+        else m.flipY = !m.flipY;
+    }
+    if (m.transpose) copyTransposed(src, width, height, pixelSize, m, first, count, dst);
+    else copyStraight(src, width, height, pixelSize, m, first, count, dst);
+}
+
+// ---- Whole images ----
+
+typedef struct {
+    uint8_t *const *src;
+    int width;
+    int height;
+    int pixelSize;
+    t_orientation o;
+    int bottomUp;
+    uint8_t *const *dst;
+} t_orientJob;
+
+static void orientTask(int begin, int end, void *arg) {
+    const t_orientJob *job = arg;
+    // Chunks start on a tile boundary so every tile but the last is full
+    begin = begin / TILE * TILE;
+    end = end / TILE * TILE;
+    if (end <= begin) return;
+    orient_copyRows(job->src, job->width, job->height, job->pixelSize, job->o, job->bottomUp,
+                    begin, end - begin, job->dst + begin);
+}
+
+static void orientAll(t_orientJob *job, int outHeight) {
+    // Whole tiles on the threads, then the partial last one
+    int full = outHeight / TILE;
+    parallel_for(full * TILE, orientTask, job);
+    if (full * TILE < outHeight) {
+        orient_copyRows(job->src, job->width, job->height, job->pixelSize, job->o, job->bottomUp,
+                        full * TILE, outHeight - full * TILE, job->dst + full * TILE);
+    }
+}
+
+t_status bmp8_orient(t_bmp8 *img, t_orientation o) {
+    if (o == ORIENT_NORMAL) return STATUS_OK;
+    int w = img->width, h = img->height;
+    int outW = orient_swapsAxes(o) ? h : w, outH = orient_swapsAxes(o) ? w : h;
+    int stride = ((w + 3) / 4) * 4, outStride = ((outW + 3) / 4) * 4;
+
+    uint8_t **src = malloc(h * sizeof(uint8_t *));
+    uint8_t **dst = malloc(outH * sizeof(uint8_t *));
+    unsigned char *data = calloc((size_t)outStride * outH, 1);
+    if (!src || !dst || !data) {
+        free(src);
+        free(dst);
+        free(data);
+        return STATUS_NO_MEMORY;
+    }
+    // Both buffers keep the row order of the file
+    for (int y = 0; y < h; y++) src[y] = img->data + (size_t)(img->topDown ? y : h - 1 - y) * stride;
+    for (int y = 0; y < outH; y++) dst[y] = data + (size_t)y * outStride;
+
+    t_orientJob job = {src, w, h, 1, o, !img->topDown, dst};
+    orientAll(&job, outH);
+
+    free(img->data);
+    img->data = data;
+    img->width = outW;
+    img->height = outH;
+    img->dataSize = outStride * outH;
+    free(src);
+    free(dst);
+    return STATUS_OK;
+}
+
+t_status bmp24_orient(t_bmp24 *img, t_orientation o) {
+    if (o == ORIENT_NORMAL) return STATUS_OK;
+    int w = img->width, h = img->height;
+    int outW = orient_swapsAxes(o) ? h : w, outH = orient_swapsAxes(o) ? w : h;
+
+    t_pixel **data = bmp24_allocateDataPixels(outW, outH);
+    uint8_t **src = malloc(h * sizeof(uint8_t *));
+    uint8_t **dst = malloc(outH * sizeof(uint8_t *));
+    if (!data || !src || !dst) {
+        if (data) bmp24_freeDataPixels(data, outH);
+        free(src);
+        free(dst);
+        return STATUS_NO_MEMORY;
+    }
+    for (int y = 0; y < h; y++) src[y] = (uint8_t *)img->data[y];
+    for (int y = 0; y < outH; y++) dst[y] = (uint8_t *)data[y];
+
+    t_orientJob job = {src, w, h, sizeof(t_pixel), o, 0, dst};
+    orientAll(&job, outH);
+
+    bmp24_freeDataPixels(img->data, h);
+    img->data = data;
+    img->width = outW;
+    img->height = outH;
+    free(src);
+    free(dst);
+    return STATUS_OK;
+}
+
+// 0 for an unsupported angle
+static int rotation(int degrees) {
+    switch (degrees) {
+        case 90: return ORIENT_ROTATE_90;
+        case 180: return ORIENT_ROTATE_180;
+        case 270: return ORIENT_ROTATE_270;
+        default: return 0;
+    }
+}
+
+t_status bmp8_rotate(t_bmp8 *img, int degrees) {
+    int o = rotation(degrees);
+    return o ? bmp8_orient(img, o) : STATUS_INVALID_ARGUMENT;
+}
+
+t_status bmp24_rotate(t_bmp24 *img, int degrees) {
+    int o = rotation(degrees);
+    return o ? bmp24_orient(img, o) : STATUS_INVALID_ARGUMENT;
+}
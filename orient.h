@@ -0,0 +1,46 @@
+#ifndef ORIENT_H
+#define ORIENT_H
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// === Rotations, flips and transposes ===
+// The values are the EXIF orientation tags: applying the transform to an
+// image tagged with that value shows it upright. The transposing forms
+// (5 to 8) swap width and height and are copied in 16 x 16 tiles so the
+// source rows of a tile stay in cache (8 x 8 SSE2 shuffles for 8-bit pixels).
+typedef enum {
+    ORIENT_NORMAL = 1,
+    ORIENT_FLIP_HORIZONTAL = 2,
+    ORIENT_ROTATE_180 = 3,
+    ORIENT_FLIP_VERTICAL = 4,
+    ORIENT_TRANSPOSE = 5,
+    ORIENT_ROTATE_90 = 6,       // clockwise
+    ORIENT_TRANSVERSE = 7,
+    ORIENT_ROTATE_270 = 8
+} t_orientation;
+
+// 1 when the output is height x width
+int orient_swapsAxes(t_orientation o);
+
+// Rows [first, first + count) of the transformed image, dst[i] receives row first + i.
+// src holds the height source rows of width pixels of pixelSize bytes.
+// With bottomUp the output rows are numbered from the bottom, like in a BMP file.
+void orient_copyRows(uint8_t *const *src, int width, int height, int pixelSize, t_orientation o,
+                     int bottomUp, int first, int count, uint8_t *const *dst);
+
+// In place (the pixel buffer is replaced), STATUS_NO_MEMORY with the image unchanged
+// when memory runs out
+t_status bmp8_orient(t_bmp8 *img, t_orientation o);
+t_status bmp24_orient(t_bmp24 *img, t_orientation o);
+// Clockwise, degrees is 90, 180 or 270 (STATUS_INVALID_ARGUMENT otherwise)
+t_status bmp8_rotate(t_bmp8 *img, int degrees);
+t_status bmp24_rotate(t_bmp24 *img, int degrees);
+
+// Save with the transform applied on the fly (the image itself is not changed)
+t_status bmp8_saveImageOriented(const char *filename, t_bmp8 *img, t_orientation o);
+t_status bmp24_saveImageOriented(t_bmp24 *img, const char *filename, t_orientation o);
+t_status bmp8_encodeOriented(t_bmp8 *img, t_buffer *out, t_orientation o);
+t_status bmp24_encodeOriented(t_bmp24 *img, t_buffer *out, t_orientation o);
+
+#endif // ORIENT_H
@@ -0,0 +1,200 @@
+#include "parallel.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define PARALLEL_MAX_THREADS 64
+
+// One parallel_for call: its chunks are taken one by one by the workers and the caller
+typedef struct t_job {
+    t_parallelTask task;
+    t_parallelCheckedTask checked;  // used instead of task when set
+    void *arg;
+    int count;
+    int chunks;
+    int next;               // first chunk nobody took yet
+    int done;
+    int failed;             // a checked chunk returned -1
+    struct t_job *queued;   // next job with chunks left
+} t_job;
+
+// Read once, whichever thread gets there first
+static int threadCount = 0;
+
+static void parallel_detectThreads(void) {
+    int n = 0;
+    const char *env = getenv("IMAGEPROC_THREADS");
+    if (env) n = atoi(env);
+    if (n <= 0) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        n = (int)info.dwNumberOfProcessors;
+#else
+        n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    }
+    if (n < 1) n = 1;
+    if (n > PARALLEL_MAX_THREADS) n = PARALLEL_MAX_THREADS;
+    threadCount = n;
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK parallel_detectOnce(PINIT_ONCE once, PVOID param, PVOID *context) {
+    (void)once;
+    (void)param;
+    (void)context;
+    parallel_detectThreads();
+    return TRUE;
+}
+#endif
+
+int parallel_threadCount(void) {
+#ifdef _WIN32
+    static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+    InitOnceExecuteOnce(&once, parallel_detectOnce, NULL, NULL);
+#else
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, parallel_detectThreads);
+#endif
+    return threadCount;
+}
+
+// ---- Worker pool ----
+// The workers are started with the first parallel_for and live as long as the
+// process, so a call only costs a wake-up. Calls from several threads share
+// them: jobs wait in a queue and a caller runs chunks itself while it waits,
+// its own first, which also makes a parallel_for inside a task safe.
+
+#ifdef _WIN32
+static SRWLOCK poolLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE workReady = CONDITION_VARIABLE_INIT;
+static CONDITION_VARIABLE chunkDone = CONDITION_VARIABLE_INIT;
+#define POOL_LOCK() AcquireSRWLockExclusive(&poolLock)
+#define POOL_UNLOCK() ReleaseSRWLockExclusive(&poolLock)
+#define POOL_WAIT(cond) SleepConditionVariableSRW(&(cond), &poolLock, INFINITE, 0)
+#define POOL_WAKE_ALL(cond) WakeAllConditionVariable(&(cond))
+#else
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t chunkDone = PTHREAD_COND_INITIALIZER;
+#define POOL_LOCK() pthread_mutex_lock(&poolLock)
+#define POOL_UNLOCK() pthread_mutex_unlock(&poolLock)
+#define POOL_WAIT(cond) pthread_cond_wait(&(cond), &poolLock)
+#define POOL_WAKE_ALL(cond) pthread_cond_broadcast(&(cond))
+#endif
+
+static t_job *queueHead = NULL;
+static t_job *queueTail = NULL;
+
+static void queueRemove(t_job *job) {
+    t_job **link = &queueHead;
+    t_job *previous = NULL;
+    while (*link && *link != job) {
+        previous = *link;
+        link = &(*link)->queued;
+    }
+    if (!*link) return;
+    *link = job->queued;
+    if (queueTail == job) queueTail = previous;
+}
+
+// Called with the lock held, the lock is released while the chunk runs
+static void runChunk(t_job *job) {
+    int c = job->next++;
+    if (job->next == job->chunks) queueRemove(job);
+    POOL_UNLOCK();
+    int begin = (int)((long long)job->count * c / job->chunks);
+    int end = (int)((long long)job->count * (c + 1) / job->chunks);
+    int failed = 0;
+    if (job->checked) failed = job->checked(begin, end, job->arg) != 0;
+    else job->task(begin, end, job->arg);
+    POOL_LOCK();
+    job->failed |= failed;
+    if (++job->done == job->chunks) POOL_WAKE_ALL(chunkDone);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI parallel_worker(LPVOID unused) {
+#else
+static void *parallel_worker(void *unused) {
+#endif
+    (void)unused;
+    POOL_LOCK();
+    for (;;) {
+        while (!queueHead) POOL_WAIT(workReady);
+        runChunk(queueHead);
+    }
+    POOL_UNLOCK();
+    return 0;
+}
+
+static void parallel_startWorkers(void) {
+    for (int t = 1; t < parallel_threadCount(); t++) {
+#ifdef _WIN32
+        HANDLE handle = CreateThread(NULL, 0, parallel_worker, NULL, 0, NULL);
+        if (handle) CloseHandle(handle);
+#else
+        pthread_t handle;
+        if (pthread_create(&handle, NULL, parallel_worker, NULL) == 0) pthread_detach(handle);
+#endif
+    }
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK parallel_startOnce(PINIT_ONCE once, PVOID param, PVOID *context) {
+    (void)once;
+    (void)param;
+    (void)context;
+    parallel_startWorkers();
+    return TRUE;
+}
+#endif
+
+static int parallel_run(int count, t_parallelTask task, t_parallelCheckedTask checked, void *arg) {
+    int threads = parallel_threadCount();
+    if (threads > count) threads = count;
+    if (threads <= 1) {
+        if (count <= 0) return 0;
+        if (checked) return checked(0, count, arg) != 0 ? -1 : 0;
+        task(0, count, arg);
+        return 0;
+    }
+
+#ifdef _WIN32
+    static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+    InitOnceExecuteOnce(&once, parallel_startOnce, NULL, NULL);
+#else
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, parallel_startWorkers);
+#endif
+
+    t_job job = {task, checked, arg, count, threads, 0, 0, 0, NULL};
+    POOL_LOCK();
+    if (queueTail) queueTail->queued = &job;
+    else queueHead = &job;
+    queueTail = &job;
+    POOL_WAKE_ALL(workReady);
+
+    // If no worker could be started the caller does everything
+    while (job.done < job.chunks) {
+        if (job.next < job.chunks) runChunk(&job);
+        else if (queueHead) runChunk(queueHead);
+        else POOL_WAIT(chunkDone);
+    }
+    POOL_UNLOCK();
+    return job.failed ? -1 : 0;
+}
+
+void parallel_for(int count, t_parallelTask task, void *arg) {
+    parallel_run(count, task, NULL, arg);
+}
+
+int parallel_forChecked(int count, t_parallelCheckedTask task, void *arg) {
+    return parallel_run(count, NULL, task, arg);
+}
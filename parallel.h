@@ -0,0 +1,18 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Work on the items [begin, end)
+typedef void (*t_parallelTask)(int begin, int end, void *arg);
+
+// Split [0, count) in contiguous chunks run on the worker threads, returns when all are done.
+// The number of threads is the number of CPUs, or IMAGEPROC_THREADS when it is set.
+// The workers are started by the first call and reused, several threads may call it at once.
+void parallel_for(int count, t_parallelTask task, void *arg);
+int parallel_threadCount(void);
+
+// Same for tasks that can fail (e.g. their scratch buffer cannot be allocated):
+// a task returns 0 or -1, the call returns -1 when any chunk did, once all are done
+typedef int (*t_parallelCheckedTask)(int begin, int end, void *arg);
+int parallel_forChecked(int count, t_parallelCheckedTask task, void *arg);
+
+#endif // PARALLEL_H
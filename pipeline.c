@@ -0,0 +1,596 @@
+#include "pipeline.h"
+#include "convolution.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A pass over the image costs about as much as this many kernel taps
+#define PASS_COST 16
+
+typedef enum {
+    STAGE_LUT,
+    STAGE_EQUALIZE,
+    STAGE_GRAYSCALE,
+    STAGE_CONVOLUTION
+} t_stageKind;
+
+// Optimized form of the pipeline
+typedef struct {
+    t_stageKind kind;
+    t_lut lut;
+    int kernelSize;
+    float *kernel;
+} t_stage;
+
+t_pipeline *pipeline_create(void) {
+    t_pipeline *p = malloc(sizeof(t_pipeline));
+    if (!p) return NULL;
+    p->ops = NULL;
+    p->count = 0;
+    p->capacity = 0;
+    p->composeBlurs = 0;
+    return p;
+}
+
+void pipeline_clear(t_pipeline *p) {
+    for (int i = 0; i < p->count; i++) {
+        free(p->ops[i].kernel);
+        free(p->ops[i].lut);
+    }
+    p->count = 0;
+    p->composeBlurs = 0;
+}
+
+void pipeline_free(t_pipeline *p) {
+    if (p) {
+        pipeline_clear(p);
+        free(p->ops);
+        free(p);
+    }
+}
+
+// Append an operation
+static int pipeline_push(t_pipeline *p, t_operation op) {
+    if (p->count == p->capacity) {
+        int capacity = p->capacity ? p->capacity * 2 : 8;
+        t_operation *ops = realloc(p->ops, capacity * sizeof(t_operation));
+        if (!ops) return -1;
+        p->ops = ops;
+        p->capacity = capacity;
+    }
+    p->ops[p->count++] = op;
+    return 0;
+}
+
+int pipeline_negative(t_pipeline *p) {
+    t_operation op = {OP_NEGATIVE, 0, 0, NULL, NULL};
+    return pipeline_push(p, op);
+}
+
+int pipeline_brightness(t_pipeline *p, int value) {
+    t_operation op = {OP_BRIGHTNESS, value, 0, NULL, NULL};
+    return pipeline_push(p, op);
+}
+
+int pipeline_threshold(t_pipeline *p, int threshold) {
+    t_operation op = {OP_THRESHOLD, threshold, 0, NULL, NULL};
+    return pipeline_push(p, op);
+}
+
+int pipeline_grayscale(t_pipeline *p) {
+    t_operation op = {OP_GRAYSCALE, 0, 0, NULL, NULL};
+    return pipeline_push(p, op);
+}
+
+int pipeline_equalize(t_pipeline *p) {
+    t_operation op = {OP_EQUALIZE, 0, 0, NULL, NULL};
+    return pipeline_push(p, op);
+}
+
+int pipeline_filter(t_pipeline *p, float **kernel, int kernelSize) {
+    t_operation op = {OP_CONVOLUTION, 0, kernelSize, malloc(kernelSize * kernelSize * sizeof(float)), NULL};
+    if (!op.kernel) return -1;
+    for (int y = 0; y < kernelSize; y++) {
+        memcpy(op.kernel + y * kernelSize, kernel[y], kernelSize * sizeof(float));
+    }
+    if (pipeline_push(p, op) != 0) {
+        free(op.kernel);
+        return -1;
+    }
+    return 0;
+}
+
+int pipeline_lut(t_pipeline *p, const t_lut *lut) {
+    t_operation op = {OP_LUT, 0, 0, NULL, malloc(sizeof(t_lut))};
+    if (!op.lut) return -1;
+    *op.lut = *lut;
+    if (pipeline_push(p, op) != 0) {
+        free(op.lut);
+        return -1;
+    }
+    return 0;
+}
+
+// ---- Text form ----
+
+// The 3x3 kernels of the menu
+typedef struct {
+    const char *name;
+    t_kernelPreset preset;
+} t_namedKernel;
+
+static const t_namedKernel namedKernels[] = {
+    {"box", PRESET_BOX},
+    {"gaussian", PRESET_GAUSSIAN},
+    {"sharpen", PRESET_SHARPEN},
+    {"outline", PRESET_OUTLINE},
+    {"emboss", PRESET_EMBOSS}
+};
+
+#define PIPELINE_MAX_KERNEL 255
+
+// Drop the operations recorded after the first count
+static void pipeline_truncate(t_pipeline *p, int count) {
+    for (int i = count; i < p->count; i++) {
+        free(p->ops[i].kernel);
+        free(p->ops[i].lut);
+    }
+    p->count = count;
+}
+
+static int isSeparator(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ';';
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// kernel=S:w,w,... from the text after '='
+static int parseKernel(t_pipeline *p, const char *text, const char *end) {
+    char *next;
+    long size = strtol(text, &next, 10);
+    if (next >= end || *next != ':' || size < 1 || size > PIPELINE_MAX_KERNEL || size % 2 == 0) return -1;
+    float *weights = malloc(size * size * sizeof(float));
+    float **rows = malloc(size * sizeof(float *));
+    int status = weights && rows ? 0 : -1;
+    for (long i = 0; status == 0 && i < size * size; i++) {
+        const char *start = next + 1;
+        weights[i] = strtof(start, &next);
+        if (next == start || next > end || (i + 1 < size * size ? *next != ',' : next != end)) status = -1;
+    }
+    if (status == 0) {
+        for (long y = 0; y < size; y++) rows[y] = weights + y * size;
+        status = pipeline_filter(p, rows, (int)size);
+    }
+    free(weights);
+    free(rows);
+    return status;
+}
+
+static int parseLut(t_pipeline *p, const char *text, const char *end) {
+    if (end - text != 2 * 3 * 256) return -1;
+    t_lut lut;
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 256; i++) {
+            int hi = hexDigit(text[0]), lo = hexDigit(text[1]);
+            if (hi < 0 || lo < 0) return -1;
+            lut.map[c][i] = (uint8_t)(hi * 16 + lo);
+            text += 2;
+        }
+    }
+    return pipeline_lut(p, &lut);
+}
+
+static int parseOperation(t_pipeline *p, const char *token, const char *end) {
+    const char *equal = memchr(token, '=', end - token);
+    size_t nameLength = (equal ? equal : end) - token;
+    const char *value = equal ? equal + 1 : NULL;
+#define IS(name) (nameLength == strlen(name) && strncmp(token, name, nameLength) == 0)
+
+    if (!value) {
+        if (IS("negative")) return pipeline_negative(p);
+        if (IS("grayscale")) return pipeline_grayscale(p);
+        if (IS("equalize")) return pipeline_equalize(p);
+        if (IS("compose")) {
+            p->composeBlurs = 1;
+            return 0;
+        }
+        for (size_t k = 0; k < sizeof(namedKernels) / sizeof(namedKernels[0]); k++) {
+            if (!IS(namedKernels[k].name)) continue;
+            float *rows[3];
+            const float *weights = convolution_preset(namedKernels[k].preset);
+            for (int y = 0; y < 3; y++) rows[y] = (float *)weights + 3 * y;
+            return pipeline_filter(p, rows, 3);
+        }
+        return -1;
+    }
+    if (IS("brightness") || IS("threshold")) {
+        char *next;
+        long v = strtol(value, &next, 10);
+        if (next != end || next == value || v < -65536 || v > 65536) return -1;
+        return IS("brightness") ? pipeline_brightness(p, (int)v) : pipeline_threshold(p, (int)v);
+    }
+    if (IS("kernel")) return parseKernel(p, value, end);
+    if (IS("lut")) return parseLut(p, value, end);
+#undef IS
+    return -1;
+}
+
+int pipeline_parse(t_pipeline *p, const char *text) {
+    int count = p->count;
+    int composeBlurs = p->composeBlurs;
+    while (*text) {
+        while (*text && isSeparator(*text)) text++;
+        if (!*text) break;
+        const char *end = text;
+        while (*end && !isSeparator(*end)) end++;
+        if (parseOperation(p, text, end) != 0) {
+            pipeline_truncate(p, count);
+            p->composeBlurs = composeBlurs;
+            return -1;
+        }
+        text = end;
+    }
+    return 0;
+}
+
+// snprintf at the end of out, counting what does not fit
+static void appendText(char *out, size_t size, size_t *length, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(*length < size ? out + *length : NULL, *length < size ? size - *length : 0, format, args);
+    va_end(args);
+    if (n > 0) *length += n;
+}
+
+size_t pipeline_describe(const t_pipeline *p, char *out, size_t size) {
+    size_t length = 0;
+    if (size > 0) out[0] = 0;
+    if (p->composeBlurs) appendText(out, size, &length, "compose");
+    for (int i = 0; i < p->count; i++) {
+        const t_operation *op = &p->ops[i];
+        const char *separator = i > 0 || p->composeBlurs ? " " : "";
+        switch (op->type) {
+            case OP_NEGATIVE: appendText(out, size, &length, "%snegative", separator); break;
+            case OP_BRIGHTNESS: appendText(out, size, &length, "%sbrightness=%d", separator, op->value); break;
+            case OP_THRESHOLD: appendText(out, size, &length, "%sthreshold=%d", separator, op->value); break;
+            case OP_GRAYSCALE: appendText(out, size, &length, "%sgrayscale", separator); break;
+            case OP_EQUALIZE: appendText(out, size, &length, "%sequalize", separator); break;
+            case OP_CONVOLUTION:
+                // %.9g keeps every bit of a float
+                appendText(out, size, &length, "%skernel=%d:", separator, op->kernelSize);
+                for (int k = 0; k < op->kernelSize * op->kernelSize; k++) {
+                    appendText(out, size, &length, k ? ",%.9g" : "%.9g", op->kernel[k]);
+                }
+                break;
+            case OP_LUT:
+                appendText(out, size, &length, "%slut=", separator);
+                for (int c = 0; c < 3; c++) {
+                    for (int v = 0; v < 256; v++) appendText(out, size, &length, "%02x", op->lut->map[c][v]);
+                }
+                break;
+        }
+    }
+    return length;
+}
+
+// ---- Compilation ----
+
+// Output of a blur never leaves [0, 255], so no clamping is lost by composing after it
+static int isRangePreserving(const float *k, int size) {
+    float sum = 0;
+    for (int i = 0; i < size * size; i++) {
+        if (k[i] < 0) return 0;
+        sum += k[i];
+    }
+    return sum <= 1.0001f;
+}
+
+static int isIdentityKernel(const float *k, int size) {
+    for (int i = 0; i < size * size; i++) {
+        if (k[i] != (i == size * size / 2 ? 1.0f : 0.0f)) return 0;
+    }
+    return 1;
+}
+
+static int isZeroKernel(const float *k, int size) {
+    for (int i = 0; i < size * size; i++) if (k[i] != 0) return 0;
+    return 1;
+}
+
+// Applying a then b is the same as applying the full convolution of the two kernels
+static float *composeKernels(const float *a, int sa, const float *b, int sb) {
+    int sc = sa + sb - 1;
+    float *c = calloc(sc * sc, sizeof(float));
+    if (!c) return NULL;
+    for (int ay = 0; ay < sa; ay++) {
+        for (int ax = 0; ax < sa; ax++) {
+            for (int by = 0; by < sb; by++) {
+                for (int bx = 0; bx < sb; bx++) {
+                    c[(ay + by) * sc + ax + bx] += a[ay * sa + ax] * b[by * sb + bx];
+                }
+            }
+        }
+    }
+    return c;
+}
+
+static void freeStages(t_stage *stages, int count) {
+    for (int i = 0; i < count; i++) free(stages[i].kernel);
+    free(stages);
+}
+
+// Turn the recorded operations into optimized stages, returns the stage count or -1
+static int pipeline_compile(const t_pipeline *p, int color, t_stage **out) {
+    t_stage *stages = malloc((p->count + 1) * sizeof(t_stage));
+    if (!stages) return -1;
+    int n = 0;
+
+    for (int i = 0; i < p->count; i++) {
+        const t_operation *op = &p->ops[i];
+        t_stage *last = n > 0 ? &stages[n - 1] : NULL;
+
+        switch (op->type) {
+            case OP_NEGATIVE:
+            case OP_BRIGHTNESS:
+            case OP_THRESHOLD:
+            case OP_LUT:
+                // Fold into the previous table when there is one
+                if (!last || last->kind != STAGE_LUT) {
+                    last = &stages[n++];
+                    last->kind = STAGE_LUT;
+                    last->kernel = NULL;
+                    lut_identity(&last->lut);
+                }
+                if (op->type == OP_NEGATIVE) lut_negative(&last->lut, LUT_RGB);
+                else if (op->type == OP_BRIGHTNESS) lut_brightness(&last->lut, LUT_RGB, op->value);
+                else if (op->type == OP_THRESHOLD) lut_threshold(&last->lut, LUT_RGB, op->value);
+                else lut_compose(&last->lut, &last->lut, op->lut);
+                break;
+
+            case OP_GRAYSCALE:
+                // Nothing to do on a grayscale image
+                if (!color) break;
+                stages[n].kind = STAGE_GRAYSCALE;
+                stages[n++].kernel = NULL;
+                break;
+
+            case OP_EQUALIZE:
+                stages[n].kind = STAGE_EQUALIZE;
+                stages[n++].kernel = NULL;
+                break;
+
+            case OP_CONVOLUTION: {
+                int size = op->kernelSize;
+                if (p->composeBlurs && last && last->kind == STAGE_CONVOLUTION &&
+                    isRangePreserving(last->kernel, last->kernelSize)) {
+                    int composed = last->kernelSize + size - 1;
+                    if (composed * composed <= last->kernelSize * last->kernelSize + size * size + PASS_COST) {
+                        float *k = composeKernels(last->kernel, last->kernelSize, op->kernel, size);
+                        if (!k) {
+                            freeStages(stages, n);
+                            return -1;
+                        }
+                        free(last->kernel);
+                        last->kernel = k;
+                        last->kernelSize = composed;
+                        break;
+                    }
+                }
+                t_stage *s = &stages[n];
+                s->kind = STAGE_CONVOLUTION;
+                s->kernelSize = size;
+                s->kernel = malloc(size * size * sizeof(float));
+                if (!s->kernel) {
+                    freeStages(stages, n);
+                    return -1;
+                }
+                memcpy(s->kernel, op->kernel, size * size * sizeof(float));
+                n++;
+                break;
+            }
+        }
+    }
+
+    // Drop identities, and everything before a stage whose output is constant
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        t_stage *s = &stages[i];
+        int identity = (s->kind == STAGE_LUT && lut_isIdentity(&s->lut)) ||
+                       (s->kind == STAGE_CONVOLUTION && isIdentityKernel(s->kernel, s->kernelSize));
+        int constant = (s->kind == STAGE_LUT && lut_isConstant(&s->lut)) ||
+                       (s->kind == STAGE_CONVOLUTION && isZeroKernel(s->kernel, s->kernelSize));
+        if (identity) {
+            free(s->kernel);
+            continue;
+        }
+        if (constant) {
+            for (int j = 0; j < kept; j++) free(stages[j].kernel);
+            kept = 0;
+        }
+        stages[kept++] = *s;
+    }
+
+    *out = stages;
+    return kept;
+}
+
+// ---- Execution ----
+
+static t_status applyStageFilter8(t_bmp8 *img, const t_stage *s) {
+    float **rows = malloc(s->kernelSize * sizeof(float *));
+    if (!rows) return STATUS_NO_MEMORY;
+    for (int y = 0; y < s->kernelSize; y++) rows[y] = s->kernel + y * s->kernelSize;
+    t_status status = bmp8_applyFilter(img, rows, s->kernelSize);
+    free(rows);
+    return status;
+}
+
+static t_status applyStageFilter24(t_bmp24 *img, const t_stage *s) {
+    float **rows = malloc(s->kernelSize * sizeof(float *));
+    if (!rows) return STATUS_NO_MEMORY;
+    for (int y = 0; y < s->kernelSize; y++) rows[y] = s->kernel + y * s->kernelSize;
+    t_status status = bmp24_applyFilter(img, rows, s->kernelSize);
+    free(rows);
+    return status;
+}
+
+// A run of tables and equalizations is resolved into one table:
+// the histogram of the input is pushed through the tables instead of recomputed
+static t_status applyPointRun8(t_bmp8 *img, const t_stage *stages, int count) {
+    t_lut lut;
+    unsigned int *hist = NULL;
+    lut_identity(&lut);
+
+    for (int i = 0; i < count; i++) {
+        if (stages[i].kind == STAGE_LUT) {
+            lut_compose(&lut, &lut, &stages[i].lut);
+            continue;
+        }
+        if (!hist) {
+            hist = bmp8_computeHistogram(img);
+            if (!hist) return STATUS_NO_MEMORY;
+        }
+        lut_equalize(&lut, LUT_RED, hist, img->width * img->height);
+    }
+    free(hist);
+
+    bmp8_applyLUT(img, &lut);
+    return STATUS_OK;
+}
+
+// Stops at the first stage that fails
+static t_status runStages8(t_bmp8 *img, const t_stage *stages, int n) {
+    t_status status = STATUS_OK;
+    for (int i = 0; i < n && status == STATUS_OK;) {
+        if (stages[i].kind == STAGE_CONVOLUTION) {
+            status = applyStageFilter8(img, &stages[i++]);
+            continue;
+        }
+        int j = i;
+        while (j < n && (stages[j].kind == STAGE_LUT || stages[j].kind == STAGE_EQUALIZE)) j++;
+        status = applyPointRun8(img, stages + i, j - i);
+        i = j;
+    }
+    return status;
+}
+
+static t_status runStages24(t_bmp24 *img, const t_stage *stages, int n) {
+    t_status status = STATUS_OK;
+    for (int i = 0; i < n && status == STATUS_OK; i++) {
+        const t_stage *s = &stages[i];
+        switch (s->kind) {
+            case STAGE_LUT: bmp24_applyLUT(img, &s->lut); break;
+            case STAGE_EQUALIZE: status = bmp24_equalize(img); break;
+            case STAGE_GRAYSCALE: bmp24_grayscale(img); break;
+            case STAGE_CONVOLUTION: status = applyStageFilter24(img, s); break;
+        }
+    }
+    return status;
+}
+
+t_status pipeline_materialize8(t_pipeline *p, t_bmp8 *img) {
+    t_stage *stages;
+    int n = pipeline_compile(p, 0, &stages);
+    t_status status = n < 0 ? STATUS_NO_MEMORY : runStages8(img, stages, n);
+    if (n >= 0) freeStages(stages, n);
+    pipeline_clear(p);
+    return status;
+}
+
+t_status pipeline_materialize24(t_pipeline *p, t_bmp24 *img) {
+    t_stage *stages;
+    int n = pipeline_compile(p, 1, &stages);
+    t_status status = n < 0 ? STATUS_NO_MEMORY : runStages24(img, stages, n);
+    if (n >= 0) freeStages(stages, n);
+    pipeline_clear(p);
+    return status;
+}
+
+// ---- Incremental update ----
+// A changed pixel moves the output up to the sum of the kernel radii away
+// (the halo), and that output reads up to the same distance further. Each
+// dirty rectangle grown twice by the halo is filtered as a small image and
+// the rectangle grown once is copied to dst. An equalization depends on the
+// whole histogram, the image is then recomputed entirely.
+
+// Halo of the stages, -1 when the output depends on every pixel
+static int stagesHalo(const t_stage *stages, int n) {
+    int halo = 0;
+    for (int i = 0; i < n; i++) {
+        if (stages[i].kind == STAGE_EQUALIZE) return -1;
+        if (stages[i].kind == STAGE_CONVOLUTION) halo += stages[i].kernelSize / 2;
+    }
+    return halo;
+}
+
+t_status pipeline_update8(const t_pipeline *p, const t_bmp8 *src, t_bmp8 *dst, const t_dirty *dirty) {
+    if (src->width != dst->width || src->height != dst->height) return STATUS_INVALID_ARGUMENT;
+    t_stage *stages;
+    int n = pipeline_compile(p, 0, &stages);
+    if (n < 0) return STATUS_NO_MEMORY;
+
+    t_status status = STATUS_OK;
+    int halo = stagesHalo(stages, n);
+    t_rect whole = {0, 0, (int)src->width, (int)src->height};
+    for (int i = 0; i < (halo < 0 ? 1 : dirty->count); i++) {
+        t_rect changed = halo < 0 ? whole : rect_clip(rect_grow(dirty->rects[i], halo), whole.width, whole.height);
+        if (rect_isEmpty(changed)) continue;
+        t_rect source = halo < 0 ? whole : rect_clip(rect_grow(changed, halo), whole.width, whole.height);
+        t_bmp8 *part = bmp8_crop(src, source);
+        if (!part) {
+            status = STATUS_NO_MEMORY;
+            continue;
+        }
+        t_status run = runStages8(part, stages, n);
+        if (run != STATUS_OK) {
+            status = run;
+            bmp8_free(part);
+            continue;
+        }
+        t_rect inner = {changed.x - source.x, changed.y - source.y, changed.width, changed.height};
+        bmp8_paste(dst, changed.x, changed.y, part, inner);
+        bmp8_free(part);
+    }
+
+    freeStages(stages, n);
+    return status;
+}
+
+t_status pipeline_update24(const t_pipeline *p, const t_bmp24 *src, t_bmp24 *dst, const t_dirty *dirty) {
+    if (src->width != dst->width || src->height != dst->height) return STATUS_INVALID_ARGUMENT;
+    t_stage *stages;
+    int n = pipeline_compile(p, 1, &stages);
+    if (n < 0) return STATUS_NO_MEMORY;
+
+    t_status status = STATUS_OK;
+    int halo = stagesHalo(stages, n);
+    t_rect whole = {0, 0, src->width, src->height};
+    for (int i = 0; i < (halo < 0 ? 1 : dirty->count); i++) {
+        t_rect changed = halo < 0 ? whole : rect_clip(rect_grow(dirty->rects[i], halo), whole.width, whole.height);
+        if (rect_isEmpty(changed)) continue;
+        t_rect source = halo < 0 ? whole : rect_clip(rect_grow(changed, halo), whole.width, whole.height);
+        t_bmp24 *part = bmp24_crop(src, source);
+        if (!part) {
+            status = STATUS_NO_MEMORY;
+            continue;
+        }
+        t_status run = runStages24(part, stages, n);
+        if (run != STATUS_OK) {
+            status = run;
+            bmp24_free(part);
+            continue;
+        }
+        t_rect inner = {changed.x - source.x, changed.y - source.y, changed.width, changed.height};
+        bmp24_paste(dst, changed.x, changed.y, part, inner);
+        bmp24_free(part);
+    }
+
+    freeStages(stages, n);
+    return status;
+}
@@ -0,0 +1,89 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <stddef.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "lut.h"
+#include "roi.h"
+
+// === Deferred filter pipeline ===
+// Filters are recorded instead of being executed. When the pipeline is
+// materialized on an image it is first optimized:
+//  - adjacent point operations (negative, brightness, threshold, tables,
+//    equalize) are collapsed into a single 256-entry table per channel,
+//  - identity stages and every stage before an operation whose result does
+//    not depend on its input (e.g. a constant table) are dropped.
+// These give the same pixels as running the filters one by one. On request
+// (composeBlurs), consecutive blurs (non-negative kernels) are also composed
+// into one kernel when one bigger pass is cheaper than two: the pixels are
+// then no longer rounded between the passes and may differ by a few levels,
+// more in the border band where the first pass read outside of the image.
+
+typedef enum {
+    OP_NEGATIVE,
+    OP_BRIGHTNESS,
+    OP_THRESHOLD,
+    OP_GRAYSCALE,
+    OP_EQUALIZE,
+    OP_CONVOLUTION,
+    OP_LUT
+} t_opType;
+
+typedef struct {
+    t_opType type;
+    int value;          // brightness / threshold
+    int kernelSize;     // convolution only
+    float *kernel;      // kernelSize * kernelSize weights, row by row
+    t_lut *lut;         // OP_LUT only
+} t_operation;
+
+typedef struct {
+    t_operation *ops;
+    int count;
+    int capacity;
+    int composeBlurs;   // 0 by default, reset by pipeline_clear
+} t_pipeline;
+
+t_pipeline *pipeline_create(void);
+void pipeline_free(t_pipeline *p);
+// Forget the recorded operations and composeBlurs (nothing is computed)
+void pipeline_clear(t_pipeline *p);
+
+// Recording, 0 on success, -1 on allocation failure
+int pipeline_negative(t_pipeline *p);
+int pipeline_brightness(t_pipeline *p, int value);
+int pipeline_threshold(t_pipeline *p, int threshold);
+int pipeline_grayscale(t_pipeline *p);
+int pipeline_equalize(t_pipeline *p);
+int pipeline_filter(t_pipeline *p, float **kernel, int kernelSize);
+// Any table built with lut.h (gamma, levels, curves...)
+int pipeline_lut(t_pipeline *p, const t_lut *lut);
+
+// Text form, operations separated by spaces or ';':
+//   negative  brightness=N  threshold=N  grayscale  equalize
+//   box  gaussian  sharpen  outline  emboss   (the 3x3 kernels of the menu)
+//   kernel=S:w,w,...                          (S * S weights, row by row, S odd)
+//   lut=<1536 hex digits>                     (red, green then blue maps)
+//   compose                                   (sets composeBlurs)
+// The operations are appended to p, 0 on success. On a syntax or allocation
+// error -1 is returned and p is left as it was.
+int pipeline_parse(t_pipeline *p, const char *text);
+// Canonical text of p, parsed back to the same operations. Returns the
+// length of the full text like snprintf, out may be NULL when size is 0
+size_t pipeline_describe(const t_pipeline *p, char *out, size_t size);
+
+// Optimize and run the recorded operations on img, then clear the pipeline.
+// On failure the image is left part-way through the operations
+t_status pipeline_materialize8(t_pipeline *p, t_bmp8 *img);
+t_status pipeline_materialize24(t_pipeline *p, t_bmp24 *img);
+
+// Incremental run for interactive edits: dst holds the result of p on src
+// before the pixels in dirty were changed. Only the dirty rectangles grown
+// by the reach of the kernels are recomputed (everything when p equalizes).
+// p is kept so it can be run again after the next edit. The pixels are those
+// of a full run, except for kernels big enough to go through the FFT whose
+// rounding may differ by one level
+t_status pipeline_update8(const t_pipeline *p, const t_bmp8 *src, t_bmp8 *dst, const t_dirty *dirty);
+t_status pipeline_update24(const t_pipeline *p, const t_bmp24 *src, t_bmp24 *dst, const t_dirty *dirty);
+
+#endif // PIPELINE_H
@@ -0,0 +1,594 @@
+#include "resample.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Rows of bytes, channels values per pixel (t_pixel is 3 packed bytes)
+typedef struct {
+    uint8_t **rows;
+    int width;
+    int height;
+    int channels;
+} t_view;
+
+static int view8(const t_bmp8 *img, t_view *v) {
+    int stride = ((img->width + 3) / 4) * 4;
+    v->rows = malloc(img->height * sizeof(uint8_t *));
+    if (!v->rows) return -1;
+    for (unsigned int y = 0; y < img->height; y++) v->rows[y] = img->data + (size_t)y * stride;
+    v->width = img->width;
+    v->height = img->height;
+    v->channels = 1;
+    return 0;
+}
+
+static int view24(const t_bmp24 *img, t_view *v) {
+    v->rows = malloc(img->height * sizeof(uint8_t *));
+    if (!v->rows) return -1;
+    for (int y = 0; y < img->height; y++) v->rows[y] = (uint8_t *)img->data[y];
+    v->width = img->width;
+    v->height = img->height;
+    v->channels = 3;
+    return 0;
+}
+
+// ---- Weight tables ----
+
+static float filter_radius(t_resampleFilter f) {
+    switch (f) {
+        case RESAMPLE_BOX: return 0.5f;
+        case RESAMPLE_BILINEAR: return 1.0f;
+        case RESAMPLE_BICUBIC: return 2.0f;
+        default: return 3.0f;
+    }
+}
+
+static double sinc(double x) {
+    if (x == 0) return 1;
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+static double filter_weight(t_resampleFilter f, double x) {
+    x = fabs(x);
+    switch (f) {
+        case RESAMPLE_BOX: return x <= 0.5 ? 1 : 0;
+        case RESAMPLE_BILINEAR: return x < 1 ? 1 - x : 0;
+        case RESAMPLE_BICUBIC:
+            // Catmull-Rom (a = -0.5)
+            if (x < 1) return (1.5 * x - 2.5) * x * x + 1;
+            if (x < 2) return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+            return 0;
+        default: return x < 3 ? sinc(x) * sinc(x / 3) : 0;
+    }
+}
+
+typedef struct {
+    int *start;
+    int *count;
+    float *weights;     // taps values per output position
+    int taps;
+} t_weights;
+
+static void weights_free(t_weights *w) {
+    free(w->start);
+    free(w->count);
+    free(w->weights);
+}
+
+static int weights_build(t_weights *w, int srcSize, int dstSize, t_resampleFilter f) {
+    double scale = (double)srcSize / dstSize;
+    double filterScale = scale > 1 ? scale : 1;
+    double support = filter_radius(f) * filterScale;
+    w->taps = (int)ceil(support) * 2 + 1;
+    w->start = malloc(dstSize * sizeof(int));
+    w->count = malloc(dstSize * sizeof(int));
+    w->weights = malloc((size_t)dstSize * w->taps * sizeof(float));
+    if (!w->start || !w->count || !w->weights) {
+        weights_free(w);
+        return -1;
+    }
+
+    for (int i = 0; i < dstSize; i++) {
+        double center = (i + 0.5) * scale;
+        int first = (int)(center - support + 0.5);
+        int last = (int)(center + support + 0.5);
+        if (first < 0) first = 0;
+        if (last > srcSize) last = srcSize;
+        if (last - first > w->taps) last = first + w->taps;
+
+        float *k = w->weights + (size_t)i * w->taps;
+        double sum = 0;
+        for (int j = first; j < last; j++) {
+            k[j - first] = (float)filter_weight(f, (j + 0.5 - center) / filterScale);
+            sum += k[j - first];
+        }
+        // Upscaling with the box filter can miss every tap: take the nearest pixel
+        if (sum == 0) {
+            first = (int)center < srcSize ? (int)center : srcSize - 1;
+            last = first + 1;
+            k[0] = 1;
+            sum = 1;
+        }
+        for (int j = 0; j < last - first; j++) k[j] = (float)(k[j] / sum);
+        w->start[i] = first;
+        w->count[i] = last - first;
+    }
+    return 0;
+}
+
+// ---- Two-pass resize ----
+
+typedef struct {
+    const t_view *src;
+    const t_view *dst;
+    const t_weights *wx;
+    const t_weights *wy;
+    float *tmp;         // src->height rows of dst->width * channels
+} t_resizeJob;
+
+static void resize_horizontal(int begin, int end, void *arg) {
+    const t_resizeJob *job = arg;
+    int ch = job->src->channels;
+    int rowLength = job->dst->width * ch;
+    for (int y = begin; y < end; y++) {
+        const uint8_t *in = job->src->rows[y];
+        float *out = job->tmp + (size_t)y * rowLength;
+        for (int x = 0; x < job->dst->width; x++) {
+            const float *k = job->wx->weights + (size_t)x * job->wx->taps;
+            const uint8_t *p = in + job->wx->start[x] * ch;
+            int n = job->wx->count[x];
+            for (int c = 0; c < ch; c++) {
+                float sum = 0;
+                for (int j = 0; j < n; j++) sum += p[j * ch + c] * k[j];
+                out[x * ch + c] = sum;
+            }
+        }
+    }
+}
+
+// Whole rows are accumulated so the inner loop is contiguous
+static void resize_vertical(int begin, int end, void *arg) {
+    const t_resizeJob *job = arg;
+    int rowLength = job->dst->width * job->dst->channels;
+    float *acc = malloc(rowLength * sizeof(float));
+    if (!acc) return;
+    for (int y = begin; y < end; y++) {
+        const float *k = job->wy->weights + (size_t)y * job->wy->taps;
+        int first = job->wy->start[y];
+        for (int i = 0; i < rowLength; i++) acc[i] = 0;
+        for (int j = 0; j < job->wy->count[y]; j++) {
+            const float *in = job->tmp + (size_t)(first + j) * rowLength;
+            float wj = k[j];
+            for (int i = 0; i < rowLength; i++) acc[i] += in[i] * wj;
+        }
+        uint8_t *out = job->dst->rows[y];
+        for (int i = 0; i < rowLength; i++) {
+            float v = roundf(acc[i]);
+            out[i] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+    free(acc);
+}
+
+static int resize_view(const t_view *src, const t_view *dst, t_resampleFilter filter) {
+    t_weights wx, wy;
+    if (weights_build(&wx, src->width, dst->width, filter) != 0) return -1;
+    if (weights_build(&wy, src->height, dst->height, filter) != 0) {
+        weights_free(&wx);
+        return -1;
+    }
+    t_resizeJob job = {src, dst, &wx, &wy, malloc((size_t)src->height * dst->width * dst->channels * sizeof(float))};
+    if (job.tmp) {
+        parallel_for(src->height, resize_horizontal, &job);
+        parallel_for(dst->height, resize_vertical, &job);
+    }
+    int status = job.tmp ? 0 : -1;
+    free(job.tmp);
+    weights_free(&wx);
+    weights_free(&wy);
+    return status;
+}
+
+t_bmp8 *bmp8_resize(const t_bmp8 *img, int width, int height, t_resampleFilter filter) {
+    t_bmp8 *out = bmp8_create(width, height);
+    if (!out) return NULL;
+    memcpy(out->colorTable, img->colorTable, 1024);
+    // Both views walk storage rows: the output keeps the row order of the input
+    out->topDown = img->topDown;
+    t_view src, dst;
+    int status = -1;
+    if (view8(img, &src) == 0) {
+        if (view8(out, &dst) == 0) {
+            status = resize_view(&src, &dst, filter);
+            free(dst.rows);
+        }
+        free(src.rows);
+    }
+    if (status != 0) {
+        bmp8_free(out);
+        return NULL;
+    }
+    return out;
+}
+
+t_bmp24 *bmp24_resize(const t_bmp24 *img, int width, int height, t_resampleFilter filter) {
+    t_bmp24 *out = bmp24_allocate(width, height, img->colorDepth);
+    if (!out) return NULL;
+    t_view src, dst;
+    int status = -1;
+    if (view24(img, &src) == 0) {
+        if (view24(out, &dst) == 0) {
+            status = resize_view(&src, &dst, filter);
+            free(dst.rows);
+        }
+        free(src.rows);
+    }
+    if (status != 0) {
+        bmp24_free(out);
+        return NULL;
+    }
+    return out;
+}
+
+// ---- Pyramids ----
+
+static int clampIndex(int i, int n) {
+    return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+typedef struct {
+    const t_view *src;
+    const t_view *dst;
+    int *tmp;           // src->height rows of dst->width * channels
+} t_reduceJob;
+
+// Binomial 1 4 6 4 1 on the even columns
+static void reduce_horizontal(int begin, int end, void *arg) {
+    const t_reduceJob *job = arg;
+    int ch = job->src->channels, w = job->src->width;
+    for (int y = begin; y < end; y++) {
+        const uint8_t *in = job->src->rows[y];
+        int *out = job->tmp + (size_t)y * job->dst->width * ch;
+        for (int x = 0; x < job->dst->width; x++) {
+            int c0 = clampIndex(2 * x - 2, w) * ch, c1 = clampIndex(2 * x - 1, w) * ch, c2 = 2 * x * ch;
+            int c3 = clampIndex(2 * x + 1, w) * ch, c4 = clampIndex(2 * x + 2, w) * ch;
+            for (int c = 0; c < ch; c++) {
+                out[x * ch + c] = in[c0 + c] + 4 * in[c1 + c] + 6 * in[c2 + c] + 4 * in[c3 + c] + in[c4 + c];
+            }
+        }
+    }
+}
+
+static void reduce_vertical(int begin, int end, void *arg) {
+    const t_reduceJob *job = arg;
+    int h = job->src->height;
+    int rowLength = job->dst->width * job->dst->channels;
+    for (int y = begin; y < end; y++) {
+        const int *r0 = job->tmp + (size_t)clampIndex(2 * y - 2, h) * rowLength;
+        const int *r1 = job->tmp + (size_t)clampIndex(2 * y - 1, h) * rowLength;
+        const int *r2 = job->tmp + (size_t)(2 * y) * rowLength;
+        const int *r3 = job->tmp + (size_t)clampIndex(2 * y + 1, h) * rowLength;
+        const int *r4 = job->tmp + (size_t)clampIndex(2 * y + 2, h) * rowLength;
+        uint8_t *out = job->dst->rows[y];
+        for (int i = 0; i < rowLength; i++) {
+            out[i] = (uint8_t)((r0[i] + 4 * r1[i] + 6 * r2[i] + 4 * r3[i] + r4[i] + 128) >> 8);
+        }
+    }
+}
+
+static int pyramid_reduce(const t_view *src, const t_view *dst) {
+    t_reduceJob job = {src, dst, malloc((size_t)src->height * dst->width * dst->channels * sizeof(int))};
+    if (!job.tmp) return -1;
+    parallel_for(src->height, reduce_horizontal, &job);
+    parallel_for(dst->height, reduce_vertical, &job);
+    free(job.tmp);
+    return 0;
+}
+
+// Expand a level to width x height (contiguous bytes): even positions take 1 6 1 / 8,
+// odd positions 4 4 / 8 of the coarse pixels
+static uint8_t *pyramid_expand(const t_view *src, int width, int height) {
+    int ch = src->channels;
+    int rowLength = width * ch;
+    int *tmp = malloc((size_t)src->height * rowLength * sizeof(int));
+    uint8_t *out = malloc((size_t)height * rowLength);
+    if (!tmp || !out) {
+        free(tmp);
+        free(out);
+        return NULL;
+    }
+
+    for (int y = 0; y < src->height; y++) {
+        const uint8_t *in = src->rows[y];
+        int *t = tmp + (size_t)y * rowLength;
+        for (int x = 0; x < width; x++) {
+            int i = x / 2;
+            for (int c = 0; c < ch; c++) {
+                if (x & 1) {
+                    t[x * ch + c] = 4 * in[i * ch + c] + 4 * in[clampIndex(i + 1, src->width) * ch + c];
+                } else {
+                    t[x * ch + c] = in[clampIndex(i - 1, src->width) * ch + c] + 6 * in[i * ch + c] +
+                                    in[clampIndex(i + 1, src->width) * ch + c];
+                }
+            }
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        int i = y / 2;
+        const int *a = tmp + (size_t)clampIndex(i - 1, src->height) * rowLength;
+        const int *b = tmp + (size_t)i * rowLength;
+        const int *c = tmp + (size_t)clampIndex(i + 1, src->height) * rowLength;
+        uint8_t *o = out + (size_t)y * rowLength;
+        for (int k = 0; k < rowLength; k++) {
+            int v = (y & 1) ? 4 * b[k] + 4 * c[k] : a[k] + 6 * b[k] + c[k];
+            o[k] = (uint8_t)((v + 32) >> 6);
+        }
+    }
+    free(tmp);
+    return out;
+}
+
+t_bmp8 **bmp8_gaussianPyramid(const t_bmp8 *img, int levels, int *count) {
+    if (levels < 1) return NULL;
+    t_bmp8 **out = calloc(levels, sizeof(t_bmp8 *));
+    if (!out) return NULL;
+
+    out[0] = bmp8_create(img->width, img->height);
+    if (!out[0]) {
+        free(out);
+        return NULL;
+    }
+    memcpy(out[0]->colorTable, img->colorTable, 1024);
+    int stride = ((img->width + 3) / 4) * 4;
+    if (img->topDown) {
+        // Level 0 is always bottom-up like the images built by bmp8_create
+        for (unsigned int y = 0; y < img->height; y++) {
+            memcpy(out[0]->data + (size_t)y * stride, img->data + (size_t)(img->height - 1 - y) * stride, stride);
+        }
+    } else {
+        memcpy(out[0]->data, img->data, out[0]->dataSize);
+    }
+
+    int n = 1;
+    while (n < levels && out[n - 1]->width > 1 && out[n - 1]->height > 1) {
+        t_bmp8 *prev = out[n - 1];
+        t_bmp8 *next = bmp8_create((prev->width + 1) / 2, (prev->height + 1) / 2);
+        t_view src, dst;
+        int status = -1;
+        if (next && view8(prev, &src) == 0) {
+            if (view8(next, &dst) == 0) {
+                status = pyramid_reduce(&src, &dst);
+                free(dst.rows);
+            }
+            free(src.rows);
+        }
+        if (status != 0) {
+            bmp8_free(next);
+            break;
+        }
+        memcpy(next->colorTable, img->colorTable, 1024);
+        out[n++] = next;
+    }
+    *count = n;
+    return out;
+}
+
+t_bmp24 **bmp24_gaussianPyramid(const t_bmp24 *img, int levels, int *count) {
+    if (levels < 1) return NULL;
+    t_bmp24 **out = calloc(levels, sizeof(t_bmp24 *));
+    if (!out) return NULL;
+
+    out[0] = bmp24_allocate(img->width, img->height, img->colorDepth);
+    if (!out[0]) {
+        free(out);
+        return NULL;
+    }
+    for (int y = 0; y < img->height; y++) memcpy(out[0]->data[y], img->data[y], img->width * sizeof(t_pixel));
+
+    int n = 1;
+    while (n < levels && out[n - 1]->width > 1 && out[n - 1]->height > 1) {
+        t_bmp24 *prev = out[n - 1];
+        t_bmp24 *next = bmp24_allocate((prev->width + 1) / 2, (prev->height + 1) / 2, img->colorDepth);
+        t_view src, dst;
+        int status = -1;
+        if (next && view24(prev, &src) == 0) {
+            if (view24(next, &dst) == 0) {
+                status = pyramid_reduce(&src, &dst);
+                free(dst.rows);
+            }
+            free(src.rows);
+        }
+        if (status != 0) {
+            bmp24_free(next);
+            break;
+        }
+        out[n++] = next;
+    }
+    *count = n;
+    return out;
+}
+
+void bmp8_freePyramid(t_bmp8 **levels, int count) {
+    if (!levels) return;
+    for (int i = 0; i < count; i++) bmp8_free(levels[i]);
+    free(levels);
+}
+
+void bmp24_freePyramid(t_bmp24 **levels, int count) {
+    if (!levels) return;
+    for (int i = 0; i < count; i++) bmp24_free(levels[i]);
+    free(levels);
+}
+
+t_bmp8 *bmp8_resizeFromPyramid(t_bmp8 **levels, int count, int width, int height, t_resampleFilter filter) {
+    int i = 0;
+    while (i + 1 < count && (int)levels[i + 1]->width >= width && (int)levels[i + 1]->height >= height) i++;
+    return bmp8_resize(levels[i], width, height, filter);
+}
+
+t_bmp24 *bmp24_resizeFromPyramid(t_bmp24 **levels, int count, int width, int height, t_resampleFilter filter) {
+    int i = 0;
+    while (i + 1 < count && levels[i + 1]->width >= width && levels[i + 1]->height >= height) i++;
+    return bmp24_resize(levels[i], width, height, filter);
+}
+
+// ---- Laplacian pyramid ----
+
+void laplacian_free(t_laplacianPyramid *pyramid) {
+    if (!pyramid) return;
+    for (int i = 0; i < pyramid->levels; i++) free(pyramid->band[i]);
+    free(pyramid->band);
+    free(pyramid->width);
+    free(pyramid->height);
+    free(pyramid);
+}
+
+static t_laplacianPyramid *laplacian_allocate(int levels, int channels) {
+    t_laplacianPyramid *p = malloc(sizeof(t_laplacianPyramid));
+    if (!p) return NULL;
+    p->levels = levels;
+    p->channels = channels;
+    p->width = calloc(levels, sizeof(int));
+    p->height = calloc(levels, sizeof(int));
+    p->band = calloc(levels, sizeof(int16_t *));
+    if (!p->width || !p->height || !p->band) {
+        p->levels = 0;
+        laplacian_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+// Fill the bands from the Gaussian levels given as views
+static int laplacian_build(t_laplacianPyramid *p, const t_view *views) {
+    for (int i = 0; i < p->levels; i++) {
+        int w = views[i].width, h = views[i].height, ch = p->channels;
+        p->width[i] = w;
+        p->height[i] = h;
+        p->band[i] = malloc((size_t)w * h * ch * sizeof(int16_t));
+        if (!p->band[i]) return -1;
+
+        uint8_t *up = NULL;
+        if (i + 1 < p->levels) {
+            up = pyramid_expand(&views[i + 1], w, h);
+            if (!up) return -1;
+        }
+        for (int y = 0; y < h; y++) {
+            const uint8_t *g = views[i].rows[y];
+            int16_t *b = p->band[i] + (size_t)y * w * ch;
+            const uint8_t *e = up ? up + (size_t)y * w * ch : NULL;
+            for (int k = 0; k < w * ch; k++) b[k] = (int16_t)(g[k] - (e ? e[k] : 0));
+        }
+        free(up);
+    }
+    return 0;
+}
+
+// Rebuild the finest level into dst, coarse to fine
+static int laplacian_collapse(const t_laplacianPyramid *p, const t_view *dst) {
+    int ch = p->channels;
+    int last = p->levels - 1;
+    uint8_t *level = malloc((size_t)p->width[last] * p->height[last] * ch);
+    if (!level) return -1;
+    for (int k = 0; k < p->width[last] * p->height[last] * ch; k++) level[k] = (uint8_t)p->band[last][k];
+
+    for (int i = last - 1; i >= 0; i--) {
+        t_view coarse = {malloc(p->height[i + 1] * sizeof(uint8_t *)), p->width[i + 1], p->height[i + 1], ch};
+        if (!coarse.rows) {
+            free(level);
+            return -1;
+        }
+        for (int y = 0; y < coarse.height; y++) coarse.rows[y] = level + (size_t)y * coarse.width * ch;
+        uint8_t *up = pyramid_expand(&coarse, p->width[i], p->height[i]);
+        free(coarse.rows);
+        free(level);
+        if (!up) return -1;
+        for (int k = 0; k < p->width[i] * p->height[i] * ch; k++) {
+            int v = up[k] + p->band[i][k];
+            up[k] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+        level = up;
+    }
+
+    for (int y = 0; y < dst->height; y++) memcpy(dst->rows[y], level + (size_t)y * dst->width * ch, dst->width * ch);
+    free(level);
+    return 0;
+}
+
+t_laplacianPyramid *bmp8_laplacianPyramid(const t_bmp8 *img, int levels) {
+    int count;
+    t_bmp8 **gauss = bmp8_gaussianPyramid(img, levels, &count);
+    if (!gauss) return NULL;
+    t_laplacianPyramid *p = laplacian_allocate(count, 1);
+    t_view *views = calloc(count, sizeof(t_view));
+    int status = p && views ? 0 : -1;
+    for (int i = 0; i < count && status == 0; i++) status = view8(gauss[i], &views[i]);
+    if (status == 0) status = laplacian_build(p, views);
+    for (int i = 0; views && i < count; i++) free(views[i].rows);
+    free(views);
+    bmp8_freePyramid(gauss, count);
+    if (status != 0) {
+        laplacian_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+t_laplacianPyramid *bmp24_laplacianPyramid(const t_bmp24 *img, int levels) {
+    int count;
+    t_bmp24 **gauss = bmp24_gaussianPyramid(img, levels, &count);
+    if (!gauss) return NULL;
+    t_laplacianPyramid *p = laplacian_allocate(count, 3);
+    t_view *views = calloc(count, sizeof(t_view));
+    int status = p && views ? 0 : -1;
+    for (int i = 0; i < count && status == 0; i++) status = view24(gauss[i], &views[i]);
+    if (status == 0) status = laplacian_build(p, views);
+    for (int i = 0; views && i < count; i++) free(views[i].rows);
+    free(views);
+    bmp24_freePyramid(gauss, count);
+    if (status != 0) {
+        laplacian_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+t_bmp8 *bmp8_collapsePyramid(const t_laplacianPyramid *pyramid) {
+    if (pyramid->channels != 1) return NULL;
+    t_bmp8 *out = bmp8_create(pyramid->width[0], pyramid->height[0]);
+    t_view dst;
+    if (!out || view8(out, &dst) != 0) {
+        bmp8_free(out);
+        return NULL;
+    }
+    int status = laplacian_collapse(pyramid, &dst);
+    free(dst.rows);
+    if (status != 0) {
+        bmp8_free(out);
+        return NULL;
+    }
+    return out;
+}
+
+t_bmp24 *bmp24_collapsePyramid(const t_laplacianPyramid *pyramid) {
+    if (pyramid->channels != 3) return NULL;
+    t_bmp24 *out = bmp24_allocate(pyramid->width[0], pyramid->height[0], 24);
+    t_view dst;
+    if (!out || view24(out, &dst) != 0) {
+        bmp24_free(out);
+        return NULL;
+    }
+    int status = laplacian_collapse(pyramid, &dst);
+    free(dst.rows);
+    if (status != 0) {
+        bmp24_free(out);
+        return NULL;
+    }
+    return out;
+}
@@ -0,0 +1,53 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// === Resize and image pyramids ===
+// Resizing is separable: a horizontal then a vertical pass, each one with a
+// table of weights computed once per output column / row. When shrinking,
+// the filter is widened by the scale factor so every source pixel counts.
+// Both passes are split over the worker threads.
+
+typedef enum {
+    RESAMPLE_BOX,       // area average
+    RESAMPLE_BILINEAR,
+    RESAMPLE_BICUBIC,   // Catmull-Rom
+    RESAMPLE_LANCZOS3
+} t_resampleFilter;
+
+// New image of the requested size (the source is left untouched)
+t_bmp8 *bmp8_resize(const t_bmp8 *img, int width, int height, t_resampleFilter filter);
+t_bmp24 *bmp24_resize(const t_bmp24 *img, int width, int height, t_resampleFilter filter);
+
+// Gaussian pyramid: level 0 is a copy of img, each level is blurred with the
+// 5-tap binomial kernel and halved. Returns levels images (fewer if the image
+// becomes 1 pixel wide), the count is written in *count.
+t_bmp8 **bmp8_gaussianPyramid(const t_bmp8 *img, int levels, int *count);
+t_bmp24 **bmp24_gaussianPyramid(const t_bmp24 *img, int levels, int *count);
+void bmp8_freePyramid(t_bmp8 **levels, int count);
+void bmp24_freePyramid(t_bmp24 **levels, int count);
+
+// Resize from the smallest pyramid level that is still at least as big as the target,
+// so thumbnails never go back to the full resolution image
+t_bmp8 *bmp8_resizeFromPyramid(t_bmp8 **levels, int count, int width, int height, t_resampleFilter filter);
+t_bmp24 *bmp24_resizeFromPyramid(t_bmp24 **levels, int count, int width, int height, t_resampleFilter filter);
+
+// Laplacian pyramid: band i = Gaussian level i - expand(level i + 1), the last
+// band is the coarsest Gaussian level. Collapsing gives back the exact image.
+typedef struct {
+    int levels;
+    int channels;       // 1 for t_bmp8, 3 for t_bmp24 (red, green, blue)
+    int *width;
+    int *height;
+    int16_t **band;     // width * height * channels values per level
+} t_laplacianPyramid;
+
+t_laplacianPyramid *bmp8_laplacianPyramid(const t_bmp8 *img, int levels);
+t_laplacianPyramid *bmp24_laplacianPyramid(const t_bmp24 *img, int levels);
+t_bmp8 *bmp8_collapsePyramid(const t_laplacianPyramid *pyramid);
+t_bmp24 *bmp24_collapsePyramid(const t_laplacianPyramid *pyramid);
+void laplacian_free(t_laplacianPyramid *pyramid);
+
+#endif // RESAMPLE_H
@@ -0,0 +1,200 @@
+#include "roi.h"
+#include "dispatch.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ---- Rectangles ----
+
+int rect_isEmpty(t_rect r) {
+    return r.width <= 0 || r.height <= 0;
+}
+
+t_rect rect_clip(t_rect r, int width, int height) {
+    int x1 = r.x + r.width, y1 = r.y + r.height;
+    if (r.x < 0) r.x = 0;
+    if (r.y < 0) r.y = 0;
+    if (x1 > width) x1 = width;
+    if (y1 > height) y1 = height;
+    r.width = x1 > r.x ? x1 - r.x : 0;
+    r.height = y1 > r.y ? y1 - r.y : 0;
+    return r;
+}
+
+t_rect rect_union(t_rect a, t_rect b) {
+    if (rect_isEmpty(a)) return b;
+    if (rect_isEmpty(b)) return a;
+    int x1 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    int y1 = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    t_rect u = {a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, 0, 0};
+    u.width = x1 - u.x;
+    u.height = y1 - u.y;
+    return u;
+}
+
+t_rect rect_grow(t_rect r, int margin) {
+    t_rect g = {r.x - margin, r.y - margin, r.width + 2 * margin, r.height + 2 * margin};
+    return g;
+}
+
+static long long rect_area(t_rect r) {
+    return rect_isEmpty(r) ? 0 : (long long)r.width * r.height;
+}
+
+// ---- Dirty rectangles ----
+
+void dirty_clear(t_dirty *d) {
+    d->count = 0;
+}
+
+static void dirty_remove(t_dirty *d, int i) {
+    d->rects[i] = d->rects[--d->count];
+}
+
+void dirty_add(t_dirty *d, t_rect r) {
+    if (rect_isEmpty(r)) return;
+
+    // Absorb every rectangle r touches, the union may touch new ones
+    for (int i = 0; i < d->count;) {
+        t_rect o = d->rects[i];
+        if (o.x <= r.x + r.width && r.x <= o.x + o.width && o.y <= r.y + r.height && r.y <= o.y + o.height) {
+            r = rect_union(r, o);
+            dirty_remove(d, i);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (d->count == DIRTY_MAX_RECTS) {
+        // Join r with the rectangle that adds the least area
+        int best = 0;
+        long long bestCost = -1;
+        for (int i = 0; i < d->count; i++) {
+            t_rect u = rect_union(r, d->rects[i]);
+            long long cost = rect_area(u) - rect_area(r) - rect_area(d->rects[i]);
+            if (bestCost < 0 || cost < bestCost) {
+                best = i;
+                bestCost = cost;
+            }
+        }
+        r = rect_union(r, d->rects[best]);
+        dirty_remove(d, best);
+        // The bigger rectangle may now touch others
+        dirty_add(d, r);
+        return;
+    }
+    d->rects[d->count++] = r;
+}
+
+// ---- Crop and paste ----
+
+// Storage row of image row y
+static unsigned char *bmp8_row(const t_bmp8 *img, int y) {
+    int stride = ((img->width + 3) / 4) * 4;
+    return img->data + (size_t)(img->topDown ? y : (int)img->height - 1 - y) * stride;
+}
+
+t_bmp8 *bmp8_crop(const t_bmp8 *img, t_rect r) {
+    r = rect_clip(r, img->width, img->height);
+    if (rect_isEmpty(r)) return NULL;
+    t_bmp8 *out = bmp8_create(r.width, r.height);
+    if (!out) return NULL;
+    out->topDown = img->topDown;
+    for (int y = 0; y < r.height; y++) memcpy(bmp8_row(out, y), bmp8_row(img, r.y + y) + r.x, r.width);
+    return out;
+}
+
+t_bmp24 *bmp24_crop(const t_bmp24 *img, t_rect r) {
+    r = rect_clip(r, img->width, img->height);
+    if (rect_isEmpty(r)) return NULL;
+    t_bmp24 *out = bmp24_allocate(r.width, r.height, img->colorDepth);
+    if (!out) return NULL;
+    for (int y = 0; y < r.height; y++) memcpy(out->data[y], img->data[r.y + y] + r.x, r.width * sizeof(t_pixel));
+    return out;
+}
+
+// Clip from to src, then the destination to dst, moving the other side along
+static int pasteArea(int dstWidth, int dstHeight, int *x, int *y, int srcWidth, int srcHeight, t_rect *from) {
+    t_rect f = rect_clip(*from, srcWidth, srcHeight);
+    *x += f.x - from->x;
+    *y += f.y - from->y;
+    t_rect d = rect_clip((t_rect){*x, *y, f.width, f.height}, dstWidth, dstHeight);
+    f.x += d.x - *x;
+    f.y += d.y - *y;
+    f.width = d.width;
+    f.height = d.height;
+    *x = d.x;
+    *y = d.y;
+    *from = f;
+    return !rect_isEmpty(f);
+}
+
+void bmp8_paste(t_bmp8 *dst, int x, int y, const t_bmp8 *src, t_rect from) {
+    if (!pasteArea(dst->width, dst->height, &x, &y, src->width, src->height, &from)) return;
+    for (int row = 0; row < from.height; row++) {
+        memcpy(bmp8_row(dst, y + row) + x, bmp8_row(src, from.y + row) + from.x, from.width);
+    }
+}
+
+void bmp24_paste(t_bmp24 *dst, int x, int y, const t_bmp24 *src, t_rect from) {
+    if (!pasteArea(dst->width, dst->height, &x, &y, src->width, src->height, &from)) return;
+    for (int row = 0; row < from.height; row++) {
+        memcpy(dst->data[y + row] + x, src->data[from.y + row] + from.x, from.width * sizeof(t_pixel));
+    }
+}
+
+// ---- Filters ----
+
+void bmp8_applyLUTRect(t_bmp8 *img, const t_lut *lut, t_rect r) {
+    r = rect_clip(r, img->width, img->height);
+    for (int y = r.y; y < r.y + r.height; y++) {
+        unsigned char *row = bmp8_row(img, y);
+        for (int x = r.x; x < r.x + r.width; x++) row[x] = lut->map[0][row[x]];
+    }
+}
+
+void bmp24_applyLUTRect(t_bmp24 *img, const t_lut *lut, t_rect r) {
+    r = rect_clip(r, img->width, img->height);
+    for (int y = r.y; y < r.y + r.height; y++) {
+        t_pixel *row = img->data[y];
+        for (int x = r.x; x < r.x + r.width; x++) {
+            row[x].red = lut->map[0][row[x].red];
+            row[x].green = lut->map[1][row[x].green];
+            row[x].blue = lut->map[2][row[x].blue];
+        }
+    }
+}
+
+void bmp24_grayscaleRect(t_bmp24 *img, t_rect r) {
+    r = rect_clip(r, img->width, img->height);
+    const t_kernels *kernels = dispatch_selected();
+    for (int y = r.y; y < r.y + r.height; y++) kernels->grayscale((uint8_t *)(img->data[y] + r.x), r.width);
+}
+
+// The rectangle and its halo are filtered as a small image (the borders of
+// the copy only spoil the halo), then the rectangle is written back
+t_status bmp8_applyFilterRect(t_bmp8 *img, float **kernel, int kernelSize, t_rect r) {
+    r = rect_clip(r, img->width, img->height);
+    if (rect_isEmpty(r)) return STATUS_OK;
+    t_rect source = rect_clip(rect_grow(r, kernelSize / 2), img->width, img->height);
+    t_bmp8 *part = bmp8_crop(img, source);
+    if (!part) return STATUS_NO_MEMORY;
+    t_status status = bmp8_applyFilter(part, kernel, kernelSize);
+    t_rect inner = {r.x - source.x, r.y - source.y, r.width, r.height};
+    if (status == STATUS_OK) bmp8_paste(img, r.x, r.y, part, inner);
+    bmp8_free(part);
+    return status;
+}
+
+t_status bmp24_applyFilterRect(t_bmp24 *img, float **kernel, int kernelSize, t_rect r) {
+    r = rect_clip(r, img->width, img->height);
+    if (rect_isEmpty(r)) return STATUS_OK;
+    t_rect source = rect_clip(rect_grow(r, kernelSize / 2), img->width, img->height);
+    t_bmp24 *part = bmp24_crop(img, source);
+    if (!part) return STATUS_NO_MEMORY;
+    t_status status = bmp24_applyFilter(part, kernel, kernelSize);
+    t_rect inner = {r.x - source.x, r.y - source.y, r.width, r.height};
+    if (status == STATUS_OK) bmp24_paste(img, r.x, r.y, part, inner);
+    bmp24_free(part);
+    return status;
+}
@@ -0,0 +1,55 @@
+#ifndef ROI_H
+#define ROI_H
+#include "bmp8.h"
+#include "bmp24.h"
+#include "lut.h"
+#include "status.h"
+
+// === Regions of interest and dirty rectangles ===
+// Rectangles are in image coordinates, top row first, whatever the row order
+// of the file. A filter restricted to a rectangle only writes inside it but
+// reads around it as the full-frame filter would, so the pixels it produces
+// are the same as those of the full-frame filter.
+
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} t_rect;
+
+int rect_isEmpty(t_rect r);
+t_rect rect_clip(t_rect r, int width, int height);
+// Smallest rectangle holding both (an empty one is ignored)
+t_rect rect_union(t_rect a, t_rect b);
+// margin pixels added on every side
+t_rect rect_grow(t_rect r, int margin);
+
+// Areas of an image changed since the last pipeline run. Overlapping or
+// touching rectangles are merged, past DIRTY_MAX_RECTS the two cheapest to
+// join are merged as well
+#define DIRTY_MAX_RECTS 16
+
+typedef struct {
+    t_rect rects[DIRTY_MAX_RECTS];
+    int count;
+} t_dirty;
+
+void dirty_clear(t_dirty *d);
+void dirty_add(t_dirty *d, t_rect r);
+
+// Copy of a rectangle (clipped), NULL when empty or on allocation failure
+t_bmp8 *bmp8_crop(const t_bmp8 *img, t_rect r);
+t_bmp24 *bmp24_crop(const t_bmp24 *img, t_rect r);
+// Rectangle from of src (clipped) written at (x, y) in dst, clipped to dst
+void bmp8_paste(t_bmp8 *dst, int x, int y, const t_bmp8 *src, t_rect from);
+void bmp24_paste(t_bmp24 *dst, int x, int y, const t_bmp24 *src, t_rect from);
+
+// Filters restricted to a rectangle
+void bmp8_applyLUTRect(t_bmp8 *img, const t_lut *lut, t_rect r);
+void bmp24_applyLUTRect(t_bmp24 *img, const t_lut *lut, t_rect r);
+void bmp24_grayscaleRect(t_bmp24 *img, t_rect r);
+t_status bmp8_applyFilterRect(t_bmp8 *img, float **kernel, int kernelSize, t_rect r);
+t_status bmp24_applyFilterRect(t_bmp24 *img, float **kernel, int kernelSize, t_rect r);
+
+#endif // ROI_H
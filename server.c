@@ -0,0 +1,298 @@
+#include "server.h"
+#include "bmpheader.h"
+#include "pipeline.h"
+#include "bmp1.h"
+#include "bmp32.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ---- Socket helpers ----
+
+static int readAll(int fd, void *data, size_t len) {
+    unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int writeAll(int fd, const void *data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int connectTo(const char *socketPath, int *fd) {
+    struct sockaddr_un address;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) return -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    *fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (*fd < 0) return -1;
+    if (connect(*fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(*fd);
+        return -1;
+    }
+    return 0;
+}
+
+// ---- Server ----
+
+// Sessions running, at most SERVER_MAX_SESSIONS
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ended;
+    int active;
+} t_sessions;
+
+// What a client thread keeps between its requests
+typedef struct {
+    int fd;
+    unsigned char *request;   // pipeline, path and image, each followed by a 0
+    size_t capacity;
+    t_buffer result;
+    t_pipeline *pipeline;
+    t_cache *cache;           // shared by every session, may be NULL
+    t_sessions *sessions;
+} t_session;
+
+// 4/8-bit files, or 1-bit masks as 0 / 255 grayscale
+static t_bmp8 *decode8(const unsigned char *image, size_t length, t_status *status) {
+    t_bmp8 *img = bmp8_decode(image, length, status);
+    if (img || *status != STATUS_UNSUPPORTED) return img;
+    t_bmp1 *mask = bmp1_decode(image, length, status);
+    if (!mask) return NULL;
+    img = bmp1_toBmp8(mask);
+    bmp1_free(mask);
+    if (!img) *status = STATUS_NO_MEMORY;
+    return img;
+}
+
+// 24-bit files, or 32-bit ones without their alpha
+static t_bmp24 *decode24(const unsigned char *image, size_t length, t_status *status) {
+    t_bmp24 *img = bmp24_decode(image, length, status);
+    if (img || *status != STATUS_UNSUPPORTED) return img;
+    t_bmp32 *wide = bmp32_decode(image, length, status);
+    if (!wide) return NULL;
+    img = bmp32_toBmp24(wide);
+    bmp32_free(wide);
+    if (!img) *status = STATUS_NO_MEMORY;
+    return img;
+}
+
+static t_status processRequest(t_session *s, const char *text, const char *path,
+                               const unsigned char *image, size_t length) {
+    t_status status = STATUS_OK;
+    unsigned char *file = NULL;
+    if (*path) {
+        file = bmp_readFile(path, &length, &status);
+        if (!file) return status;
+        image = file;
+    }
+
+    if (pipeline_parse(s->pipeline, text) != 0) {
+        status = STATUS_INVALID_ARGUMENT;
+    } else {
+        t_bmp8 *img8 = decode8(image, length, &status);
+        if (img8) {
+            if (s->cache) status = cache_materialize8(s->cache, s->pipeline, img8, NULL);
+            else status = pipeline_materialize8(s->pipeline, img8);
+            if (status == STATUS_OK) status = bmp8_encode(img8, &s->result);
+            bmp8_free(img8);
+        } else if (status == STATUS_UNSUPPORTED) {
+            t_bmp24 *img24 = decode24(image, length, &status);
+            if (img24) {
+                if (s->cache) status = cache_materialize24(s->cache, s->pipeline, img24, NULL);
+                else status = pipeline_materialize24(s->pipeline, img24);
+                if (status == STATUS_OK) status = bmp24_encode(img24, &s->result);
+                bmp24_free(img24);
+            }
+        }
+    }
+    pipeline_clear(s->pipeline);
+    free(file);
+    return status;
+}
+
+static int sendResponse(int fd, t_status status, const t_buffer *result) {
+    uint32_t head[2] = {(uint32_t)status, status == STATUS_OK ? (uint32_t)result->size : 0};
+    if (writeAll(fd, head, sizeof(head)) != 0) return -1;
+    return status == STATUS_OK ? writeAll(fd, result->data, result->size) : 0;
+}
+
+// Requests of one client until it disconnects
+static void serveSession(t_session *s) {
+    for (;;) {
+        uint32_t head[4];
+        if (readAll(s->fd, head, sizeof(head)) != 0) return;
+        if (head[0] != SERVER_MAGIC || head[1] > SERVER_MAX_PIPELINE || head[2] > SERVER_MAX_PATH ||
+            head[3] > SERVER_MAX_IMAGE || (head[2] == 0) == (head[3] == 0)) {
+            sendResponse(s->fd, STATUS_INVALID_ARGUMENT, &s->result);
+            return;
+        }
+
+        size_t needed = (size_t)head[1] + head[2] + head[3] + 3;
+        if (needed > s->capacity) {
+            unsigned char *grown = realloc(s->request, needed);
+            if (!grown) {
+                sendResponse(s->fd, STATUS_NO_MEMORY, &s->result);
+                return;
+            }
+            s->request = grown;
+            s->capacity = needed;
+        }
+        char *text = (char *)s->request;
+        char *path = text + head[1] + 1;
+        unsigned char *image = (unsigned char *)path + head[2] + 1;
+        if (readAll(s->fd, text, head[1]) != 0 || readAll(s->fd, path, head[2]) != 0 ||
+            readAll(s->fd, image, head[3]) != 0) return;
+        text[head[1]] = 0;
+        path[head[2]] = 0;
+
+        t_status status = processRequest(s, text, path, image, head[3]);
+        if (sendResponse(s->fd, status, &s->result) != 0) return;
+    }
+}
+
+static void endSession(t_sessions *sessions) {
+    pthread_mutex_lock(&sessions->lock);
+    sessions->active--;
+    pthread_cond_signal(&sessions->ended);
+    pthread_mutex_unlock(&sessions->lock);
+}
+
+static void *clientThread(void *arg) {
+    t_session *s = arg;
+    t_sessions *sessions = s->sessions;
+    s->request = NULL;
+    s->capacity = 0;
+    buffer_init(&s->result);
+    s->pipeline = pipeline_create();
+    if (s->pipeline) serveSession(s);
+    close(s->fd);
+    pipeline_free(s->pipeline);
+    buffer_free(&s->result);
+    free(s->request);
+    free(s);
+    endSession(sessions);
+    return NULL;
+}
+
+// Blocks while limit sessions are running, then counts a new one
+static void startSession(t_sessions *sessions, int limit) {
+    pthread_mutex_lock(&sessions->lock);
+    while (sessions->active >= limit) pthread_cond_wait(&sessions->ended, &sessions->lock);
+    sessions->active++;
+    pthread_mutex_unlock(&sessions->lock);
+}
+
+int server_run(const char *socketPath, t_cache *cache) {
+    struct sockaddr_un address;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) return -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    // A client that leaves early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) return -1;
+    unlink(socketPath);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        close(listener);
+        return -1;
+    }
+
+    t_sessions sessions = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0};
+    for (;;) {
+        // Past the limit, new clients wait in the listen queue until a session ends
+        startSession(&sessions, SERVER_MAX_SESSIONS);
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            endSession(&sessions);
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        t_session *s = malloc(sizeof(t_session));
+        pthread_t thread;
+        if (!s) {
+            close(fd);
+            endSession(&sessions);
+            continue;
+        }
+        s->fd = fd;
+        s->cache = cache;
+        s->sessions = &sessions;
+        if (pthread_create(&thread, NULL, clientThread, s) != 0) {
+            close(fd);
+            free(s);
+            endSession(&sessions);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    // Waits for the sessions still running, they point to the counter
+    close(listener);
+    startSession(&sessions, 1);
+    return -1;
+}
+
+// ---- Client ----
+
+t_status server_request(const char *socketPath, const char *pipeline, const char *path,
+                        const void *image, size_t imageLength, t_buffer *out) {
+    if (!pipeline) pipeline = "";
+    if (!path) path = "";
+    size_t pipelineLength = strlen(pipeline), pathLength = strlen(path);
+    if (pipelineLength > SERVER_MAX_PIPELINE || pathLength > SERVER_MAX_PATH ||
+        imageLength > SERVER_MAX_IMAGE || (pathLength == 0) == (imageLength == 0)) {
+        return STATUS_INVALID_ARGUMENT;
+    }
+
+    int fd;
+    if (connectTo(socketPath, &fd) != 0) return STATUS_OPEN_FAILED;
+    uint32_t head[4] = {SERVER_MAGIC, (uint32_t)pipelineLength, (uint32_t)pathLength, (uint32_t)imageLength};
+    t_status status = STATUS_OK;
+    if (writeAll(fd, head, sizeof(head)) != 0 || writeAll(fd, pipeline, pipelineLength) != 0 ||
+        writeAll(fd, path, pathLength) != 0 || writeAll(fd, image, imageLength) != 0) {
+        status = STATUS_WRITE_FAILED;
+    }
+
+    uint32_t answer[2];
+    if (status == STATUS_OK && readAll(fd, answer, sizeof(answer)) != 0) status = STATUS_READ_FAILED;
+    if (status == STATUS_OK) status = (t_status)answer[0];
+    out->size = 0;
+    unsigned char chunk[65536];
+    for (size_t left = status == STATUS_OK ? answer[1] : 0; left > 0 && status == STATUS_OK;) {
+        size_t n = left < sizeof(chunk) ? left : sizeof(chunk);
+        if (readAll(fd, chunk, n) != 0) status = STATUS_READ_FAILED;
+        else status = buffer_append(out, chunk, n);
+        left -= n;
+    }
+    close(fd);
+    return status;
+}
+
+#endif
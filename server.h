@@ -0,0 +1,44 @@
+#ifndef SERVER_H
+#define SERVER_H
+#include <stddef.h>
+#include <stdint.h>
+#include "buffer.h"
+#include "status.h"
+#include "cache.h"
+
+// === Image-processing daemon on a Unix domain socket ===
+// A connection carries any number of requests, one after the other:
+//   request:  uint32 magic, pipeline length, path length, image length,
+//             then the pipeline text (pipeline.h), the path of a BMP file the
+//             server can read, and the BMP file itself (path or image is empty)
+//   response: uint32 status (t_status), length, then the processed BMP file
+// Integers are in the byte order of the machine, both ends run on it.
+// 4/8-bit images and 1-bit masks come back as 8-bit images, 24-bit and
+// 32-bit ones as 24-bit images (the alpha channel is dropped).
+// Every client gets its own thread whose buffers and pipeline are reused from
+// one request to the next; the filters share the worker pool of parallel.h.
+// At most SERVER_MAX_SESSIONS clients are served at once, the next ones wait
+// in the listen queue until a connection closes.
+
+#define SERVER_MAGIC 0x50474D49u   // "IMGP"
+
+// Bigger requests are refused and the connection is closed
+#define SERVER_MAX_PIPELINE (1u << 20)
+#define SERVER_MAX_PATH     4096u
+#define SERVER_MAX_IMAGE    (1u << 30)
+
+#define SERVER_MAX_SESSIONS 64
+
+#ifndef _WIN32
+// Serves until the process is stopped, -1 if the socket cannot be set up.
+// A stale socket file at socketPath is replaced. With a cache, a pipeline
+// already applied to the same pixels is answered without being computed.
+int server_run(const char *socketPath, t_cache *cache);
+
+// Sends one request on a new connection, the processed image goes to out.
+// Returns the status of the server, or of the connection when it fails
+t_status server_request(const char *socketPath, const char *pipeline, const char *path,
+                        const void *image, size_t imageLength, t_buffer *out);
+#endif
+
+#endif // SERVER_H
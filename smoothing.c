@@ -0,0 +1,338 @@
+#include "smoothing.h"
+#include "integral.h"
+#include "parallel.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Empty cells around the grid so the blur needs no bounds checks
+#define GRID_PAD 2
+// Floats per column strip of the box filter
+#define STRIP 256
+
+// Rows of bytes, channels values per pixel
+typedef struct {
+    uint8_t **rows;
+    int width;
+    int height;
+    int channels;
+} t_view;
+
+static int view8(const t_bmp8 *img, t_view *v) {
+    // Top row first, like the summed-area tables
+    int stride = ((img->width + 3) / 4) * 4;
+    v->rows = malloc(img->height * sizeof(uint8_t *));
+    if (!v->rows) return -1;
+    for (unsigned int y = 0; y < img->height; y++) {
+        v->rows[y] = img->data + (size_t)(img->topDown ? y : img->height - 1 - y) * stride;
+    }
+    v->width = img->width;
+    v->height = img->height;
+    v->channels = 1;
+    return 0;
+}
+
+static int view24(const t_bmp24 *img, t_view *v) {
+    v->rows = malloc(img->height * sizeof(uint8_t *));
+    if (!v->rows) return -1;
+    for (int y = 0; y < img->height; y++) v->rows[y] = (uint8_t *)img->data[y];
+    v->width = img->width;
+    v->height = img->height;
+    v->channels = 3;
+    return 0;
+}
+
+static uint8_t clampByte(float v) {
+    v = roundf(v);
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// ---- Bilateral grid ----
+
+// Cells are [gy][gx][gz] with values channels sums then the weight
+typedef struct {
+    const t_view *view;
+    float spatial;
+    float range;
+    int gw;
+    int gh;
+    int gd;
+    int values;         // channels + 1
+    float *cells;
+} t_grid;
+
+static float *gridCell(const t_grid *g, int gx, int gy, int gz) {
+    return g->cells + (((size_t)gy * g->gw + gx) * g->gd + gz) * g->values;
+}
+
+// Range coordinate of a pixel: its value, or the gray level of a color pixel
+static int rangeValue(const uint8_t *p, int channels) {
+    return channels == 1 ? p[0] : (p[0] + p[1] + p[2]) / 3;
+}
+
+static int gridRow(const t_grid *g, int y) {
+    return (int)(y / g->spatial + 0.5f) + GRID_PAD;
+}
+
+// Nearest cell; the image rows of a grid row are contiguous, so grid rows split the work
+static void splatRows(int begin, int end, void *arg) {
+    const t_grid *g = arg;
+    const t_view *v = g->view;
+    int y = (int)((begin - GRID_PAD - 1) * g->spatial);
+    if (y < 0) y = 0;
+    while (y < v->height && gridRow(g, y) < begin) y++;
+    for (; y < v->height && gridRow(g, y) < end; y++) {
+        int gy = gridRow(g, y);
+        const uint8_t *row = v->rows[y];
+        for (int x = 0; x < v->width; x++) {
+            const uint8_t *p = row + x * v->channels;
+            int gx = (int)(x / g->spatial + 0.5f) + GRID_PAD;
+            int gz = (int)(rangeValue(p, v->channels) / g->range + 0.5f) + GRID_PAD;
+            float *cell = gridCell(g, gx, gy, gz);
+            for (int c = 0; c < v->channels; c++) cell[c] += p[c];
+            cell[v->channels] += 1;
+        }
+    }
+}
+
+// 1 4 6 4 1 / 16 (a Gaussian of one cell) along a line of n cells, stride floats apart
+static void blurLine(float *line, int n, size_t stride, int values, float *tmp) {
+    for (int i = 0; i < n; i++) memcpy(tmp + (size_t)i * values, line + i * stride, values * sizeof(float));
+    for (int i = GRID_PAD; i < n - GRID_PAD; i++) {
+        float *out = line + i * stride;
+        const float *a = tmp + (size_t)(i - 2) * values, *b = a + values, *c = b + values, *d = c + values, *e = d + values;
+        for (int k = 0; k < values; k++) out[k] = (a[k] + 4 * b[k] + 6 * c[k] + 4 * d[k] + e[k]) / 16;
+    }
+}
+
+// The padding cells stay at 0: only the inner cells are rewritten, which is
+// enough because the content of the grid sits two cells away from its border
+static int blurRangeAndX(int begin, int end, void *arg) {
+    const t_grid *g = arg;
+    int longest = g->gw > g->gd ? g->gw : g->gd;
+    float *tmp = malloc((size_t)longest * g->values * sizeof(float));
+    if (!tmp) return -1;
+    for (int gy = begin; gy < end; gy++) {
+        for (int gx = 0; gx < g->gw; gx++) blurLine(gridCell(g, gx, gy, 0), g->gd, g->values, g->values, tmp);
+        for (int gz = 0; gz < g->gd; gz++) {
+            blurLine(gridCell(g, 0, gy, gz), g->gw, (size_t)g->gd * g->values, g->values, tmp);
+        }
+    }
+    free(tmp);
+    return 0;
+}
+
+static int blurY(int begin, int end, void *arg) {
+    const t_grid *g = arg;
+    float *tmp = malloc((size_t)g->gh * g->values * sizeof(float));
+    if (!tmp) return -1;
+    for (int gx = begin; gx < end; gx++) {
+        for (int gz = 0; gz < g->gd; gz++) {
+            blurLine(gridCell(g, gx, 0, gz), g->gh, (size_t)g->gw * g->gd * g->values, g->values, tmp);
+        }
+    }
+    free(tmp);
+    return 0;
+}
+
+// Trilinear interpolation of the blurred grid, normalized by the weight
+static void sliceRows(int begin, int end, void *arg) {
+    const t_grid *g = arg;
+    const t_view *v = g->view;
+    int ch = v->channels;
+    for (int y = begin; y < end; y++) {
+        float fy = y / g->spatial + GRID_PAD;
+        int iy = (int)fy;
+        float wy = fy - iy;
+        uint8_t *row = v->rows[y];
+        for (int x = 0; x < v->width; x++) {
+            uint8_t *p = row + x * ch;
+            float fx = x / g->spatial + GRID_PAD, fz = rangeValue(p, ch) / g->range + GRID_PAD;
+            int ix = (int)fx, iz = (int)fz;
+            float wx = fx - ix, wz = fz - iz;
+            float acc[4] = {0, 0, 0, 0};
+            for (int corner = 0; corner < 8; corner++) {
+                int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+                float w = (dx ? wx : 1 - wx) * (dy ? wy : 1 - wy) * (dz ? wz : 1 - wz);
+                const float *cell = gridCell(g, ix + dx, iy + dy, iz + dz);
+                for (int k = 0; k <= ch; k++) acc[k] += w * cell[k];
+            }
+            if (acc[ch] <= 0) continue;
+            for (int c = 0; c < ch; c++) p[c] = clampByte(acc[c] / acc[ch]);
+        }
+    }
+}
+
+static t_status bilateral(const t_view *v, float sigmaSpatial, float sigmaRange) {
+    if (sigmaSpatial <= 0 || sigmaRange <= 0) return STATUS_INVALID_ARGUMENT;
+    t_grid g;
+    g.view = v;
+    g.spatial = sigmaSpatial;
+    g.range = sigmaRange;
+    // The slice reads one cell past the last sample
+    g.gw = (int)((v->width - 1) / sigmaSpatial) + 2 + 2 * GRID_PAD;
+    g.gh = (int)((v->height - 1) / sigmaSpatial) + 2 + 2 * GRID_PAD;
+    g.gd = (int)(255 / sigmaRange) + 2 + 2 * GRID_PAD;
+    g.values = v->channels + 1;
+    g.cells = calloc((size_t)g.gw * g.gh * g.gd * g.values, sizeof(float));
+    if (!g.cells) return STATUS_NO_MEMORY;
+
+    // The image is only written by the slice, after both blurs succeeded
+    parallel_for(g.gh, splatRows, &g);
+    t_status status = STATUS_NO_MEMORY;
+    if (parallel_forChecked(g.gh, blurRangeAndX, &g) == 0 && parallel_forChecked(g.gw, blurY, &g) == 0) {
+        parallel_for(v->height, sliceRows, &g);
+        status = STATUS_OK;
+    }
+    free(g.cells);
+    return status;
+}
+
+t_status bmp8_bilateral(t_bmp8 *img, float sigmaSpatial, float sigmaRange) {
+    t_view v;
+    if (view8(img, &v) != 0) return STATUS_NO_MEMORY;
+    t_status status = bilateral(&v, sigmaSpatial, sigmaRange);
+    free(v.rows);
+    return status;
+}
+
+t_status bmp24_bilateral(t_bmp24 *img, float sigmaSpatial, float sigmaRange) {
+    t_view v;
+    if (view24(img, &v) != 0) return STATUS_NO_MEMORY;
+    t_status status = bilateral(&v, sigmaSpatial, sigmaRange);
+    free(v.rows);
+    return status;
+}
+
+// ---- Guided filter ----
+
+typedef struct {
+    const t_view *view;
+    const t_integral *in;
+    int radius;
+    float epsilon2;
+    float *a;           // width * height * channels, then their window means
+    float *b;
+} t_guidedJob;
+
+// Per window: a = var / (var + eps^2), b = mean * (1 - a)
+static void coefficientRows(int begin, int end, void *arg) {
+    const t_guidedJob *job = arg;
+    int w = job->view->width, ch = job->view->channels, r = job->radius;
+    for (int y = begin; y < end; y++) {
+        float *a = job->a + (size_t)y * w * ch, *b = job->b + (size_t)y * w * ch;
+        for (int x = 0; x < w; x++) {
+            for (int c = 0; c < ch; c++) {
+                double mean = integral_mean(job->in, x - r, y - r, x + r + 1, y + r + 1, c);
+                double variance = integral_variance(job->in, x - r, y - r, x + r + 1, y + r + 1, c);
+                float k = (float)(variance / (variance + job->epsilon2));
+                a[x * ch + c] = k;
+                b[x * ch + c] = (float)(mean * (1 - k));
+            }
+        }
+    }
+}
+
+// Window means of a and b along the rows, then down strips of columns,
+// with prefix sums and windows clipped to the image
+static int boxRows(int begin, int end, void *arg) {
+    const t_guidedJob *job = arg;
+    int w = job->view->width, ch = job->view->channels, r = job->radius;
+    double *prefix = malloc((size_t)(w + 1) * ch * sizeof(double));
+    if (!prefix) return -1;
+    for (int y = begin; y < end; y++) {
+        float *planes[2] = {job->a + (size_t)y * w * ch, job->b + (size_t)y * w * ch};
+        for (int p = 0; p < 2; p++) {
+            float *line = planes[p];
+            for (int c = 0; c < ch; c++) prefix[c] = 0;
+            for (int i = 0; i < w * ch; i++) prefix[i + ch] = prefix[i] + line[i];
+            for (int x = 0; x < w; x++) {
+                int x0 = x - r < 0 ? 0 : x - r, x1 = x + r + 1 > w ? w : x + r + 1;
+                for (int c = 0; c < ch; c++) {
+                    line[x * ch + c] = (float)((prefix[x1 * ch + c] - prefix[x0 * ch + c]) / (x1 - x0));
+                }
+            }
+        }
+    }
+    free(prefix);
+    return 0;
+}
+
+static int boxColumns(int begin, int end, void *arg) {
+    const t_guidedJob *job = arg;
+    int h = job->view->height, r = job->radius;
+    size_t rowLength = (size_t)job->view->width * job->view->channels;
+    double *prefix = malloc((size_t)(h + 1) * STRIP * sizeof(double));
+    if (!prefix) return -1;
+    for (int s = begin; s < end; s++) {
+        size_t first = (size_t)s * STRIP;
+        int lanes = rowLength - first < STRIP ? (int)(rowLength - first) : STRIP;
+        float *planes[2] = {job->a + first, job->b + first};
+        for (int p = 0; p < 2; p++) {
+            for (int i = 0; i < lanes; i++) prefix[i] = 0;
+            for (int y = 0; y < h; y++) {
+                const float *line = planes[p] + y * rowLength;
+                double *above = prefix + (size_t)y * lanes, *here = above + lanes;
+                for (int i = 0; i < lanes; i++) here[i] = above[i] + line[i];
+            }
+            for (int y = 0; y < h; y++) {
+                int y0 = y - r < 0 ? 0 : y - r, y1 = y + r + 1 > h ? h : y + r + 1;
+                const double *top = prefix + (size_t)y0 * lanes, *bottom = prefix + (size_t)y1 * lanes;
+                float *line = planes[p] + y * rowLength;
+                for (int i = 0; i < lanes; i++) line[i] = (float)((bottom[i] - top[i]) / (y1 - y0));
+            }
+        }
+    }
+    free(prefix);
+    return 0;
+}
+
+static void outputRows(int begin, int end, void *arg) {
+    const t_guidedJob *job = arg;
+    size_t rowLength = (size_t)job->view->width * job->view->channels;
+    for (int y = begin; y < end; y++) {
+        uint8_t *row = job->view->rows[y];
+        const float *a = job->a + y * rowLength, *b = job->b + y * rowLength;
+        for (size_t i = 0; i < rowLength; i++) row[i] = clampByte(a[i] * row[i] + b[i]);
+    }
+}
+
+static t_status guided(const t_view *v, t_integral *in, int radius, float epsilon) {
+    size_t size = (size_t)v->width * v->height * v->channels;
+    t_guidedJob job = {v, in, radius < 0 ? 0 : radius, epsilon * epsilon, malloc(size * sizeof(float)),
+                       malloc(size * sizeof(float))};
+    t_status status = STATUS_NO_MEMORY;
+    if (job.a && job.b) {
+        size_t rowLength = (size_t)v->width * v->channels;
+        parallel_for(v->height, coefficientRows, &job);
+        if (parallel_forChecked(v->height, boxRows, &job) == 0 &&
+            parallel_forChecked((int)((rowLength + STRIP - 1) / STRIP), boxColumns, &job) == 0) {
+            parallel_for(v->height, outputRows, &job);
+            status = STATUS_OK;
+        }
+    }
+    free(job.a);
+    free(job.b);
+    return status;
+}
+
+t_status bmp8_guidedFilter(t_bmp8 *img, int radius, float epsilon) {
+    t_view v;
+    if (view8(img, &v) != 0) return STATUS_NO_MEMORY;
+    t_integral *in = integral_fromBmp8(img, INTEGRAL_SQUARES | INTEGRAL_PARALLEL);
+    t_status status = in ? guided(&v, in, radius, epsilon) : STATUS_NO_MEMORY;
+    integral_free(in);
+    free(v.rows);
+    return status;
+}
+
+t_status bmp24_guidedFilter(t_bmp24 *img, int radius, float epsilon) {
+    t_view v;
+    if (view24(img, &v) != 0) return STATUS_NO_MEMORY;
+    t_integral *in = integral_fromBmp24(img, INTEGRAL_SQUARES | INTEGRAL_PARALLEL);
+    t_status status = in ? guided(&v, in, radius, epsilon) : STATUS_NO_MEMORY;
+    integral_free(in);
+    free(v.rows);
+    return status;
+}
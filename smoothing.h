@@ -0,0 +1,28 @@
+#ifndef SMOOTHING_H
+#define SMOOTHING_H
+#include "bmp8.h"
+#include "bmp24.h"
+
+// === Edge-preserving smoothing ===
+// Bilateral filter approximated on a bilateral grid: pixels are accumulated
+// in a coarse (x, y, intensity) grid with cells of sigmaSpatial pixels by
+// sigmaRange gray levels, the grid is blurred and read back with trilinear
+// interpolation. The cost per pixel does not depend on sigmaSpatial (the grid
+// gets smaller when it grows). Color images use their gray level as the range
+// so the three channels are smoothed together.
+// The guided filter (He et al.) uses the image as its own guide: in each
+// (2 * radius + 1) window the output is a linear function of the input, which
+// is flat where the variance is below epsilon^2 and follows the edges where it
+// is above. Window means come from summed-area tables.
+// Both are split over the worker threads.
+
+// STATUS_INVALID_ARGUMENT for a sigma <= 0, STATUS_NO_MEMORY when memory runs
+// out; the image is unchanged on failure
+t_status bmp8_bilateral(t_bmp8 *img, float sigmaSpatial, float sigmaRange);
+t_status bmp24_bilateral(t_bmp24 *img, float sigmaSpatial, float sigmaRange);
+
+// epsilon is in gray levels. STATUS_NO_MEMORY, image unchanged, when memory runs out
+t_status bmp8_guidedFilter(t_bmp8 *img, int radius, float epsilon);
+t_status bmp24_guidedFilter(t_bmp24 *img, int radius, float epsilon);
+
+#endif // SMOOTHING_H
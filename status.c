@@ -0,0 +1,16 @@
+#include "status.h"
+
+const char *status_message(t_status status) {
+    switch (status) {
+        case STATUS_OK:               return "Success";
+        case STATUS_OPEN_FAILED:      return "Unable to open the file";
+        case STATUS_READ_FAILED:      return "Failed to read the file";
+        case STATUS_WRITE_FAILED:     return "Failed to write the file";
+        case STATUS_UNSUPPORTED:      return "Unsupported BMP format";
+        case STATUS_CORRUPTED:        return "Corrupted BMP file";
+        case STATUS_NO_MEMORY:        return "Memory allocation failed";
+        case STATUS_INVALID_ARGUMENT: return "Invalid argument";
+        case STATUS_BUFFER_TOO_SMALL: return "Output buffer too small";
+    }
+    return "Unknown error";
+}
@@ -0,0 +1,27 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+// === Result of the library functions that can fail ===
+// Loading functions return NULL and store the reason in an optional
+// t_status *status argument, the others return it directly.
+typedef enum {
+    STATUS_OK = 0,
+    STATUS_OPEN_FAILED,       // the file cannot be opened or created
+    STATUS_READ_FAILED,       // the file ends before the pixel data does
+    STATUS_WRITE_FAILED,
+    STATUS_UNSUPPORTED,       // valid BMP, but a depth / compression this loader does not handle
+    STATUS_CORRUPTED,         // invalid header or compressed stream
+    STATUS_NO_MEMORY,
+    STATUS_INVALID_ARGUMENT,
+    STATUS_BUFFER_TOO_SMALL   // the encoded image does not fit in the caller's buffer
+} t_status;
+
+// Short English description, never NULL
+const char *status_message(t_status status);
+
+// Stores s in *out when the caller asked for it
+static inline void status_set(t_status *out, t_status s) {
+    if (out) *out = s;
+}
+
+#endif // STATUS_H
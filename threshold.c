@@ -0,0 +1,82 @@
+#include "threshold.h"
+#include "integral.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <math.h>
+
+int threshold_otsu(const unsigned int *hist) {
+    double total = 0, sum = 0;
+    for (int i = 0; i < 256; i++) {
+        total += hist[i];
+        sum += (double)i * hist[i];
+    }
+    if (total == 0) return 0;
+
+    // Class 0 is [0, t), class 1 is [t, 255]
+    double weight0 = 0, sum0 = 0, best = -1;
+    int threshold = 0;
+    for (int t = 1; t < 256; t++) {
+        weight0 += hist[t - 1];
+        sum0 += (double)(t - 1) * hist[t - 1];
+        double weight1 = total - weight0;
+        if (weight0 == 0 || weight1 == 0) continue;
+        double diff = sum0 / weight0 - (sum - sum0) / weight1;
+        double between = weight0 * weight1 * diff * diff;
+        if (between > best) {
+            best = between;
+            threshold = t;
+        }
+    }
+    return threshold;
+}
+
+int bmp8_otsu(t_bmp8 *img) {
+    unsigned int *hist = bmp8_computeHistogram(img);
+    if (!hist) return -1;
+    int threshold = threshold_otsu(hist);
+    free(hist);
+    bmp8_threshold(img, threshold);
+    return threshold;
+}
+
+// ---- Adaptive ----
+
+typedef struct {
+    t_bmp8 *img;
+    const t_integral *in;   // top row first
+    t_adaptiveMethod method;
+    int half;
+    float k;
+} t_adaptiveJob;
+
+static void adaptiveRows(int begin, int end, void *arg) {
+    const t_adaptiveJob *job = arg;
+    const t_bmp8 *img = job->img;
+    int w = img->width, stride = ((w + 3) / 4) * 4, half = job->half;
+    for (int y = begin; y < end; y++) {
+        unsigned char *row = img->data + (size_t)(img->topDown ? y : (int)img->height - 1 - y) * stride;
+        for (int x = 0; x < w; x++) {
+            int x0 = x - half, y0 = y - half, x1 = x + half + 1, y1 = y + half + 1;
+            double mean = integral_mean(job->in, x0, y0, x1, y1, 0);
+            double threshold;
+            if (job->method == ADAPTIVE_MEAN) {
+                threshold = mean - job->k;
+            } else {
+                double deviation = sqrt(integral_variance(job->in, x0, y0, x1, y1, 0));
+                threshold = job->method == ADAPTIVE_NIBLACK ? mean + job->k * deviation
+                                                            : mean * (1 + job->k * (deviation / 128 - 1));
+            }
+            row[x] = row[x] >= threshold ? 255 : 0;
+        }
+    }
+}
+
+t_status bmp8_adaptiveThreshold(t_bmp8 *img, t_adaptiveMethod method, int window, float k) {
+    t_integral *in = integral_fromBmp8(img, method == ADAPTIVE_MEAN ? INTEGRAL_PARALLEL
+                                                                    : INTEGRAL_PARALLEL | INTEGRAL_SQUARES);
+    if (!in) return STATUS_NO_MEMORY;
+    t_adaptiveJob job = {img, in, method, (window < 1 ? 1 : window) / 2, k};
+    parallel_for(img->height, adaptiveRows, &job);
+    integral_free(in);
+    return STATUS_OK;
+}
@@ -0,0 +1,26 @@
+#ifndef THRESHOLD_H
+#define THRESHOLD_H
+#include "bmp8.h"
+
+// === Automatic thresholds ===
+// Otsu picks one global threshold from the histogram. The adaptive methods
+// compare every pixel with statistics of the window around it; the window
+// sums come from integral images (sum and sum of squares), so the cost per
+// pixel does not depend on the window size. Windows are clipped to the image.
+// Like bmp8_threshold, pixels >= threshold become 255 and the others 0.
+
+typedef enum {
+    ADAPTIVE_MEAN,      // mean - k (k is the constant C)
+    ADAPTIVE_NIBLACK,   // mean + k * std, k around -0.2
+    ADAPTIVE_SAUVOLA    // mean * (1 + k * (std / 128 - 1)), k around 0.2 to 0.5
+} t_adaptiveMethod;
+
+// Threshold maximizing the between-class variance of a 256-bin histogram
+int threshold_otsu(const unsigned int *hist);
+// Threshold the image with its Otsu threshold, returns the threshold or -1
+int bmp8_otsu(t_bmp8 *img);
+
+// window is the side of the square window (made odd), STATUS_NO_MEMORY when memory runs out
+t_status bmp8_adaptiveThreshold(t_bmp8 *img, t_adaptiveMethod method, int window, float k);
+
+#endif // THRESHOLD_H
@@ -0,0 +1,453 @@
+// Files past 2 GB on 32-bit systems, fseeko / ftello declared with -std=c11
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+#include "tiled.h"
+#include "bmp8.h"
+#include "bmp24.h"
+#include "bmpheader.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define TILED_LOCK(t) AcquireSRWLockExclusive(&(t)->lock)
+#define TILED_UNLOCK(t) ReleaseSRWLockExclusive(&(t)->lock)
+#define SEEK64(f, offset) _fseeki64(f, (__int64)(offset), SEEK_SET)
+#define TELL64(f) ((uint64_t)_ftelli64(f))
+#else
+#include <pthread.h>
+#include <sys/types.h>
+#define TILED_LOCK(t) pthread_mutex_lock(&(t)->lock)
+#define TILED_UNLOCK(t) pthread_mutex_unlock(&(t)->lock)
+#define SEEK64(f, offset) fseeko(f, (off_t)(offset), SEEK_SET)
+#define TELL64(f) ((uint64_t)ftello(f))
+#endif
+
+// The headers and palette are looked for in the first bytes of the file
+#define TILED_HEADER_WINDOW 65536
+
+typedef struct {
+    uint8_t *pixels;        // NULL when not in memory, TILED_TILE_SIZE rows even at the edges
+    int newer;              // LRU list of the tiles in memory, -1 at the ends
+    int older;
+    unsigned char dirty;    // changed since it was loaded
+    unsigned char spilled;  // its latest version is in the scratch file
+} t_tile;
+
+struct t_tiled {
+    int width;
+    int height;
+    int channels;
+    int tilesX;
+    int tilesY;
+    size_t tileBytes;
+    size_t budget;
+    size_t loaded;          // bytes of tiles in memory
+    t_tile *tiles;          // tilesX * tilesY, row-major
+    int newest;
+    int oldest;
+    FILE *source;           // BMP file, NULL for a blank image
+    uint64_t dataOffset;
+    uint32_t rowSize;
+    int topDown;
+    FILE *scratch;          // opened when a changed tile first leaves memory
+    t_status error;         // first read or write error
+#ifdef _WIN32
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+static void put32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; p[2] = (v >> 16) & 0xFF; p[3] = v >> 24;
+}
+static void put16(unsigned char *p, uint16_t v) {
+    p[0] = v & 0xFF; p[1] = v >> 8;
+}
+
+// ---- Creation ----
+
+static t_tiled *tiled_alloc(int width, int height, int channels, size_t memoryBudget) {
+    if (width <= 0 || height <= 0 || (channels != 1 && channels != 3)) return NULL;
+    t_tiled *t = calloc(1, sizeof(t_tiled));
+    if (!t) return NULL;
+    t->width = width;
+    t->height = height;
+    t->channels = channels;
+    t->tilesX = (width + TILED_TILE_SIZE - 1) / TILED_TILE_SIZE;
+    t->tilesY = (height + TILED_TILE_SIZE - 1) / TILED_TILE_SIZE;
+    t->tileBytes = (size_t)TILED_TILE_SIZE * TILED_TILE_SIZE * channels;
+    t->budget = memoryBudget;
+    t->newest = t->oldest = -1;
+    t->error = STATUS_OK;
+    t->tiles = calloc((size_t)t->tilesX * t->tilesY, sizeof(t_tile));
+    if (!t->tiles) {
+        free(t);
+        return NULL;
+    }
+#ifdef _WIN32
+    InitializeSRWLock(&t->lock);
+#else
+    pthread_mutex_init(&t->lock, NULL);
+#endif
+    return t;
+}
+
+t_tiled *tiled_create(int width, int height, int channels, size_t memoryBudget) {
+    return tiled_alloc(width, height, channels, memoryBudget);
+}
+
+t_tiled *tiled_open(const char *filename, size_t memoryBudget, t_status *status) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        status_set(status, STATUS_OPEN_FAILED);
+        return NULL;
+    }
+    unsigned char *head = malloc(TILED_HEADER_WINDOW);
+    size_t length = head ? fread(head, 1, TILED_HEADER_WINDOW, f) : 0;
+    fseek(f, 0, SEEK_END);
+    uint64_t fileSize = TELL64(f);
+
+    t_bmpHeader h;
+    t_status s = STATUS_OK;
+    if (!head) s = STATUS_NO_MEMORY;
+    else if (bmp_parseHeader(head, length, &h) != 0) s = STATUS_CORRUPTED;
+    else if ((h.bitCount != 8 && h.bitCount != 24) || h.compression != 0) s = STATUS_UNSUPPORTED;
+    else if (h.dataOffset + (uint64_t)h.rowSize * h.height > fileSize) s = STATUS_READ_FAILED;
+    free(head);
+
+    t_tiled *t = NULL;
+    if (s == STATUS_OK) {
+        t = tiled_alloc(h.width, h.height, h.bitCount / 8, memoryBudget);
+        if (!t) s = STATUS_NO_MEMORY;
+    }
+    if (!t) {
+        fclose(f);
+        status_set(status, s);
+        return NULL;
+    }
+    t->source = f;
+    t->dataOffset = h.dataOffset;
+    t->rowSize = h.rowSize;
+    t->topDown = h.topDown;
+    status_set(status, STATUS_OK);
+    return t;
+}
+
+void tiled_free(t_tiled *t) {
+    if (!t) return;
+    for (int i = 0; i < t->tilesX * t->tilesY; i++) free(t->tiles[i].pixels);
+    if (t->source) fclose(t->source);
+    if (t->scratch) fclose(t->scratch);
+#ifndef _WIN32
+    pthread_mutex_destroy(&t->lock);
+#endif
+    free(t->tiles);
+    free(t);
+}
+
+int tiled_width(const t_tiled *t) {
+    return t->width;
+}
+
+int tiled_height(const t_tiled *t) {
+    return t->height;
+}
+
+int tiled_channels(const t_tiled *t) {
+    return t->channels;
+}
+
+size_t tiled_memoryUsed(const t_tiled *t) {
+    return t->loaded;
+}
+
+// ---- Tile cache (called with the lock held) ----
+
+static void setError(t_tiled *t, t_status s) {
+    if (t->error == STATUS_OK) t->error = s;
+}
+
+static void unlinkTile(t_tiled *t, int i) {
+    t_tile *tile = &t->tiles[i];
+    if (tile->newer >= 0) t->tiles[tile->newer].older = tile->older;
+    else t->newest = tile->older;
+    if (tile->older >= 0) t->tiles[tile->older].newer = tile->newer;
+    else t->oldest = tile->newer;
+}
+
+static void pushNewest(t_tiled *t, int i) {
+    t->tiles[i].newer = -1;
+    t->tiles[i].older = t->newest;
+    if (t->newest >= 0) t->tiles[t->newest].newer = i;
+    t->newest = i;
+    if (t->oldest < 0) t->oldest = i;
+}
+
+// Tiles sit at index * tileBytes in the scratch file
+static void evictTile(t_tiled *t, int i) {
+    t_tile *tile = &t->tiles[i];
+    if (tile->dirty) {
+        if (!t->scratch) t->scratch = tmpfile();
+        if (!t->scratch || SEEK64(t->scratch, (uint64_t)i * t->tileBytes) != 0 ||
+            fwrite(tile->pixels, 1, t->tileBytes, t->scratch) != t->tileBytes) {
+            // Keep it rather than lose the changes
+            setError(t, STATUS_WRITE_FAILED);
+            return;
+        }
+        tile->spilled = 1;
+        tile->dirty = 0;
+    }
+    unlinkTile(t, i);
+    free(tile->pixels);
+    tile->pixels = NULL;
+    t->loaded -= t->tileBytes;
+}
+
+// Rows of the tile from the BMP file, BGR turned into RGB
+static void readSource(t_tiled *t, int i, uint8_t *pixels) {
+    int x0 = i % t->tilesX * TILED_TILE_SIZE, y0 = i / t->tilesX * TILED_TILE_SIZE;
+    int w = t->width - x0 < TILED_TILE_SIZE ? t->width - x0 : TILED_TILE_SIZE;
+    int h = t->height - y0 < TILED_TILE_SIZE ? t->height - y0 : TILED_TILE_SIZE;
+    size_t rowBytes = (size_t)w * t->channels;
+    for (int r = 0; r < h; r++) {
+        int y = y0 + r;
+        uint64_t fileRow = t->topDown ? y : t->height - 1 - y;
+        uint8_t *row = pixels + (size_t)r * TILED_TILE_SIZE * t->channels;
+        if (SEEK64(t->source, t->dataOffset + fileRow * t->rowSize + (uint64_t)x0 * t->channels) != 0 ||
+            fread(row, 1, rowBytes, t->source) != rowBytes) {
+            setError(t, STATUS_READ_FAILED);
+            return;
+        }
+        if (t->channels == 3) {
+            for (int x = 0; x < w; x++) {
+                uint8_t b = row[3 * x];
+                row[3 * x] = row[3 * x + 2];
+                row[3 * x + 2] = b;
+            }
+        }
+    }
+}
+
+// Pixels of tile i, loaded if needed, NULL on allocation failure
+static uint8_t *tilePixels(t_tiled *t, int i) {
+    t_tile *tile = &t->tiles[i];
+    if (tile->pixels) {
+        if (t->newest != i) {
+            unlinkTile(t, i);
+            pushNewest(t, i);
+        }
+        return tile->pixels;
+    }
+
+    while (t->oldest >= 0 && t->loaded + t->tileBytes > t->budget) {
+        int oldest = t->oldest;
+        evictTile(t, oldest);
+        if (t->tiles[oldest].pixels) break;
+    }
+    tile->pixels = calloc(t->tileBytes, 1);
+    if (!tile->pixels) {
+        setError(t, STATUS_NO_MEMORY);
+        return NULL;
+    }
+    if (tile->spilled) {
+        if (SEEK64(t->scratch, (uint64_t)i * t->tileBytes) != 0 ||
+            fread(tile->pixels, 1, t->tileBytes, t->scratch) != t->tileBytes) setError(t, STATUS_READ_FAILED);
+    } else if (t->source) {
+        readSource(t, i, tile->pixels);
+    }
+    tile->dirty = 0;
+    pushNewest(t, i);
+    t->loaded += t->tileBytes;
+    return tile->pixels;
+}
+
+// ---- Rectangles ----
+
+// rows[y] is row r.y + y of the rectangle (already clipped)
+static t_status copyRect(t_tiled *t, t_rect r, uint8_t **rows, int write) {
+    int tx0 = r.x / TILED_TILE_SIZE, tx1 = (r.x + r.width - 1) / TILED_TILE_SIZE;
+    int ty0 = r.y / TILED_TILE_SIZE, ty1 = (r.y + r.height - 1) / TILED_TILE_SIZE;
+    TILED_LOCK(t);
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            uint8_t *pixels = tilePixels(t, ty * t->tilesX + tx);
+            if (!pixels) continue;
+            t_rect part = rect_clip((t_rect){r.x - tx * TILED_TILE_SIZE, r.y - ty * TILED_TILE_SIZE, r.width, r.height},
+                                    TILED_TILE_SIZE, TILED_TILE_SIZE);
+            size_t bytes = (size_t)part.width * t->channels;
+            for (int y = part.y; y < part.y + part.height; y++) {
+                uint8_t *tileRow = pixels + ((size_t)y * TILED_TILE_SIZE + part.x) * t->channels;
+                uint8_t *row = rows[ty * TILED_TILE_SIZE + y - r.y] + (size_t)(tx * TILED_TILE_SIZE + part.x - r.x) * t->channels;
+                if (write) memcpy(tileRow, row, bytes);
+                else memcpy(row, tileRow, bytes);
+            }
+            if (write) t->tiles[ty * t->tilesX + tx].dirty = 1;
+        }
+    }
+    t_status status = t->error;
+    TILED_UNLOCK(t);
+    return status;
+}
+
+// Contiguous buffer of the public functions, with the part outside the image
+static t_status copyBuffer(t_tiled *t, t_rect r, uint8_t *buffer, int write) {
+    size_t rowBytes = (size_t)r.width * t->channels;
+    t_rect inside = rect_clip(r, t->width, t->height);
+    if (!write) memset(buffer, 0, rowBytes * (r.height > 0 ? r.height : 0));
+    if (rect_isEmpty(inside)) return t->error;
+    uint8_t **rows = malloc(inside.height * sizeof(uint8_t *));
+    if (!rows) return STATUS_NO_MEMORY;
+    for (int y = 0; y < inside.height; y++) {
+        rows[y] = buffer + (size_t)(inside.y - r.y + y) * rowBytes + (size_t)(inside.x - r.x) * t->channels;
+    }
+    t_status status = copyRect(t, inside, rows, write);
+    free(rows);
+    return status;
+}
+
+t_status tiled_read(t_tiled *t, t_rect r, uint8_t *out) {
+    return copyBuffer(t, r, out, 0);
+}
+
+t_status tiled_write(t_tiled *t, t_rect r, const uint8_t *in) {
+    return copyBuffer(t, r, (uint8_t *)in, 1);
+}
+
+// ---- Filters ----
+
+typedef struct {
+    t_tiled *src;
+    t_tiled *dst;
+    float **kernel;
+    int kernelSize;
+} t_filterJob;
+
+// Tile and halo as a small 8-bit image (top row first, as the tiles)
+static void filterTile8(const t_filterJob *job, t_rect tile, t_rect source) {
+    t_bmp8 *part = bmp8_create(source.width, source.height);
+    uint8_t **rows = malloc(source.height * sizeof(uint8_t *));
+    if (!part || !rows) {
+        TILED_LOCK(job->dst);
+        setError(job->dst, STATUS_NO_MEMORY);
+        TILED_UNLOCK(job->dst);
+    } else {
+        int stride = ((source.width + 3) / 4) * 4;
+        part->topDown = 1;
+        for (int y = 0; y < source.height; y++) rows[y] = part->data + (size_t)y * stride;
+        copyRect(job->src, source, rows, 0);
+        bmp8_applyFilter(part, job->kernel, job->kernelSize);
+        for (int y = 0; y < source.height; y++) rows[y] = part->data + (size_t)y * stride + (tile.x - source.x);
+        copyRect(job->dst, tile, rows + (tile.y - source.y), 1);
+    }
+    free(rows);
+    bmp8_free(part);
+}
+
+static void filterTile24(const t_filterJob *job, t_rect tile, t_rect source) {
+    t_bmp24 *part = bmp24_allocate(source.width, source.height, 24);
+    uint8_t **rows = malloc(source.height * sizeof(uint8_t *));
+    if (!part || !rows) {
+        TILED_LOCK(job->dst);
+        setError(job->dst, STATUS_NO_MEMORY);
+        TILED_UNLOCK(job->dst);
+    } else {
+        for (int y = 0; y < source.height; y++) rows[y] = (uint8_t *)part->data[y];
+        copyRect(job->src, source, rows, 0);
+        bmp24_applyFilter(part, job->kernel, job->kernelSize);
+        // The filter replaced the rows
+        for (int y = 0; y < source.height; y++) rows[y] = (uint8_t *)(part->data[y] + (tile.x - source.x));
+        copyRect(job->dst, tile, rows + (tile.y - source.y), 1);
+    }
+    free(rows);
+    bmp24_free(part);
+}
+
+static void filterTiles(int begin, int end, void *arg) {
+    const t_filterJob *job = arg;
+    const t_tiled *t = job->dst;
+    for (int i = begin; i < end; i++) {
+        t_rect tile = {i % t->tilesX * TILED_TILE_SIZE, i / t->tilesX * TILED_TILE_SIZE, TILED_TILE_SIZE, TILED_TILE_SIZE};
+        tile = rect_clip(tile, t->width, t->height);
+        t_rect source = rect_clip(rect_grow(tile, job->kernelSize / 2), t->width, t->height);
+        if (t->channels == 1) filterTile8(job, tile, source);
+        else filterTile24(job, tile, source);
+    }
+}
+
+t_status tiled_applyFilter(t_tiled *src, t_tiled *dst, float **kernel, int kernelSize) {
+    if (src == dst || src->width != dst->width || src->height != dst->height || src->channels != dst->channels ||
+        kernelSize < 1 || kernelSize % 2 == 0) return STATUS_INVALID_ARGUMENT;
+    t_filterJob job = {src, dst, kernel, kernelSize};
+    parallel_for(dst->tilesX * dst->tilesY, filterTiles, &job);
+    return src->error != STATUS_OK ? src->error : dst->error;
+}
+
+t_status tiled_applyLUT(t_tiled *t, const t_lut *lut) {
+    TILED_LOCK(t);
+    for (int i = 0; i < t->tilesX * t->tilesY; i++) {
+        uint8_t *p = tilePixels(t, i);
+        if (!p) continue;
+        for (size_t k = 0; k < t->tileBytes; k += t->channels) {
+            for (int c = 0; c < t->channels; c++) p[k + c] = lut->map[c][p[k + c]];
+        }
+        t->tiles[i].dirty = 1;
+    }
+    t_status status = t->error;
+    TILED_UNLOCK(t);
+    return status;
+}
+
+// ---- Save ----
+
+t_status tiled_save(t_tiled *t, const char *filename) {
+    uint32_t paletteSize = t->channels == 1 ? 1024 : 0;
+    uint32_t offset = 14 + 40 + paletteSize;
+    uint64_t rowSize = ((uint64_t)t->width * t->channels + 3) / 4 * 4;
+    uint64_t imageSize = rowSize * t->height;
+    // Sizes that do not fit are left at 0, readers compute them
+    uint32_t fileSize32 = offset + imageSize <= UINT32_MAX ? (uint32_t)(offset + imageSize) : 0;
+    uint32_t imageSize32 = imageSize <= UINT32_MAX ? (uint32_t)imageSize : 0;
+
+    unsigned char header[14 + 40 + 1024] = {0};
+    put16(header, 0x4D42);
+    put32(header + 2, fileSize32);
+    put32(header + 10, offset);
+    unsigned char *info = header + 14;
+    put32(info, 40);
+    put32(info + 4, (uint32_t)t->width);
+    put32(info + 8, (uint32_t)t->height);
+    put16(info + 12, 1);
+    put16(info + 14, (uint16_t)(t->channels * 8));
+    put32(info + 20, imageSize32);
+    put32(info + 24, 2835);
+    put32(info + 28, 2835);
+    if (t->channels == 1) {
+        put32(info + 32, 256);
+        for (int i = 0; i < 256; i++) memset(info + 40 + 4 * i, i, 3);
+    }
+
+    t_bmpWriter w = {fopen(filename, "wb"), NULL, STATUS_OK};
+    if (!w.file) return STATUS_OPEN_FAILED;
+    bmp_write(&w, header, offset);
+    uint8_t *row = calloc(rowSize, 1);
+    if (!row) w.status = STATUS_NO_MEMORY;
+    for (int y = t->height - 1; y >= 0 && w.status == STATUS_OK; y--) {
+        t_status s = tiled_read(t, (t_rect){0, y, t->width, 1}, row);
+        if (s != STATUS_OK) w.status = s;
+        if (t->channels == 3) {
+            for (int x = 0; x < t->width; x++) {
+                uint8_t r = row[3 * x];
+                row[3 * x] = row[3 * x + 2];
+                row[3 * x + 2] = r;
+            }
+        }
+        bmp_write(&w, row, rowSize);
+    }
+    free(row);
+    if (fclose(w.file) != 0 && w.status == STATUS_OK) w.status = STATUS_WRITE_FAILED;
+    return w.status;
+}
@@ -0,0 +1,52 @@
+#ifndef TILED_H
+#define TILED_H
+#include <stddef.h>
+#include <stdint.h>
+#include "lut.h"
+#include "roi.h"
+#include "status.h"
+
+// === Tiled images larger than memory ===
+// The pixels are split in TILED_TILE_SIZE x TILED_TILE_SIZE tiles listed in a
+// row-major directory. A tile is read from the BMP file the first time it is
+// touched, and the least recently used tiles leave memory when the budget is
+// reached (those that changed go to a temporary file and come back from it).
+// Pixels are top row first: one gray byte, or red, green, blue (t_pixel).
+// 8-bit files keep their palette indices, like bmp8_loadImage.
+// Filters run tile by tile on the worker threads, each tile read with the
+// halo its kernel needs, so the memory used stays near the budget whatever
+// the size of the image. One tiled image may be used by several threads.
+
+#define TILED_TILE_SIZE 256
+
+typedef struct t_tiled t_tiled;
+
+// Uncompressed 8-bit or 24-bit BMP file, kept open until tiled_free.
+// A budget smaller than a tile still keeps one tile in memory
+t_tiled *tiled_open(const char *filename, size_t memoryBudget, t_status *status);
+// Blank image (all 0), channels is 1 or 3. NULL on invalid size or allocation failure
+t_tiled *tiled_create(int width, int height, int channels, size_t memoryBudget);
+void tiled_free(t_tiled *img);
+
+int tiled_width(const t_tiled *img);
+int tiled_height(const t_tiled *img);
+int tiled_channels(const t_tiled *img);
+// Bytes of tiles currently in memory
+size_t tiled_memoryUsed(const t_tiled *img);
+
+// Copy a rectangle to / from out, r.width * channels bytes per row, top row
+// first. Pixels outside the image read as 0 and are not written.
+// The first read or write error of the image is returned
+t_status tiled_read(t_tiled *img, t_rect r, uint8_t *out);
+t_status tiled_write(t_tiled *img, t_rect r, const uint8_t *in);
+
+// Same pixels as bmp8/bmp24_applyFilter and applyLUT on the whole image held
+// top row first (the first kernel row is the top one), up to the rounding of
+// the FFT for big kernels. dst is another image of the same size
+t_status tiled_applyFilter(t_tiled *src, t_tiled *dst, float **kernel, int kernelSize);
+t_status tiled_applyLUT(t_tiled *img, const t_lut *lut);
+
+// Bottom-up BMP file, gray palette for 8-bit images, streamed row by row
+t_status tiled_save(t_tiled *img, const char *filename);
+
+#endif // TILED_H